@@ -0,0 +1,211 @@
+#include "handlers/display/DisplayFormat.h"
+
+#include <boost/program_options.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cmath>
+
+// Standard MIDI File: 120 bpm, 480 ticks per quarter
+#define SMF_DIVISION 480
+#define SMF_TEMPO 500000
+
+namespace
+{
+  namespace po = boost::program_options;
+
+  void readRecording(const std::string & filename, ASI::Display::BinaryHeader & header, std::vector<ASI::Display::BinaryRecord> & records)
+  {
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if (!in)
+    {
+      throw std::runtime_error("Cannot open " + filename);
+    }
+
+    if (!in.read((char *)&header, sizeof(header)) || memcmp(header.magic, DISPLAY_BINARY_MAGIC, sizeof(header.magic)) != 0)
+    {
+      throw std::runtime_error("Not a binary display recording: " + filename);
+    }
+
+    if (header.version != DISPLAY_BINARY_VERSION)
+    {
+      throw std::runtime_error("Unsupported version: " + std::to_string(header.version));
+    }
+
+    if (header.sampleRate == 0)
+    {
+      throw std::runtime_error("Invalid sample rate");
+    }
+
+    // a partial record at the end (e.g. still being written) is ignored
+    ASI::Display::BinaryRecord record;
+    while (in.read((char *)&record, sizeof(record)))
+    {
+      records.push_back(record);
+    }
+  }
+
+  // times are relative to the first event
+  void writeCsv(std::ostream & out, const ASI::Display::BinaryHeader & header, const std::vector<ASI::Display::BinaryRecord> & records)
+  {
+    ASI::Display::CsvFormatter formatter;
+    formatter.writeHeader(out);
+
+    for (const ASI::Display::BinaryRecord & record : records)
+    {
+      const double time = double(record.frame - records.front().frame) / header.sampleRate;
+      formatter.write(out, time, record.data);
+    }
+  }
+
+  void writeBigEndian(std::string & out, const uint32_t value, const size_t bytes)
+  {
+    for (size_t i = bytes; i > 0; --i)
+    {
+      out.push_back(char((value >> (8 * (i - 1))) & 0xff));
+    }
+  }
+
+  void writeVariableLength(std::string & out, const uint32_t value)
+  {
+    char buffer[5];
+    size_t size = 0;
+    uint32_t v = value;
+    do
+    {
+      buffer[size] = v & 0x7f;
+      if (size > 0)
+      {
+	buffer[size] |= 0x80;
+      }
+      ++size;
+      v >>= 7;
+    } while (v > 0);
+
+    while (size > 0)
+    {
+      --size;
+      out.push_back(buffer[size]);
+    }
+  }
+
+  // format 0, system messages are skipped
+  void writeMidi(std::ostream & out, const ASI::Display::BinaryHeader & header, const std::vector<ASI::Display::BinaryRecord> & records)
+  {
+    const double ticksPerSecond = SMF_DIVISION * 1000000.0 / SMF_TEMPO;
+
+    std::string track;
+
+    // tempo
+    writeVariableLength(track, 0);
+    track.append("\xff\x51\x03", 3);
+    writeBigEndian(track, SMF_TEMPO, 3);
+
+    uint64_t previous = 0;
+    for (const ASI::Display::BinaryRecord & record : records)
+    {
+      if (record.size == 0 || record.data[0] < 0x80 || record.data[0] >= 0xf0)
+      {
+	continue;
+      }
+
+      const double seconds = double(record.frame - records.front().frame) / header.sampleRate;
+      const uint64_t tick = std::llround(seconds * ticksPerSecond);
+
+      writeVariableLength(track, tick - previous);
+      track.append((const char *)record.data, record.size);
+      previous = tick;
+    }
+
+    // end of track
+    writeVariableLength(track, 0);
+    track.append("\xff\x2f\x00", 3);
+
+    std::string file;
+    file.append("MThd", 4);
+    writeBigEndian(file, 6, 4);
+    writeBigEndian(file, 0, 2);            // format
+    writeBigEndian(file, 1, 2);            // tracks
+    writeBigEndian(file, SMF_DIVISION, 2);
+    file.append("MTrk", 4);
+    writeBigEndian(file, track.size(), 4);
+    file.append(track);
+
+    out.write(file.data(), file.size());
+  }
+
+}
+
+int main(int argc, char **args)
+{
+  po::options_description desc("ASIConvert [options] input");
+  desc.add_options()
+    ("help,h", "Print this help message")
+    ("input,i", po::value<std::string>(), "Binary recording (--display:format=binary)")
+    ("output,o", po::value<std::string>()->default_value("-"), "Output filename")
+    ("format,f", po::value<std::string>()->default_value("csv"), "Output format: csv / midi");
+
+  po::positional_options_description positional;
+  positional.add("input", 1);
+
+  po::variables_map vm;
+  try
+  {
+    po::store(po::command_line_parser(argc, args).options(desc).positional(positional).run(), vm);
+
+    if (vm.count("help") || !vm.count("input"))
+    {
+      std::cout << "Converter of the Display binary recordings" << std::endl << std::endl << desc << std::endl;
+      return 3;
+    }
+  }
+  catch (const po::error& e)
+  {
+    std::cerr << "ERROR: " << e.what() << std::endl << desc << std::endl;
+    return 3;
+  }
+
+  try
+  {
+    const std::string & format = vm["format"].as<std::string>();
+    if (format != "csv" && format != "midi")
+    {
+      throw std::runtime_error("Unknown format: " + format);
+    }
+
+    ASI::Display::BinaryHeader header;
+    std::vector<ASI::Display::BinaryRecord> records;
+    readRecording(vm["input"].as<std::string>(), header, records);
+
+    const std::string & filename = vm["output"].as<std::string>();
+    std::ofstream file;
+    if (filename != "-")
+    {
+      file.open(filename.c_str(), std::ios::binary);
+      if (!file)
+      {
+	throw std::runtime_error("Cannot open " + filename);
+      }
+    }
+    std::ostream & out = filename == "-" ? std::cout : file;
+
+    if (format == "csv")
+    {
+      writeCsv(out, header, records);
+    }
+    else
+    {
+      writeMidi(out, header, records);
+    }
+  }
+  catch (const std::exception & e)
+  {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
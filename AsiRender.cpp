@@ -0,0 +1,145 @@
+#include "offline/OfflineRenderer.h"
+
+#include <boost/program_options.hpp>
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <cstring>
+
+namespace
+{
+  namespace po = boost::program_options;
+
+  std::string getOutputName(const std::string & directory, const std::string & input)
+  {
+    const size_t slash = input.find_last_of('/');
+    std::string name = slash == std::string::npos ? input : input.substr(slash + 1);
+
+    const size_t dot = name.find_last_of('.');
+    if (dot != std::string::npos)
+    {
+      name.resize(dot);
+    }
+
+    return directory + "/" + name + ".wav";
+  }
+
+  void printStatistics(const ASI::Offline::RenderJob & job, const jack_nframes_t sampleRate)
+  {
+    if (!job.error.empty())
+    {
+      std::cout << job.input << ": ERROR: " << job.error << std::endl;
+      return;
+    }
+
+    const double audio = double(job.statistics.frames) / double(sampleRate);
+    const double render = job.statistics.renderSeconds;
+
+    std::cout << job.input << " -> " << job.output << ": ";
+    std::cout << audio << " s in " << render << " s, ";
+    std::cout << audio / render << " x real time" << std::endl;
+  }
+
+}
+
+int main(int argc, char **args)
+{
+  // everything after "--" goes to the handlers (same options as asisynth)
+  int renderArgc = argc;
+  std::vector<std::string> handlerArguments;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(args[i], "--") == 0)
+    {
+      renderArgc = i;
+      handlerArguments.assign(args + i + 1, args + argc);
+      break;
+    }
+  }
+
+  po::options_description desc("ASIRender [options] input... -- [asisynth options]");
+  desc.add_options()
+    ("help,h", "Print this help message")
+    ("input,i", po::value<std::vector<std::string> >(), "Input files (MIDI or melody json)")
+    ("output,o", po::value<std::string>()->default_value("."), "Output directory")
+    ("rate,r", po::value<jack_nframes_t>()->default_value(48000), "Sample rate")
+    ("period,n", po::value<jack_nframes_t>()->default_value(256), "Frames per period")
+    ("tail,t", po::value<double>()->default_value(2.0), "Seconds rendered after the last event")
+    ("jobs,j", po::value<size_t>()->default_value(std::thread::hardware_concurrency()), "Number of parallel renders");
+
+  po::positional_options_description positional;
+  positional.add("input", -1);
+
+  po::variables_map vm;
+  try
+  {
+    po::store(po::command_line_parser(renderArgc, args).options(desc).positional(positional).run(), vm);
+
+    if (vm.count("help") || !vm.count("input"))
+    {
+      std::cout << "Offline renderer for ASISynth" << std::endl << std::endl << desc << std::endl;
+      return 3;
+    }
+  }
+  catch (const po::error& e)
+  {
+    std::cerr << "ERROR: " << e.what() << std::endl << desc << std::endl;
+    return 3;
+  }
+
+  ASI::Offline::RenderOptions options;
+  options.sampleRate = vm["rate"].as<jack_nframes_t>();
+  options.bufferSize = vm["period"].as<jack_nframes_t>();
+  options.tail = vm["tail"].as<double>();
+  options.handlerArguments = handlerArguments;
+
+  if (options.sampleRate == 0 || options.bufferSize == 0)
+  {
+    std::cerr << "ERROR: rate and period must be positive" << std::endl;
+    return 3;
+  }
+
+  const std::string & directory = vm["output"].as<std::string>();
+  const size_t threads = vm["jobs"].as<size_t>();
+
+  std::vector<ASI::Offline::RenderJob> jobs;
+  for (const std::string & input : vm["input"].as<std::vector<std::string> >())
+  {
+    ASI::Offline::RenderJob job;
+    job.input = input;
+    job.output = getOutputName(directory, input);
+    job.statistics.frames = 0;
+    job.statistics.cycles = 0;
+    job.statistics.renderSeconds = 0.0;
+    jobs.push_back(job);
+  }
+
+  const auto t0 = std::chrono::steady_clock::now();
+  ASI::Offline::renderFiles(options, threads, jobs);
+  const auto t1 = std::chrono::steady_clock::now();
+
+  const double wallClock = std::chrono::duration<double>(t1 - t0).count();
+
+  int result = 0;
+  double audio = 0.0;
+  for (const ASI::Offline::RenderJob & job : jobs)
+  {
+    printStatistics(job, options.sampleRate);
+    audio += double(job.statistics.frames) / double(options.sampleRate);
+    if (!job.error.empty())
+    {
+      result = 1;
+    }
+  }
+
+  std::cout << std::endl;
+  std::cout << "Files: " << jobs.size() << std::endl;
+  std::cout << "Audio: " << audio << " s" << std::endl;
+  std::cout << "Wall clock: " << wallClock << " s" << std::endl;
+  std::cout << "Throughput: " << audio / wallClock << " x real time" << std::endl;
+
+  return result;
+}
@@ -1,11 +1,18 @@
 #include "I_JackHandler.h"
 #include "Factory.h"
+#include "Histogram.h"
+#include "HistoryRing.h"
+#include "ParallelChain.h"
+#include "Timing.h"
 
 #include <iostream>
+#include <iomanip>
 #include <vector>
+#include <string>
 #include <memory>
 #include <atomic>
-#include <chrono>
+#include <cstring>
+#include <algorithm>
 
 #include <jack/jack.h>
 #include <jack/midiport.h>
@@ -13,39 +20,139 @@
 #include <unistd.h>
 #include <signal.h>
 
+#define MISSED_DEADLINES_HISTORY 1024
+
 namespace
 {
 
   typedef std::vector<std::shared_ptr<ASI::I_JackHandler> > Handlers_t;
 
+  // a cycle which took longer than nframes / sr
+  struct MissedDeadline
+  {
+    jack_nframes_t frame;       // at the start of the cycle
+    jack_nframes_t nframes;
+    ASI::ticks_t elapsed;
+    ASI::ticks_t deadline;
+
+    size_t slowest;             // index of the slowest handler
+    ASI::ticks_t slowestElapsed;
+
+    size_t events;              // on all our MIDI inputs
+    size_t xruns;               // reported so far
+  };
+
   struct ClientData
   {
-    size_t time;
-    double maxLoad; // nedd to "* sr / 1000000.0" later
+    ASI::ticks_t time;
+    double maxLoad; // ticks per frame, need "* sr / ticksPerSecond" later
     jack_nframes_t frames;
     jack_nframes_t sr;
 
     Handlers_t handlers;
+
+    // null if the handlers run sequentially
+    std::unique_ptr<ASI::ParallelChain> parallel;
+
+    // 1 per handler (same order) and 1 for the whole chain
+    // written by the process callback only
+    std::vector<ASI::LatencyHistogram> latency;
+    ASI::LatencyHistogram total;
+
+    double ticksPerFrame;
+    std::vector<jack_port_t *> midiInputs;
+    jack_client_t * client;
+
+    ASI::HistoryRing<MissedDeadline, MISSED_DEADLINES_HISTORY> missedDeadlines;
+    std::atomic<size_t> xruns;
+
     std::atomic<bool> alive;
+    std::atomic<bool> dump;
   };
 
+  // each handler depends on the one before it (e.g. without --graph):
+  // ParallelChain could never run 2 of them at the same time
+  bool isSequential(const std::vector<std::vector<size_t> > & dependencies)
+  {
+    for (size_t i = 1; i < dependencies.size(); ++i)
+    {
+      if (std::find(dependencies[i].begin(), dependencies[i].end(), i - 1) == dependencies[i].end())
+      {
+	return false;
+      }
+    }
+    return true;
+  }
+
   // here so it can be accessed by the signal handler
   // but I'd like to keep it on the stack of the app
   ClientData data;
 
   int process(jack_nframes_t nframes, void *arg)
   {
-    auto t0 = std::chrono::high_resolution_clock::now();
+    const ASI::ticks_t t0 = ASI::readTicks();
     ClientData & data = *reinterpret_cast<ClientData *>(arg);
     Handlers_t & handlers = data.handlers;
 
-    for (auto & handler : handlers)
+    size_t slowest = 0;
+    ASI::ticks_t slowestElapsed = 0;
+
+    ASI::ticks_t previous = t0;
+    if (data.parallel)
     {
-      handler->process(nframes);
+      data.parallel->process(nframes);
+      previous = ASI::readTicks();
     }
-    auto t1 = std::chrono::high_resolution_clock::now();
 
-    const size_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+    for (size_t i = 0; i < handlers.size(); ++i)
+    {
+      ASI::ticks_t elapsed;
+      if (data.parallel)
+      {
+	elapsed = data.parallel->getElapsed(i);
+      }
+      else
+      {
+	handlers[i]->process(nframes);
+
+	const ASI::ticks_t now = ASI::readTicks();
+	elapsed = now - previous;
+	previous = now;
+      }
+
+      data.latency[i].add(elapsed);
+
+      if (elapsed > slowestElapsed)
+      {
+	slowest = i;
+	slowestElapsed = elapsed;
+      }
+    }
+
+    const ASI::ticks_t elapsed = previous - t0;
+    data.total.add(elapsed);
+
+    const ASI::ticks_t deadline = nframes * data.ticksPerFrame;
+    if (elapsed > deadline)
+    {
+      MissedDeadline missed;
+      missed.frame = jack_last_frame_time(data.client);
+      missed.nframes = nframes;
+      missed.elapsed = elapsed;
+      missed.deadline = deadline;
+      missed.slowest = slowest;
+      missed.slowestElapsed = slowestElapsed;
+      missed.xruns = data.xruns.load(std::memory_order_relaxed);
+
+      // we are late already, this is cheap enough
+      missed.events = 0;
+      for (jack_port_t * port : data.midiInputs)
+      {
+	missed.events += jack_midi_get_event_count(jack_port_get_buffer(port, nframes));
+      }
+
+      data.missedDeadlines.push(missed);
+    }
 
     data.frames += nframes;
     data.time += elapsed;
@@ -56,6 +163,13 @@ namespace
     return 0;
   }
 
+  int xrun(void *arg)
+  {
+    ClientData & data = *reinterpret_cast<ClientData *>(arg);
+    ++data.xruns;
+    return 0;
+  }
+
   void shutdown(void *arg)
   {
     ClientData & data = *reinterpret_cast<ClientData *>(arg);
@@ -74,13 +188,108 @@ namespace
     data.alive = false;
   }
 
+  // kill -USR1 prints the missed deadlines collected so far
+  void dumpHandler(int i)
+  {
+    data.dump = true;
+  }
+
+  void printLatency(std::ostream & out, const char * name, const ASI::HistogramSnapshot & snapshot, const double period)
+  {
+    // as a % of the period
+    const double coeff = 100.0 / period;
+
+    out << std::setw(12) << name;
+    out << std::setw(12) << snapshot.count;
+    out << std::setw(10) << snapshot.percentile(0.5) * coeff;
+    out << std::setw(10) << snapshot.percentile(0.99) * coeff;
+    out << std::setw(10) << snapshot.percentile(0.999) * coeff;
+    out << std::setw(10) << snapshot.max * coeff;
+    out << std::endl;
+  }
+
+  // previous is updated so the next report only covers the new cycles
+  // pass nullptr for the cumulative values
+  void printLatencies(std::ostream & out, jack_client_t * client, const ClientData & data, std::vector<ASI::HistogramSnapshot> * previous)
+  {
+    const Handlers_t & handlers = data.handlers;
+
+    // in ticks
+    const double period = double(jack_get_buffer_size(client)) / double(data.sr) * ASI::getTicksPerSecond();
+
+    out << std::setw(12) << "Handler" << std::setw(12) << "Cycles";
+    out << std::setw(10) << "p50 %" << std::setw(10) << "p99 %" << std::setw(10) << "p99.9 %" << std::setw(10) << "max %";
+    out << std::endl;
+
+    out << std::fixed << std::setprecision(2);
+
+    for (size_t i = 0; i <= handlers.size(); ++i)
+    {
+      const bool isTotal = i == handlers.size();
+      const ASI::LatencyHistogram & histogram = isTotal ? data.total : data.latency[i];
+      const char * name = isTotal ? "total" : handlers[i]->getName();
+
+      ASI::HistogramSnapshot snapshot;
+      histogram.snapshot(snapshot);
+
+      if (previous)
+      {
+	ASI::HistogramSnapshot & last = (*previous)[i];
+	printLatency(out, name, snapshot.since(last), period);
+	last = snapshot;
+      }
+      else
+      {
+	printLatency(out, name, snapshot, period);
+      }
+    }
+
+    out << std::defaultfloat;
+  }
+
+  void printMissedDeadlines(std::ostream & out, const ClientData & data)
+  {
+    std::vector<MissedDeadline> records;
+    data.missedDeadlines.read(records);
+
+    out << "Missed deadlines: " << data.missedDeadlines.written() << " (last " << records.size() << ")" << std::endl;
+
+    if (records.empty())
+    {
+      return;
+    }
+
+    out << std::setw(12) << "Frame" << std::setw(8) << "Frames" << std::setw(10) << "Load %";
+    out << std::setw(12) << "Slowest" << std::setw(10) << "Its %" << std::setw(8) << "Events" << std::setw(8) << "Xruns";
+    out << std::endl;
+
+    out << std::fixed << std::setprecision(2);
+
+    for (const MissedDeadline & missed : records)
+    {
+      // as a % of the period
+      const double coeff = 100.0 / missed.deadline;
+
+      out << std::setw(12) << missed.frame;
+      out << std::setw(8) << missed.nframes;
+      out << std::setw(10) << missed.elapsed * coeff;
+      out << std::setw(12) << data.handlers[missed.slowest]->getName();
+      out << std::setw(10) << missed.slowestElapsed * coeff;
+      out << std::setw(8) << missed.events;
+      out << std::setw(8) << missed.xruns;
+      out << std::endl;
+    }
+
+    out << std::defaultfloat;
+  }
+
   void printStatistics(const ClientData & data)
   {
-    const double seconds = data.time / 1000000.0;
+    const double seconds = data.time / ASI::getTicksPerSecond();
     const double jack = double(data.frames) / double(data.sr);
     const double load = seconds / jack;
 
-    const double maxLoad = data.maxLoad * data.sr / 1000000.0;
+    const double maxLoad = data.maxLoad * data.sr / ASI::getTicksPerSecond();
 
     std::cout << std::endl;
     std::cout << "Frames: " << data.frames << std::endl;
@@ -88,6 +297,7 @@ namespace
     std::cout << "Wall clock: " << jack << std::endl;
     std::cout << "Load: " << load * 100.0 << " %" << std::endl;
     std::cout << "Max load: " << maxLoad * 100.0 << " %" << std::endl;
+    std::cout << "Xruns: " << data.xruns << std::endl;
   }
 
 }
@@ -105,11 +315,17 @@ int main(int argc, char **args)
 
   std::vector<std::shared_ptr<ASI::I_JackHandler> > & handlers = data.handlers;
   data.alive = false;
-  data.time = 0.0;
+  data.dump = false;
+  data.xruns = 0;
+  data.client = client;
+  data.time = 0;
+  data.maxLoad = 0.0;
   data.frames = 0;
   data.sr = jack_get_sample_rate(client);
 
-  if (!ASI::createHandlers(argc, args, client, handlers))
+  ASI::ClientOptions options;
+
+  if (!ASI::createHandlers(argc, args, client, handlers, options))
   {
     // -h was selected
     return 3;
@@ -121,12 +337,54 @@ int main(int argc, char **args)
     return 0;
   }
 
+  // so the process callback never allocates
+  std::vector<ASI::LatencyHistogram>(handlers.size()).swap(data.latency);
+
+  // this takes a little while, better do it now
+  data.ticksPerFrame = ASI::getTicksPerSecond() / data.sr;
+
+  // to count the MIDI events in the cycles which miss the deadline
+  // the client name might contain regex characters (e.g. "synth.2"): compare the prefix literally
+  const std::string prefix = std::string(jack_get_client_name(client)) + ":";
+  const char ** midiInputs = jack_get_ports(client, nullptr, JACK_DEFAULT_MIDI_TYPE, JackPortIsInput);
+  if (midiInputs)
+  {
+    for (const char ** name = midiInputs; *name; ++name)
+    {
+      if (strncmp(*name, prefix.c_str(), prefix.size()) == 0)
+      {
+	data.midiInputs.push_back(jack_port_by_name(client, *name));
+      }
+    }
+    jack_free(midiInputs);
+  }
+
+  if (options.threads > 0 && isSequential(options.dependencies))
+  {
+    std::cerr << "The handlers run one after the other: --threads is ignored" << std::endl;
+  }
+  else if (options.threads > 0)
+  {
+    try
+    {
+      data.parallel.reset(new ASI::ParallelChain(client, handlers, options.dependencies, options.threads));
+    }
+    catch (const std::exception & e)
+    {
+      std::cerr << "ERROR: " << e.what() << std::endl;
+      return 2;
+    }
+  }
+
   jack_set_process_callback(client, process, &data);
 
+  jack_set_xrun_callback(client, xrun, &data);
+
   jack_on_shutdown(client, shutdown, &data);
 
   signal(SIGINT, &signalHandler);
   signal(SIGTERM, &signalHandler);
+  signal(SIGUSR1, &dumpHandler);
 
   if (jack_activate(client))
   {
@@ -135,17 +393,45 @@ int main(int argc, char **args)
   }
   data.alive = true;
 
+  std::vector<ASI::HistogramSnapshot> previous(handlers.size() + 1);
+  for (ASI::HistogramSnapshot & snapshot : previous)
+  {
+    snapshot.counts.fill(0);
+    snapshot.count = 0;
+    snapshot.max = 0;
+  }
+
   /* run until interrupted */
+  size_t seconds = 0;
   while(data.alive)
   {
     sleep(1);
+    ++seconds;
+
+    if (options.statistics > 0 && seconds % options.statistics == 0)
+    {
+      std::cerr << std::endl;
+      printLatencies(std::cerr, client, data, &previous);
+    }
+
+    if (data.dump.exchange(false))
+    {
+      std::cerr << std::endl;
+      printMissedDeadlines(std::cerr, data);
+    }
   }
 
   // detach all ports
   jack_deactivate(client);
-  jack_client_close(client);
+  data.parallel.reset();
 
   printStatistics(data);
+  std::cout << std::endl;
+  printLatencies(std::cout, client, data, nullptr);
+  std::cout << std::endl;
+  printMissedDeadlines(std::cout, data);
+
+  jack_client_close(client);
 
   return 0;
 }
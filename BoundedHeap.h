@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+namespace ASI
+{
+
+  /*
+    Priority queue with a fixed capacity, preallocated in the constructor,
+    so a handler can queue events in the process callback without any heap traffic.
+
+    "Compare" as in std::priority_queue: the top is the largest element
+    (e.g. with "later", the earliest event).
+
+    Drop policy: when full, push() drops the new element and counts it
+    (the ones already queued were accepted first and keep their place).
+
+    Only 1 thread can use it, the counters can be read from any thread.
+  */
+  template <typename T, typename Compare>
+    class BoundedHeap
+  {
+  public:
+    explicit BoundedHeap(const size_t capacity, const Compare & compare = Compare())
+      : m_capacity(capacity), m_compare(compare), m_highWater(0), m_drops(0)
+    {
+      if (m_capacity == 0)
+      {
+	throw std::runtime_error("Empty bounded heap");
+      }
+
+      m_heap.reserve(m_capacity);
+    }
+
+    // false if the element has been dropped
+    bool push(const T & value)
+    {
+      if (m_heap.size() == m_capacity)
+      {
+	m_drops.store(m_drops.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	return false;
+      }
+
+      m_heap.push_back(value);
+      std::push_heap(m_heap.begin(), m_heap.end(), m_compare);
+
+      if (m_heap.size() > m_highWater.load(std::memory_order_relaxed))
+      {
+	m_highWater.store(m_heap.size(), std::memory_order_relaxed);
+      }
+
+      return true;
+    }
+
+    const T & top() const
+    {
+      return m_heap.front();
+    }
+
+    void pop()
+    {
+      std::pop_heap(m_heap.begin(), m_heap.end(), m_compare);
+      m_heap.pop_back();
+    }
+
+    // keeps the memory
+    void clear()
+    {
+      m_heap.clear();
+    }
+
+    bool empty() const
+    {
+      return m_heap.empty();
+    }
+
+    size_t size() const
+    {
+      return m_heap.size();
+    }
+
+    size_t getCapacity() const
+    {
+      return m_capacity;
+    }
+
+    size_t getDrops() const
+    {
+      return m_drops.load(std::memory_order_relaxed);
+    }
+
+    size_t getHighWater() const
+    {
+      return m_highWater.load(std::memory_order_relaxed);
+    }
+
+  private:
+    const size_t m_capacity;
+    const Compare m_compare;
+
+    // never grows past m_capacity
+    std::vector<T> m_heap;
+
+    std::atomic<size_t> m_highWater;
+    std::atomic<size_t> m_drops;
+  };
+
+}
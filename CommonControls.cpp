@@ -1,8 +1,26 @@
 #include "CommonControls.h"
 #include "sounds/Sounds.h"
+#include "MidiPort.h"
 
 #include <jack/midiport.h>
 #include <sstream>
+#include <stdexcept>
+
+// in-process connections
+#define MIDI_BUS_SIZE 32768
+#define MIDI_BUS_EVENTS 4096
+
+namespace
+{
+
+  // "echo_in" -> "in"
+  std::string getSuffix(const std::string & name)
+  {
+    const size_t underscore = name.find('_');
+    return underscore == std::string::npos ? name : name.substr(underscore + 1);
+  }
+
+}
 
 namespace ASI
 {
@@ -22,11 +40,18 @@ namespace ASI
 
   std::string CommonControls::getPortName(const char * port_name,
 					  const char * port_type,
-					  const unsigned long flags)
+					  const unsigned long flags,
+					  const std::string & instance)
   {
     if (!m_simpleNames)
     {
-      return port_name;
+      if (instance.empty())
+      {
+	return port_name;
+      }
+
+      // "echo_in" -> "<instance>_in"
+      return instance + "_" + getSuffix(port_name);
     }
 
     std::ostringstream buffer;
@@ -67,11 +92,138 @@ namespace ASI
 					     const char * port_type,
 					     const unsigned long flags)
   {
-    const std::string name = getPortName(port_name, port_type, flags);
+    const std::string name = getPortName(port_name, port_type, flags, m_instance);
     jack_port_t * port = jack_port_register(m_client, name.c_str(), port_type, flags, 0);
     return port;
   }
 
+  std::shared_ptr<MidiPort> CommonControls::registerMidiPort(const char * port_name,
+							     const unsigned long flags)
+  {
+    const std::shared_ptr<MidiPort> port = std::make_shared<MidiPort>(flags);
+
+    if (m_instance.empty())
+    {
+      port->setJackPort(registerPort(port_name, JACK_DEFAULT_MIDI_TYPE, flags));
+      return port;
+    }
+
+    Instance & instance = m_instances[m_instance];
+    if (flags & JackPortIsInput)
+    {
+      instance.inputs.push_back({getSuffix(port_name), port, std::string()});
+    }
+    else
+    {
+      instance.outputs.push_back({getSuffix(port_name), port, std::string()});
+    }
+
+    m_pendingPorts.push_back({port_name, m_instance, port});
+
+    return port;
+  }
+
+  void CommonControls::setInstance(const std::string & instance)
+  {
+    m_instance = instance;
+  }
+
+  void CommonControls::connect(const std::string & source, const std::string & destination)
+  {
+    MidiPort & output = *findPort(source, false).port;
+    NamedPort & to = findPort(destination, true);
+    MidiPort & input = *to.port;
+
+    if (input.isConnected())
+    {
+      throw std::runtime_error("MIDI input already connected: " + destination + " (from " + to.source + ")"
+			       ", more than 1 in-process source is not supported: connect " + source + " via JACK");
+    }
+    to.source = source;
+
+    // all the inputs connected to an output share its buffer
+    if (!output.isConnected())
+    {
+      output.setBus(std::make_shared<MidiBuffer>(MIDI_BUS_SIZE, MIDI_BUS_EVENTS));
+    }
+
+    input.setBus(output.getBus());
+  }
+
+  std::string CommonControls::getEndpointInstance(const std::string & endpoint)
+  {
+    return endpoint.substr(0, endpoint.find(':'));
+  }
+
+  CommonControls::NamedPort & CommonControls::findPort(const std::string & endpoint, const bool input)
+  {
+    const char * direction = input ? "input" : "output";
+
+    const size_t colon = endpoint.find(':');
+    const std::string name = getEndpointInstance(endpoint);
+
+    const std::map<std::string, Instance>::iterator instance = m_instances.find(name);
+    if (instance == m_instances.end())
+    {
+      throw std::runtime_error("No handler called: " + name);
+    }
+
+    std::vector<NamedPort> & ports = input ? instance->second.inputs : instance->second.outputs;
+
+    std::ostringstream available;
+    for (const NamedPort & port : ports)
+    {
+      available << " " << name << ":" << port.name;
+    }
+
+    if (colon == std::string::npos)
+    {
+      if (ports.size() != 1)
+      {
+	throw std::runtime_error("No MIDI " + std::string(direction) + " for: " + endpoint +
+				 (ports.empty() ? std::string() : ", name one of:" + available.str()));
+      }
+      return ports.front();
+    }
+
+    const std::string portName = endpoint.substr(colon + 1);
+    for (NamedPort & port : ports)
+    {
+      if (port.name == portName)
+      {
+	return port;
+      }
+    }
+
+    throw std::runtime_error("No MIDI " + std::string(direction) + " called: " + endpoint +
+			     (ports.empty() ? std::string() : ", available:" + available.str()));
+  }
+
+  void CommonControls::registerExternalPorts()
+  {
+    for (const PendingPort & pending : m_pendingPorts)
+    {
+      if (!pending.port->isBound())
+      {
+	const unsigned long flags = pending.port->getFlags();
+	const std::string name = getPortName(pending.name.c_str(), JACK_DEFAULT_MIDI_TYPE, flags, pending.instance);
+	jack_port_t * port = jack_port_register(m_client, name.c_str(), JACK_DEFAULT_MIDI_TYPE, flags, 0);
+	if (!port)
+	{
+	  throw std::runtime_error("Cannot register port: " + name);
+	}
+	pending.port->setJackPort(port);
+	m_externalInstances.insert(pending.instance);
+      }
+    }
+    m_pendingPorts.clear();
+  }
+
+  bool CommonControls::hasExternalPorts(const std::string & instance) const
+  {
+    return m_externalInstances.count(instance) > 0;
+  }
+
   jack_client_t * CommonControls::getClient() const
   {
     return m_client;
@@ -4,7 +4,9 @@
 #include <jack/midiport.h>
 #include <string>
 #include <memory>
+#include <vector>
 #include <map>
+#include <set>
 
 namespace ASI
 {
@@ -16,6 +18,8 @@ namespace ASI
 
   }
 
+  class MidiPort;
+
   class CommonControls
   {
   public:
@@ -26,6 +30,32 @@ namespace ASI
 			       const char * port_type,
 			       const unsigned long flags);
 
+    // without an instance (see setInstance()) this is a JACK port
+    // otherwise it is either connected in-process (connect())
+    // or registered with JACK later (registerExternalPorts())
+    std::shared_ptr<MidiPort> registerMidiPort(const char * port_name,
+					       const unsigned long flags);
+
+    // ports of the handlers created after this call belong to "instance"
+    // and are called "<instance>_in", "<instance>_out"
+    void setInstance(const std::string & instance);
+
+    // from the MIDI output of "source" to the MIDI input of "destination"
+    // "instance" or "instance:port" (e.g. "server:out_2" for the JACK port "server_out_2"),
+    // the port must be named if the handler has more than 1
+    // an output can feed many inputs, but an input has at most 1 source:
+    // there is no merge of in-process buffers, connect them via JACK instead
+    void connect(const std::string & source, const std::string & destination);
+
+    // "instance:port" -> "instance"
+    static std::string getEndpointInstance(const std::string & endpoint);
+
+    // all MIDI ports not connected in-process become JACK ports
+    void registerExternalPorts();
+
+    // after registerExternalPorts(): does "instance" have JACK MIDI ports?
+    bool hasExternalPorts(const std::string & instance) const;
+
     jack_client_t * getClient() const;
 
     // channel is 1 based
@@ -36,7 +66,30 @@ namespace ASI
   private:
     std::string getPortName(const char * port_name,
 			    const char * port_type,
-			    const unsigned long flags);
+			    const unsigned long flags,
+			    const std::string & instance);
+
+    struct PendingPort
+    {
+      std::string name;
+      std::string instance;
+      std::shared_ptr<MidiPort> port;
+    };
+
+    struct NamedPort
+    {
+      std::string name;         // in the instance: "echo_out" -> "out"
+      std::shared_ptr<MidiPort> port;
+      std::string source;       // for an input connected in-process
+    };
+
+    struct Instance
+    {
+      std::vector<NamedPort> inputs;
+      std::vector<NamedPort> outputs;
+    };
+
+    NamedPort & findPort(const std::string & endpoint, const bool input);
 
     jack_client_t * m_client;
     const bool m_simpleNames;
@@ -47,6 +100,11 @@ namespace ASI
     size_t m_midiOutputId;
     size_t m_audioInputId;
     size_t m_audioOutputId;
+
+    std::string m_instance;
+    std::map<std::string, Instance> m_instances;
+    std::vector<PendingPort> m_pendingPorts;
+    std::set<std::string> m_externalInstances;
   };
 
 }
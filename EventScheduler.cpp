@@ -0,0 +1,76 @@
+#include "EventScheduler.h"
+
+namespace ASI
+{
+
+  bool LaterEvent::operator()(const ScheduledEvent & lhs, const ScheduledEvent & rhs) const
+  {
+    if (lhs.time != rhs.time)
+    {
+      return lhs.time > rhs.time;
+    }
+    return lhs.sequence > rhs.sequence;
+  }
+
+  EventScheduler::EventScheduler(const size_t capacity)
+    : m_events(capacity), m_sequence(0)
+  {
+  }
+
+  uint64_t EventScheduler::startCycle(const jack_nframes_t frameTime)
+  {
+    return m_frames.update(frameTime);
+  }
+
+  bool EventScheduler::schedule(const uint64_t time, const MidiEvent & event)
+  {
+    if (!m_events.push({time, m_sequence, event}))
+    {
+      return false;
+    }
+
+    ++m_sequence;
+    return true;
+  }
+
+  bool EventScheduler::hasDue(const uint64_t end) const
+  {
+    return !m_events.empty() && m_events.top().time < end;
+  }
+
+  const ScheduledEvent & EventScheduler::top() const
+  {
+    return m_events.top();
+  }
+
+  void EventScheduler::pop()
+  {
+    m_events.pop();
+  }
+
+  void EventScheduler::clear()
+  {
+    m_events.clear();
+  }
+
+  bool EventScheduler::empty() const
+  {
+    return m_events.empty();
+  }
+
+  size_t EventScheduler::getCapacity() const
+  {
+    return m_events.getCapacity();
+  }
+
+  size_t EventScheduler::getDrops() const
+  {
+    return m_events.getDrops();
+  }
+
+  size_t EventScheduler::getHighWater() const
+  {
+    return m_events.getHighWater();
+  }
+
+}
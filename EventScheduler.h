@@ -0,0 +1,70 @@
+#pragma once
+
+#include "MidiEvent.h"
+#include "FrameCounter.h"
+#include "BoundedHeap.h"
+
+#include <jack/jack.h>
+#include <cstdint>
+
+namespace ASI
+{
+
+  struct ScheduledEvent
+  {
+    uint64_t time;          // absolute frame, see EventScheduler::startCycle()
+    uint64_t sequence;      // same time: first scheduled, first out
+    MidiEvent event;
+  };
+
+  // std::priority_queue order: the earliest is the largest
+  struct LaterEvent
+  {
+    bool operator()(const ScheduledEvent & lhs, const ScheduledEvent & rhs) const;
+  };
+
+  /*
+    Delayed MIDI events, ordered by time: a BoundedHeap preallocated in the constructor.
+
+    schedule() and pop() are O(log n) and never allocate,
+    due events are taken from the top, so the cost of a cycle only depends
+    on the events it emits, not on how many are pending.
+
+    Times are 64 bit frames and do not wrap (jack_last_frame_time() does after ~24h).
+
+    Drop policy (of BoundedHeap): when full, schedule() drops the new event and counts it.
+    Only the process callback can use it, the counters can be read from any thread.
+  */
+  class EventScheduler
+  {
+  public:
+    explicit EventScheduler(const size_t capacity);
+
+    // to be called at the start of each cycle with jack_last_frame_time()
+    // returns the same frame on 64 bits
+    uint64_t startCycle(const jack_nframes_t frameTime);
+
+    // false if the event has been dropped
+    bool schedule(const uint64_t time, const MidiEvent & event);
+
+    // is the earliest event before "end"? (events already late are due too)
+    bool hasDue(const uint64_t end) const;
+
+    const ScheduledEvent & top() const;
+    void pop();
+
+    void clear();
+
+    bool empty() const;
+    size_t getCapacity() const;
+    size_t getDrops() const;
+    size_t getHighWater() const;
+
+  private:
+    BoundedHeap<ScheduledEvent, LaterEvent> m_events;
+    uint64_t m_sequence;
+
+    FrameCounter m_frames;
+  };
+
+}
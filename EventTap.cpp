@@ -0,0 +1,112 @@
+#include "EventTap.h"
+
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+#define JACK_RINGBUFFER_SIZE 65536
+
+namespace ASI
+{
+
+  EventTap::EventTap()
+    : m_lost(0), m_intervalMilliseconds(0), m_consume(nullptr), m_context(nullptr), m_quit(false)
+  {
+    m_buffer.reset(jack_ringbuffer_create(JACK_RINGBUFFER_SIZE), jack_ringbuffer_free);
+    m_records.reserve(JACK_RINGBUFFER_SIZE / sizeof(Record));
+  }
+
+  EventTap::~EventTap()
+  {
+    stop();
+  }
+
+  void EventTap::start(const size_t intervalMilliseconds, const Consume consume, void * context)
+  {
+    stop();
+
+    m_intervalMilliseconds = intervalMilliseconds;
+    m_consume = consume;
+    m_context = context;
+    m_quit = false;
+
+    m_thread = std::thread(&EventTap::run, this);
+  }
+
+  void EventTap::stop()
+  {
+    if (m_thread.joinable())
+    {
+      {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_quit = true;
+      }
+      m_condition.notify_one();
+      m_thread.join();
+    }
+  }
+
+  void EventTap::write(jack_client_t * client, const MidiPortBuffer & buffer)
+  {
+    const uint64_t framesAtStart = m_frames.update(jack_last_frame_time(client));
+
+    jack_ringbuffer_t * ring = m_buffer.get();
+
+    const uint32_t eventCount = buffer.getEventCount();
+    for (uint32_t i = 0; i < eventCount; ++i)
+    {
+      jack_midi_event_t inEvent;
+      buffer.getEvent(&inEvent, i);
+
+      if (jack_ringbuffer_write_space(ring) < sizeof(Record))
+      {
+	m_lost.store(m_lost.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	continue;
+      }
+
+      Record record;
+      record.cycle = framesAtStart;
+      record.time = inEvent.time;
+      record.size = inEvent.size;
+      memset(record.data, 0, sizeof(record.data));
+      memcpy(record.data, inEvent.buffer, std::min<size_t>(inEvent.size, sizeof(record.data)));
+
+      jack_ringbuffer_write(ring, (const char *)&record, sizeof(Record));
+    }
+  }
+
+  size_t EventTap::getLost() const
+  {
+    return m_lost.load(std::memory_order_relaxed);
+  }
+
+  void EventTap::run()
+  {
+    jack_ringbuffer_t * ring = m_buffer.get();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    bool quit = false;
+    while (!quit)
+    {
+      // one last time after the quit request
+      quit = m_quit;
+      if (!quit)
+      {
+	m_condition.wait_for(lock, std::chrono::milliseconds(m_intervalMilliseconds));
+      }
+
+      // at most what fits in the ring, so this does not allocate
+      // (more might arrive while reading: they are left for the next time)
+      m_records.clear();
+      Record record;
+      while (m_records.size() < m_records.capacity() && jack_ringbuffer_read_space(ring) >= sizeof(Record))
+      {
+	jack_ringbuffer_read(ring, (char *)&record, sizeof(Record));
+	m_records.push_back(record);
+      }
+
+      m_consume(m_context, m_records.data(), m_records.size());
+    }
+  }
+
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "MidiPort.h"
+#include "FrameCounter.h"
+
+#include <jack/jack.h>
+#include <jack/ringbuffer.h>
+#include <jack/midiport.h>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+namespace ASI
+{
+
+  /*
+    The MIDI events of a port, handed over from the process callback to a thread.
+
+    write() only copies the events of the cycle to a ring buffer,
+    the thread wakes up every "interval" and passes what it finds to "consume";
+    stop() lets it run one last time, so no event written before is missed.
+
+    Frames are 64 bit: write() extends jack_last_frame_time() in every cycle,
+    with or without events, so a long silence does not lose a wrap.
+
+    If the thread falls behind and the ring is full, events are lost and counted.
+  */
+  class EventTap
+  {
+  public:
+
+    struct Record
+    {
+      uint64_t cycle;             // jack_last_frame_time() on 64 bits
+      jack_nframes_t time;        // in the cycle
+      uint32_t size;              // of the event: only the first bytes are in "data", the rest is 0
+      jack_midi_data_t data[4];
+    };
+
+    // called by the thread with the records read in 1 go (count can be 0)
+    typedef void (*Consume)(void * context, const Record * records, const size_t count);
+
+    EventTap();
+    ~EventTap();
+
+    void start(const size_t intervalMilliseconds, const Consume consume, void * context);
+
+    // to be called before "context" goes
+    void stop();
+
+    // process callback
+    void write(jack_client_t * client, const MidiPortBuffer & buffer);
+
+    // can be read from any thread
+    size_t getLost() const;
+
+  private:
+    void run();
+
+    std::shared_ptr<jack_ringbuffer_t> m_buffer;
+    std::atomic<size_t> m_lost;
+
+    // only used by the process callback
+    FrameCounter m_frames;
+
+    // only used by the thread
+    std::vector<Record> m_records;
+
+    size_t m_intervalMilliseconds;
+    Consume m_consume;
+    void * m_context;
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_quit;
+  };
+
+}
@@ -1,3 +1,4 @@
+#include "Factory.h"
 #include "CommonControls.h"
 #include "handlers/echo/EchoHandler.h"
 #include "handlers/mode/ModeHandler.h"
@@ -5,33 +6,322 @@
 #include "handlers/chords/ChordPlayerHandler.h"
 #include "handlers/display/DisplayHandler.h"
 #include "handlers/server/ServerHandler.h"
+#include "handlers/server/PublisherHandler.h"
+#include "handlers/shm/SharedMemoryHandler.h"
+#include "handlers/osc/OscHandler.h"
 #include "handlers/synth/SynthesiserHandler.h"
 #include "handlers/player/PlayerHandler.h"
 #include "handlers/transport/TransportHandler.h"
 
 #include <boost/program_options.hpp>
+#include <json.hpp>
 #include <iostream>
+#include <fstream>
+#include <map>
+#include <algorithm>
+
+namespace
+{
+  namespace po = boost::program_options;
+  using json = nlohmann::json;
+
+  // in the order they are created from the command line
+  const char * const TYPES[] = {"echo", "mode", "legato", "chords", "display", "synth", "player", "server", "publish", "shm", "osc", "trans"};
+
+  std::shared_ptr<ASI::I_JackHandler> createHandler(const std::string & type, const po::variables_map & vm, const std::shared_ptr<ASI::CommonControls> & common)
+  {
+    using namespace ASI;
+
+    if (type == "echo")
+    {
+      const double lag = vm["echo:delay"].as<double>();
+      const int transposition = vm["echo:transposition"].as<int>();
+      const double velocity = vm["echo:velocity"].as<double>();
+      const size_t capacity = vm["echo:capacity"].as<size_t>();
+      return std::make_shared<Echo::EchoHandler>(common, lag, transposition, velocity, capacity);
+    }
+
+    if (type == "mode")
+    {
+      const int offset = vm["mode:offset"].as<int>();
+      const std::string target = vm["mode:target"].as<std::string>();
+      const std::string quirk = vm["mode:quirk"].as<std::string>();
+      return std::make_shared<Mode::ModeHandler>(common, offset, target, quirk);
+    }
+
+    if (type == "legato")
+    {
+      const int delay = vm["legato:delay"].as<int>();
+      const size_t capacity = vm["legato:capacity"].as<size_t>();
+      return std::make_shared<Legato::SuperLegatoHandler>(common, delay, capacity);
+    }
+
+    if (type == "chords")
+    {
+      const std::string filename = vm["chords:file"].as<std::string>();
+      const int velocity = vm["chords:velocity"].as<int>();
+      return std::make_shared<Chords::ChordPlayerHandler>(common, filename, velocity);
+    }
+
+    if (type == "display")
+    {
+      const std::string filename = vm["display:file"].as<std::string>();
+      const std::string format = vm["display:format"].as<std::string>();
+      const size_t sync = vm["display:fsync"].as<size_t>();
+      return std::make_shared<Display::DisplayHandler>(common, filename, format, sync);
+    }
+
+    if (type == "synth")
+    {
+      const std::string parametersFile = vm["synth:params"].as<std::string>();
+      const bool watch = vm["synth:watch"].as<bool>();
+      const std::string kernels = vm["synth:kernels"].as<std::string>();
+      const size_t threads = vm["synth:threads"].as<size_t>();
+      return std::make_shared<Synth::SynthesiserHandler>(common, parametersFile, watch, kernels, threads);
+    }
+
+    if (type == "player")
+    {
+      const std::string filename = vm["player:file"].as<std::string>();
+      const size_t firstBeat = vm["player:first"].as<size_t>();
+      return std::make_shared<Player::PlayerHandler>(common, filename, firstBeat);
+    }
+
+    if (type == "server")
+    {
+      Server::ServerOptions options;
+      options.endpoints = vm["server:endpoint"].as<std::vector<std::string> >();
+      options.format = vm["server:format"].as<std::string>();
+      options.delay = vm["server:delay"].as<double>();
+      options.capacity = vm["server:capacity"].as<size_t>();
+      options.buffer = vm["server:buffer"].as<size_t>();
+      options.drain = vm["server:drain"].as<size_t>();
+      options.ports = vm["server:ports"].as<bool>();
+      return std::make_shared<Server::ServerHandler>(common, options);
+    }
+
+    if (type == "publish")
+    {
+      const std::string endpoint = vm["publish:endpoint"].as<std::string>();
+      const size_t interval = vm["publish:interval"].as<size_t>();
+      const size_t batch = vm["publish:batch"].as<size_t>();
+      return std::make_shared<Server::PublisherHandler>(common, endpoint, interval, batch);
+    }
+
+    if (type == "shm")
+    {
+      const std::string name = vm["shm:name"].as<std::string>();
+      const size_t capacity = vm["shm:capacity"].as<size_t>();
+      return std::make_shared<Shm::SharedMemoryHandler>(common, name, capacity);
+    }
+
+    if (type == "osc")
+    {
+      const std::string address = vm["osc:address"].as<std::string>();
+      const int port = vm["osc:port"].as<int>();
+      const size_t capacity = vm["osc:capacity"].as<size_t>();
+      return std::make_shared<Osc::OscHandler>(common, address, port, capacity);
+    }
+
+    if (type == "trans")
+    {
+      return std::make_shared<Transport::TransportHandler>(common);
+    }
+
+    throw std::runtime_error("Unknown handler type: " + type);
+  }
+
+  // stable: independent handlers keep the order of the file
+  // dependencies are then expressed in the new order, order[i] = position of handler i in the file
+  void sortHandlers(const std::vector<std::pair<size_t, size_t> > & connections, std::vector<std::shared_ptr<ASI::I_JackHandler> > & handlers,
+		    std::vector<std::vector<size_t> > & dependencies, std::vector<size_t> & order)
+  {
+    const size_t n = handlers.size();
+
+    std::vector<size_t> sources(n, 0);
+    for (const std::pair<size_t, size_t> & connection : connections)
+    {
+      ++sources[connection.second];
+    }
+
+    std::vector<bool> done(n, false);
+    std::vector<size_t> position(n);
+    std::vector<std::shared_ptr<ASI::I_JackHandler> > sorted;
+    order.clear();
+
+    while (sorted.size() < n)
+    {
+      size_t next = n;
+      for (size_t i = 0; i < n; ++i)
+      {
+	if (!done[i] && sources[i] == 0)
+	{
+	  next = i;
+	  break;
+	}
+      }
+
+      if (next == n)
+      {
+	throw std::runtime_error("The graph has a cycle");
+      }
+
+      done[next] = true;
+      position[next] = sorted.size();
+      sorted.push_back(handlers[next]);
+      order.push_back(next);
+
+      for (const std::pair<size_t, size_t> & connection : connections)
+      {
+	if (connection.first == next)
+	{
+	  --sources[connection.second];
+	}
+      }
+    }
+
+    handlers.swap(sorted);
+
+    dependencies.assign(n, std::vector<size_t>());
+    for (const std::pair<size_t, size_t> & connection : connections)
+    {
+      dependencies[position[connection.second]].push_back(position[connection.first]);
+    }
+  }
+
+  /*
+    {
+      "handlers": [ { "name": "legato", "type": "legato", "options": { "delay": 100 } }, ... ],
+      "connections": [ ["legato", "synth"], ["server:out_2", "echo"], ... ]
+    }
+
+    options are the same as on the command line (e.g. "legato:delay" above).
+    Connections are in-process, all other MIDI ports are registered with JACK.
+    A port is named after the handler ("server:out_2") when it has more than 1,
+    and an input can only have 1 in-process source.
+
+    Handlers with JACK MIDI ports can be connected to each other outside the graph
+    (e.g. "a_out" -> "b_in" in qjackctl) and then share the port buffers:
+    with --threads they still run one after the other, in the order of the graph.
+  */
+  void createGraph(const std::string & filename, const po::options_description & desc, const std::shared_ptr<ASI::CommonControls> & common,
+		   std::vector<std::shared_ptr<ASI::I_JackHandler> > & handlers, ASI::ClientOptions & options)
+  {
+    std::ifstream in(filename.c_str());
+    if (!in)
+    {
+      throw std::runtime_error("Cannot open graph file: " + filename);
+    }
+    const json graph = json::parse(in);
+
+    std::map<std::string, size_t> indices;
+    std::vector<std::string> names;
+
+    for (const json & node : graph["handlers"])
+    {
+      const std::string name = node["name"];
+      const std::string type = node["type"];
+
+      if (indices.count(name))
+      {
+	throw std::runtime_error("Duplicate handler name: " + name);
+      }
+
+      std::vector<std::string> arguments = {"asisynth", "--" + type};
+      if (node.find("options") != node.end())
+      {
+	const json & options = node["options"];
+	for (json::const_iterator it = options.begin(); it != options.end(); ++it)
+	{
+	  // an array is the same option repeated
+	  const json values = it.value().is_array() ? it.value() : json::array({it.value()});
+	  for (const json & value : values)
+	  {
+	    const std::string text = value.is_string() ? value.get<std::string>() : value.dump();
+	    arguments.push_back("--" + type + ":" + it.key() + "=" + text);
+	  }
+	}
+      }
+
+      std::vector<char *> argv;
+      for (std::string & argument : arguments)
+      {
+	argv.push_back(&argument[0]);
+      }
+
+      po::variables_map vm;
+      po::store(po::parse_command_line(argv.size(), argv.data(), desc), vm);
+
+      common->setInstance(name);
+      indices[name] = handlers.size();
+      names.push_back(name);
+      handlers.push_back(createHandler(type, vm, common));
+    }
+
+    common->setInstance(std::string());
+
+    std::vector<std::pair<size_t, size_t> > connections;
+    if (graph.find("connections") != graph.end())
+    {
+      for (const json & connection : graph["connections"])
+      {
+	const std::string source = connection[0];
+	const std::string destination = connection[1];
+
+	common->connect(source, destination);
+	connections.push_back(std::make_pair(indices.at(ASI::CommonControls::getEndpointInstance(source)),
+					     indices.at(ASI::CommonControls::getEndpointInstance(destination))));
+      }
+    }
+
+    common->registerExternalPorts();
+
+    std::vector<size_t> order;
+    sortHandlers(connections, handlers, options.dependencies, order);
+
+    // edges go forward in the sorted order, so this cannot make a cycle
+    size_t previous = handlers.size();
+    for (size_t i = 0; i < handlers.size(); ++i)
+    {
+      if (common->hasExternalPorts(names[order[i]]))
+      {
+	std::vector<size_t> & dependencies = options.dependencies[i];
+	if (previous != handlers.size() && std::find(dependencies.begin(), dependencies.end(), previous) == dependencies.end())
+	{
+	  dependencies.push_back(previous);
+	}
+	previous = i;
+      }
+    }
+  }
+
+}
 
 namespace ASI
 {
   namespace po = boost::program_options;
 
   bool createHandlers(int argc, char ** argv, jack_client_t * client,
-		      std::vector<std::shared_ptr<I_JackHandler> > & handlers)
+		      std::vector<std::shared_ptr<I_JackHandler> > & handlers,
+		      ClientOptions & options)
   {
     po::options_description desc("ASISynth");
     desc.add_options()
       ("help,h", "Print this help message")
       ("simple,s", "Simple port names")
       ("channel,c", po::value<int>()->default_value(1), "Output channel (1-based)")
-      ("piano,p", po::value<std::string>()->default_value("kdp90"), "Digital piano");
+      ("piano,p", po::value<std::string>()->default_value("kdp90"), "Digital piano")
+      ("stats", po::value<size_t>()->default_value(0), "Print handler timings to stderr every N seconds")
+      ("threads", po::value<size_t>()->default_value(0), "Worker threads for independent handlers of a --graph, not for those with JACK MIDI ports (0 = sequential)")
+      ("graph,g", po::value<std::string>(), "Handlers and in-process connections (json), replaces the handler options below");
 
     po::options_description echoDesc("Echo");
     echoDesc.add_options()
       ("echo", "Enable echo effect")
       ("echo:delay", po::value<double>()->default_value(0.0), "Delay in seconds")
       ("echo:transposition", po::value<int>()->default_value(0), "Transposition in semitones")
-      ("echo:velocity", po::value<double>()->default_value(1.0), "Velocity ratio");
+      ("echo:velocity", po::value<double>()->default_value(1.0), "Velocity ratio")
+      ("echo:capacity", po::value<size_t>()->default_value(4096), "Max pending events");
     desc.add(echoDesc);
 
     po::options_description modeDesc("Mode change");
@@ -45,7 +335,8 @@ namespace ASI
     po::options_description legatoDesc("Super Legato");
     legatoDesc.add_options()
       ("legato", "Super Legato")
-      ("legato:delay", po::value<int>()->default_value(0), "NOTEOFF delay in milliseconds");
+      ("legato:delay", po::value<int>()->default_value(0), "NOTEOFF delay in milliseconds")
+      ("legato:capacity", po::value<size_t>()->default_value(4096), "Max pending events");
     desc.add(legatoDesc);
 
     po::options_description chordDesc("Chord Player");
@@ -58,13 +349,18 @@ namespace ASI
     po::options_description displayDesc("Display");
     displayDesc.add_options()
       ("display", "Display")
-      ("display:file", po::value<std::string>()->default_value("-"), "Output filename");
+      ("display:file", po::value<std::string>()->default_value("-"), "Output filename")
+      ("display:format", po::value<std::string>()->default_value("csv"), "Output format: csv / binary")
+      ("display:fsync", po::value<size_t>()->default_value(0), "fsync the file every N seconds (0 = never)");
     desc.add(displayDesc);
 
     po::options_description synthesiserDesc("Synthesiser");
     synthesiserDesc.add_options()
       ("synth", "Synthesiser")
-      ("synth:params", po::value<std::string>(), "Prameters (json)");
+      ("synth:params", po::value<std::string>(), "Prameters (json)")
+      ("synth:watch", po::value<bool>()->default_value(false)->implicit_value(true), "Reload the parameters when the file changes")
+      ("synth:kernels", po::value<std::string>()->default_value(""), "Cache of the tuned filter kernels")
+      ("synth:threads", po::value<size_t>()->default_value(1), "Threads rendering the voices");
     desc.add(synthesiserDesc);
 
     po::options_description playerDesc("Player");
@@ -77,9 +373,39 @@ namespace ASI
     po::options_description serverDesc("Server");
     serverDesc.add_options()
       ("server", "Server")
-      ("server:endpoint", po::value<std::string>()->default_value("tcp://localhost:5556"), "ZMQ endpoint");
+      ("server:endpoint", po::value<std::vector<std::string> >()->default_value(std::vector<std::string>(1, "tcp://localhost:5556"), "tcp://localhost:5556"),
+       "ZMQ endpoints (repeat for more): [sub:|pull:][@|>]address[#channel]")
+      ("server:format", po::value<std::string>()->default_value("raw"), "Messages: raw / timed")
+      ("server:delay", po::value<double>()->default_value(20.0), "Playout delay in milliseconds (timed)")
+      ("server:capacity", po::value<size_t>()->default_value(4096), "Jitter buffer size in events (timed)")
+      ("server:buffer", po::value<size_t>()->default_value(65536), "Receive buffer size in bytes")
+      ("server:drain", po::value<size_t>()->default_value(0), "Max events read per cycle (0 = all)")
+      ("server:ports", po::value<bool>()->default_value(false)->implicit_value(true), "One output port per endpoint");
     desc.add(serverDesc);
 
+    po::options_description publishDesc("Publisher");
+    publishDesc.add_options()
+      ("publish", "Publish MIDI events on ZMQ")
+      ("publish:endpoint", po::value<std::string>()->default_value("tcp://*:5557"), "ZMQ endpoint: [@|>]address, bind (default) or connect")
+      ("publish:interval", po::value<size_t>()->default_value(5), "Milliseconds between sends")
+      ("publish:batch", po::value<size_t>()->default_value(256), "Max events per message");
+    desc.add(publishDesc);
+
+    po::options_description shmDesc("Shared memory");
+    shmDesc.add_options()
+      ("shm", "MIDI events from local processes (see handlers/shm/SharedMemoryRing.h)")
+      ("shm:name", po::value<std::string>()->default_value("/asisynth"), "Shared memory name")
+      ("shm:capacity", po::value<size_t>()->default_value(4096), "Ring size in events");
+    desc.add(shmDesc);
+
+    po::options_description oscDesc("OSC");
+    oscDesc.add_options()
+      ("osc", "MIDI events from OSC over UDP")
+      ("osc:address", po::value<std::string>()->default_value("127.0.0.1"), "Local IPv4 address (0.0.0.0 for all)")
+      ("osc:port", po::value<int>()->default_value(9000), "UDP port")
+      ("osc:capacity", po::value<size_t>()->default_value(4096), "Max pending (bundled) events");
+    desc.add(oscDesc);
+
     po::options_description transportDesc("Transport");
     transportDesc.add_options()
       ("trans", "Transport");
@@ -101,63 +427,30 @@ namespace ASI
       const std::string & piano = vm["piano"].as<std::string>();
       const std::shared_ptr<CommonControls> common(new CommonControls(client, simpleNames, channel, piano));
 
-      if (vm.count("echo"))
-      {
-	const double lag = vm["echo:delay"].as<double>();
-	const int transposition = vm["echo:transposition"].as<int>();
-	const double velocity = vm["echo:velocity"].as<double>();
-	handlers.push_back(std::make_shared<ASI::Echo::EchoHandler>(common, lag, transposition, velocity));
-      }
-
-      if (vm.count("mode"))
-      {
-	const int offset = vm["mode:offset"].as<int>();
-	const std::string target = vm["mode:target"].as<std::string>();
-	const std::string quirk = vm["mode:quirk"].as<std::string>();
-	handlers.push_back(std::make_shared<ASI::Mode::ModeHandler>(common, offset, target, quirk));
-      }
-
-      if (vm.count("legato"))
-      {
-	const int delay = vm["legato:delay"].as<int>();
-	handlers.push_back(std::make_shared<ASI::Legato::SuperLegatoHandler>(common, delay));
-      }
-
-      if (vm.count("chords"))
-      {
-	const std::string filename = vm["chords:file"].as<std::string>();
-	const int velocity = vm["chords:velocity"].as<int>();
-	handlers.push_back(std::make_shared<ASI::Chords::ChordPlayerHandler>(common, filename, velocity));
-      }
-
-      if (vm.count("display"))
-      {
-	const std::string filename = vm["display:file"].as<std::string>();
-	handlers.push_back(std::make_shared<ASI::Display::DisplayHandler>(common, filename));
-      }
-
-      if (vm.count("synth"))
-      {
-	const std::string parametersFile = vm["synth:params"].as<std::string>();
-	handlers.push_back(std::make_shared<ASI::Synth::SynthesiserHandler>(common, parametersFile));
-      }
-
-      if (vm.count("player"))
-      {
-	const std::string filename = vm["player:file"].as<std::string>();
-	const size_t firstBeat = vm["player:first"].as<size_t>();
-	handlers.push_back(std::make_shared<ASI::Player::PlayerHandler>(common, filename, firstBeat));
-      }
+      options.statistics = vm["stats"].as<size_t>();
+      options.threads = vm["threads"].as<size_t>();
 
-      if (vm.count("server"))
+      if (vm.count("graph"))
       {
-	const std::string endpoint = vm["server:endpoint"].as<std::string>();
-	handlers.push_back(std::make_shared<ASI::Server::ServerHandler>(common, endpoint));
+	const std::string filename = vm["graph"].as<std::string>();
+	createGraph(filename, desc, common, handlers, options);
       }
-
-      if (vm.count("trans"))
+      else
       {
-	handlers.push_back(std::make_shared<ASI::Transport::TransportHandler>(common));
+	for (const char * type : TYPES)
+	{
+	  if (vm.count(type))
+	  {
+	    handlers.push_back(createHandler(type, vm, common));
+	  }
+	}
+	// they might be connected to each other via JACK (e.g. echo_out -> synth_in)
+	// and share the port buffers: keep them in the order they are created
+	options.dependencies.assign(handlers.size(), std::vector<size_t>());
+	for (size_t i = 1; i < handlers.size(); ++i)
+	{
+	  options.dependencies[i].push_back(i - 1);
+	}
       }
     }
     catch (const po::error& e)
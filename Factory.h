@@ -7,6 +7,18 @@
 
 namespace ASI
 {
+  // options of the process callback itself, rather than of a handler
+  struct ClientOptions
+  {
+    size_t statistics;     // seconds between reports (0 = only at exit)
+    size_t threads;        // extra RT threads to run independent handlers (0 = sequential)
+
+    // for each handler, the ones it receives MIDI from in-process (see --graph)
+    // they must complete before it runs
+    std::vector<std::vector<size_t> > dependencies;
+  };
+
   bool createHandlers(int argc, char ** argv, jack_client_t * client,
-		      std::vector<std::shared_ptr<I_JackHandler> > & handlers);
+		      std::vector<std::shared_ptr<I_JackHandler> > & handlers,
+		      ClientOptions & options);
 }
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <jack/jack.h>
+#include <cstdint>
+
+namespace ASI
+{
+
+  /*
+    Extends the 32 bit JACK frame time (which wraps after ~24h at 48kHz) to 64 bit.
+
+    It must see the frames in order and at least once per wrap
+    (e.g. every cycle from jack_last_frame_time()).
+  */
+  class FrameCounter
+  {
+  public:
+    FrameCounter()
+      : m_last(0), m_wraps(0)
+    {
+    }
+
+    uint64_t update(const jack_nframes_t frame)
+    {
+      if (frame < m_last)
+      {
+	++m_wraps;
+      }
+      m_last = frame;
+
+      return (m_wraps << 32) + frame;
+    }
+
+  private:
+    jack_nframes_t m_last;
+    uint64_t m_wraps;
+  };
+
+}
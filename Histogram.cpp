@@ -0,0 +1,87 @@
+#include "Histogram.h"
+
+#include <algorithm>
+
+namespace ASI
+{
+
+  LatencyHistogram::LatencyHistogram()
+  {
+    for (std::atomic<uint64_t> & count : m_counts)
+    {
+      count.store(0);
+    }
+    m_max.store(0);
+  }
+
+  void LatencyHistogram::snapshot(HistogramSnapshot & snapshot) const
+  {
+    snapshot.count = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+    {
+      const uint64_t count = m_counts[i].load(std::memory_order_relaxed);
+      snapshot.counts[i] = count;
+      snapshot.count += count;
+    }
+    snapshot.max = m_max.load(std::memory_order_relaxed);
+  }
+
+  ticks_t LatencyHistogram::getUpperBound(const size_t bucket)
+  {
+    if (bucket < HISTOGRAM_SUB_BUCKETS)
+    {
+      return bucket;
+    }
+
+    const size_t exponent = bucket / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BITS - 1;
+    const size_t mantissa = bucket % HISTOGRAM_SUB_BUCKETS;
+    const ticks_t lower = ticks_t(HISTOGRAM_SUB_BUCKETS + mantissa) << (exponent - HISTOGRAM_SUB_BITS);
+    const ticks_t width = ticks_t(1) << (exponent - HISTOGRAM_SUB_BITS);
+    return lower + (width - 1);
+  }
+
+  ticks_t HistogramSnapshot::percentile(const double p) const
+  {
+    if (count == 0)
+    {
+      return 0;
+    }
+
+    // the rank of the value we are looking for (1 based)
+    const uint64_t rank = std::max<uint64_t>(1, p * count + 0.5);
+
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+    {
+      cumulative += counts[i];
+      if (cumulative >= rank)
+      {
+	return std::min(LatencyHistogram::getUpperBound(i), max);
+      }
+    }
+
+    return max;
+  }
+
+  HistogramSnapshot HistogramSnapshot::since(const HistogramSnapshot & previous) const
+  {
+    HistogramSnapshot result;
+    result.count = 0;
+    result.max = 0;
+
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+    {
+      result.counts[i] = counts[i] - previous.counts[i];
+      result.count += result.counts[i];
+      if (result.counts[i] > 0)
+      {
+	result.max = LatencyHistogram::getUpperBound(i);
+      }
+    }
+
+    result.max = std::min(result.max, max);
+
+    return result;
+  }
+
+}
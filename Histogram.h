@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Timing.h"
+
+#include <atomic>
+#include <array>
+#include <cstdint>
+
+namespace ASI
+{
+
+  // 8 buckets per power of 2: ~12% resolution over the full 64 bit range
+  const size_t HISTOGRAM_SUB_BITS = 3;
+  const size_t HISTOGRAM_SUB_BUCKETS = 1 << HISTOGRAM_SUB_BITS;
+  const size_t HISTOGRAM_BUCKETS = (64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS;
+
+  struct HistogramSnapshot
+  {
+    std::array<uint64_t, HISTOGRAM_BUCKETS> counts;
+    uint64_t count;
+    ticks_t max;
+
+    // upper bound of the bucket containing the percentile (0 <= p <= 1)
+    ticks_t percentile(const double p) const;
+
+    // what has been added since previous
+    // max is then only known to the bucket resolution
+    HistogramSnapshot since(const HistogramSnapshot & previous) const;
+  };
+
+  /*
+    Log-bucket histogram of durations.
+
+    add() is wait free, never allocates and must only be called by 1 thread (the process callback).
+    snapshot() can be called at any time by any other thread.
+  */
+  class LatencyHistogram
+  {
+  public:
+    LatencyHistogram();
+
+    void add(const ticks_t value)
+    {
+      const size_t bucket = getBucket(value);
+
+      // single writer: no need for an atomic read-modify-write
+      m_counts[bucket].store(m_counts[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+      if (value > m_max.load(std::memory_order_relaxed))
+      {
+	m_max.store(value, std::memory_order_relaxed);
+      }
+    }
+
+    void snapshot(HistogramSnapshot & snapshot) const;
+
+    static size_t getBucket(const ticks_t value)
+    {
+      if (value < HISTOGRAM_SUB_BUCKETS)
+      {
+	return value;
+      }
+
+      const size_t exponent = 63 - __builtin_clzll(value);
+      const size_t mantissa = (value >> (exponent - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+      return (exponent - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS + mantissa;
+    }
+
+    // largest value in the bucket
+    static ticks_t getUpperBound(const size_t bucket);
+
+  private:
+    std::array<std::atomic<uint64_t>, HISTOGRAM_BUCKETS> m_counts;
+    std::atomic<ticks_t> m_max;
+  };
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+namespace ASI
+{
+
+  /*
+    Bounded history of the last N records.
+
+    push() is wait free and must be called by 1 thread only (the process callback):
+    when the ring is full, the oldest record is overwritten.
+
+    read() can be called by any other thread and only returns records
+    which were not overwritten while being copied.
+  */
+  template <typename T, size_t N>
+    class HistoryRing
+  {
+  public:
+    HistoryRing()
+      : m_written(0)
+    {
+    }
+
+    void push(const T & record)
+    {
+      const uint64_t written = m_written.load(std::memory_order_relaxed);
+      m_records[written % N] = record;
+      m_written.store(written + 1, std::memory_order_release);
+    }
+
+    // oldest first
+    void read(std::vector<T> & records) const
+    {
+      records.clear();
+
+      const uint64_t end = m_written.load(std::memory_order_acquire);
+      const uint64_t begin = end > N ? end - N : 0;
+
+      for (uint64_t i = begin; i < end; ++i)
+      {
+	records.push_back(m_records[i % N]);
+      }
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+
+      // the writer might have overwritten some while we were copying
+      // (including the one it is writing now)
+      const uint64_t after = m_written.load(std::memory_order_relaxed) + 1;
+      const uint64_t valid = after > N ? after - N : 0;
+      if (valid > begin)
+      {
+	const uint64_t lost = std::min<uint64_t>(valid - begin, records.size());
+	records.erase(records.begin(), records.begin() + lost);
+      }
+    }
+
+    // total number of records ever pushed
+    uint64_t written() const
+    {
+      return m_written.load(std::memory_order_acquire);
+    }
+
+  private:
+    std::array<T, N> m_records;
+    std::atomic<uint64_t> m_written;
+  };
+
+}
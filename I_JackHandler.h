@@ -13,6 +13,9 @@ namespace ASI
     virtual void process(const jack_nframes_t nframes) = 0;
 
     virtual void shutdown() = 0;
+
+    // used in statistics and diagnostics
+    virtual const char * getName() const = 0;
   };
 
 }
@@ -0,0 +1,84 @@
+#include "MidiBuffer.h"
+
+#include <cerrno>
+#include <cstring>
+
+namespace ASI
+{
+
+  MidiBuffer::MidiBuffer(const size_t bytes, const size_t events)
+    : m_data(bytes)
+  {
+    m_events.reserve(events);
+    clear();
+  }
+
+  void MidiBuffer::clear()
+  {
+    m_events.clear();
+    m_used = 0;
+    m_lost = 0;
+  }
+
+  jack_midi_data_t * MidiBuffer::reserve(const jack_nframes_t time, const size_t size)
+  {
+    // same rules as JACK: events must be written in order
+    if (!m_events.empty() && m_events.back().time > time)
+    {
+      return nullptr;
+    }
+
+    if (m_used + size > m_data.size() || m_events.size() == m_events.capacity())
+    {
+      ++m_lost;
+      return nullptr;
+    }
+
+    jack_midi_event_t event;
+    event.time = time;
+    event.size = size;
+    event.buffer = m_data.data() + m_used;
+
+    m_used += size;
+    m_events.push_back(event);
+
+    return event.buffer;
+  }
+
+  int MidiBuffer::write(const jack_nframes_t time, const jack_midi_data_t * data, const size_t size)
+  {
+    jack_midi_data_t * dest = reserve(time, size);
+    if (!dest)
+    {
+      return ENOBUFS;
+    }
+    memcpy(dest, data, size);
+    return 0;
+  }
+
+  uint32_t MidiBuffer::getEventCount() const
+  {
+    return m_events.size();
+  }
+
+  int MidiBuffer::getEvent(jack_midi_event_t * event, const uint32_t index) const
+  {
+    if (index >= m_events.size())
+    {
+      return ENODATA;
+    }
+    *event = m_events[index];
+    return 0;
+  }
+
+  size_t MidiBuffer::getMaxEventSize() const
+  {
+    return m_data.size() - m_used;
+  }
+
+  uint32_t MidiBuffer::getLostEventCount() const
+  {
+    return m_lost;
+  }
+
+}
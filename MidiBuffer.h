@@ -0,0 +1,38 @@
+#pragma once
+
+#include <jack/midiport.h>
+#include <vector>
+
+namespace ASI
+{
+
+  /*
+    In-process equivalent of a JACK MIDI port buffer, with the same rules:
+    events must be written in time order and the capacity is fixed,
+    so it never allocates after construction.
+  */
+  class MidiBuffer
+  {
+  public:
+    MidiBuffer(const size_t bytes, const size_t events);
+
+    void clear();
+
+    // nullptr if full or out of order
+    jack_midi_data_t * reserve(const jack_nframes_t time, const size_t size);
+    int write(const jack_nframes_t time, const jack_midi_data_t * data, const size_t size);
+
+    uint32_t getEventCount() const;
+    int getEvent(jack_midi_event_t * event, const uint32_t index) const;
+
+    size_t getMaxEventSize() const;
+    uint32_t getLostEventCount() const;
+
+  private:
+    std::vector<jack_midi_event_t> m_events;
+    std::vector<jack_midi_data_t> m_data;
+    size_t m_used;
+    uint32_t m_lost;
+  };
+
+}
@@ -0,0 +1,281 @@
+#include "MidiFile.h"
+#include "MidiCommands.h"
+
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+namespace
+{
+
+  struct TrackEvent
+  {
+    uint64_t tick;
+    bool tempo;
+    uint32_t microsecondsPerQuarter;
+    ASI::MidiEvent event;
+  };
+
+  class Reader
+  {
+  public:
+    Reader(const std::vector<uint8_t> & data, const size_t begin, const size_t end)
+      : m_data(data), m_pos(begin), m_end(end)
+    {
+    }
+
+    bool done() const
+    {
+      return m_pos >= m_end;
+    }
+
+    size_t position() const
+    {
+      return m_pos;
+    }
+
+    uint8_t byte()
+    {
+      if (m_pos >= m_end)
+      {
+	throw std::runtime_error("Truncated MIDI file");
+      }
+      return m_data[m_pos++];
+    }
+
+    uint8_t peek() const
+    {
+      if (m_pos >= m_end)
+      {
+	throw std::runtime_error("Truncated MIDI file");
+      }
+      return m_data[m_pos];
+    }
+
+    uint32_t fixed(const size_t bytes)
+    {
+      uint32_t value = 0;
+      for (size_t i = 0; i < bytes; ++i)
+      {
+	value = (value << 8) | byte();
+      }
+      return value;
+    }
+
+    uint32_t variable()
+    {
+      uint32_t value = 0;
+      for (size_t i = 0; i < 4; ++i)
+      {
+	const uint8_t b = byte();
+	value = (value << 7) | (b & 0x7f);
+	if (!(b & 0x80))
+	{
+	  return value;
+	}
+      }
+      throw std::runtime_error("Invalid variable length quantity in MIDI file");
+    }
+
+    void skip(const size_t bytes)
+    {
+      if (m_pos + bytes > m_end)
+      {
+	throw std::runtime_error("Truncated MIDI file");
+      }
+      m_pos += bytes;
+    }
+
+  private:
+    const std::vector<uint8_t> & m_data;
+    size_t m_pos;
+    const size_t m_end;
+  };
+
+  size_t dataBytes(const uint8_t status)
+  {
+    switch (status & 0xf0)
+    {
+    case MIDI_PC:
+    case 0xD0:              // channel pressure
+      return 1;
+    default:
+      return 2;
+    }
+  }
+
+  void readTrack(Reader & reader, std::vector<TrackEvent> & events)
+  {
+    uint64_t tick = 0;
+    uint8_t runningStatus = 0;
+
+    while (!reader.done())
+    {
+      tick += reader.variable();
+
+      uint8_t status = reader.peek();
+      if (status & 0x80)
+      {
+	reader.byte();
+      }
+      else
+      {
+	if (!runningStatus)
+	{
+	  throw std::runtime_error("Running status without a previous status in MIDI file");
+	}
+	status = runningStatus;
+      }
+
+      if (status == 0xFF)
+      {
+	// meta event
+	const uint8_t type = reader.byte();
+	const uint32_t length = reader.variable();
+	if (type == 0x51 && length == 3)
+	{
+	  const uint32_t tempo = reader.fixed(3);
+	  events.push_back({tick, true, tempo, ASI::MidiEvent(0, nullptr, 0)});
+	}
+	else
+	{
+	  reader.skip(length);
+	}
+	if (type == 0x2F)
+	{
+	  // end of track
+	  break;
+	}
+      }
+      else if (status == MIDI_SYS || status == 0xF7)
+      {
+	// sysex: does not fit in a MidiEvent
+	const uint32_t length = reader.variable();
+	reader.skip(length);
+	runningStatus = 0;
+      }
+      else
+      {
+	runningStatus = status;
+
+	jack_midi_data_t data[3];
+	data[0] = status;
+	const size_t size = 1 + dataBytes(status);
+	for (size_t i = 1; i < size; ++i)
+	{
+	  data[i] = reader.byte();
+	}
+	events.push_back({tick, false, 0, ASI::MidiEvent(0, data, size)});
+      }
+    }
+  }
+
+}
+
+namespace ASI
+{
+
+  void loadMidiFile(const std::string & filename, const jack_nframes_t sampleRate, std::vector<MidiEvent> & events)
+  {
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if (!in)
+    {
+      throw std::runtime_error("Cannot open MIDI file: " + filename);
+    }
+
+    const std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    Reader header(data, 0, data.size());
+    if (header.fixed(4) != 0x4D546864) // MThd
+    {
+      throw std::runtime_error("Not a MIDI file: " + filename);
+    }
+
+    const uint32_t headerLength = header.fixed(4);
+    const size_t headerEnd = header.position() + headerLength;
+    const uint32_t format = header.fixed(2);
+    const uint32_t numberOfTracks = header.fixed(2);
+    const uint32_t division = header.fixed(2);
+    header.skip(headerEnd - header.position());
+
+    if (format > 1)
+    {
+      throw std::runtime_error("Unsupported MIDI file format: " + filename);
+    }
+
+    std::vector<TrackEvent> all;
+
+    size_t position = headerEnd;
+    size_t tracks = 0;
+    while (tracks < numberOfTracks && position < data.size())
+    {
+      Reader chunk(data, position, data.size());
+      const uint32_t id = chunk.fixed(4);
+      const uint32_t length = chunk.fixed(4);
+      const size_t begin = chunk.position();
+      const size_t end = begin + length;
+
+      if (end > data.size())
+      {
+	throw std::runtime_error("Truncated MIDI file: " + filename);
+      }
+
+      if (id == 0x4D54726B) // MTrk
+      {
+	std::vector<TrackEvent> track;
+	Reader reader(data, begin, end);
+	readTrack(reader, track);
+	all.insert(all.end(), track.begin(), track.end());
+	++tracks;
+      }
+      position = end;
+    }
+
+    std::stable_sort(all.begin(), all.end(), [](const TrackEvent & lhs, const TrackEvent & rhs)
+		     {
+		       // tempo changes first, so they apply to the events at the same tick
+		       if (lhs.tick != rhs.tick)
+			 return lhs.tick < rhs.tick;
+		       return lhs.tempo > rhs.tempo;
+		     });
+
+    events.clear();
+
+    // SMPTE division: -frames per second in the high byte, ticks per frame in the low
+    const bool smpte = division & 0x8000;
+    const double smpteTicksPerSecond = smpte ? (-int8_t(division >> 8)) * double(division & 0xff) : 0.0;
+
+    const double ticksPerQuarter = division & 0x7fff;
+    double microsecondsPerQuarter = 500000.0; // 120 bpm
+
+    uint64_t lastTick = 0;
+    double seconds = 0.0;
+
+    for (const TrackEvent & event : all)
+    {
+      if (smpte)
+      {
+	seconds = event.tick / smpteTicksPerSecond;
+      }
+      else
+      {
+	seconds += (event.tick - lastTick) * microsecondsPerQuarter / ticksPerQuarter / 1000000.0;
+      }
+      lastTick = event.tick;
+
+      if (event.tempo)
+      {
+	microsecondsPerQuarter = event.microsecondsPerQuarter;
+      }
+      else
+      {
+	MidiEvent midi = event.event;
+	midi.m_time = seconds * sampleRate;
+	events.push_back(midi);
+      }
+    }
+  }
+
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "MidiEvent.h"
+
+#include <jack/jack.h>
+#include <string>
+#include <vector>
+
+namespace ASI
+{
+
+  // read a Standard MIDI File (format 0 or 1)
+  // all tracks are merged and times are converted to frames using the tempo map
+  void loadMidiFile(const std::string & filename, const jack_nframes_t sampleRate, std::vector<MidiEvent> & events);
+
+}
@@ -0,0 +1,48 @@
+#include "MidiPort.h"
+
+namespace ASI
+{
+
+  MidiPort::MidiPort(const unsigned long flags)
+    : m_flags(flags), m_jackPort(nullptr)
+  {
+  }
+
+  unsigned long MidiPort::getFlags() const
+  {
+    return m_flags;
+  }
+
+  void MidiPort::setJackPort(jack_port_t * port)
+  {
+    m_jackPort = port;
+    m_bus.reset();
+  }
+
+  void MidiPort::setBus(const std::shared_ptr<MidiBuffer> & bus)
+  {
+    m_bus = bus;
+    m_jackPort = nullptr;
+  }
+
+  bool MidiPort::isBound() const
+  {
+    return m_jackPort || m_bus;
+  }
+
+  bool MidiPort::isConnected() const
+  {
+    return bool(m_bus);
+  }
+
+  jack_port_t * MidiPort::getJackPort() const
+  {
+    return m_jackPort;
+  }
+
+  const std::shared_ptr<MidiBuffer> & MidiPort::getBus() const
+  {
+    return m_bus;
+  }
+
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "MidiBuffer.h"
+
+#include <jack/jack.h>
+#include <jack/midiport.h>
+#include <memory>
+
+namespace ASI
+{
+
+  /*
+    What a handler sees of a MIDI port during 1 cycle:
+    either a JACK port buffer or an in-process buffer shared with another handler.
+    Same functions as jack_midi_*().
+  */
+  class MidiPortBuffer
+  {
+  public:
+    MidiPortBuffer(void * jack, MidiBuffer * bus)
+      : m_jack(jack), m_bus(bus)
+    {
+    }
+
+    uint32_t getEventCount() const
+    {
+      return m_bus ? m_bus->getEventCount() : jack_midi_get_event_count(m_jack);
+    }
+
+    int getEvent(jack_midi_event_t * event, const uint32_t index) const
+    {
+      return m_bus ? m_bus->getEvent(event, index) : jack_midi_event_get(event, m_jack, index);
+    }
+
+    void clear()
+    {
+      if (m_bus)
+      {
+	m_bus->clear();
+      }
+      else
+      {
+	jack_midi_clear_buffer(m_jack);
+      }
+    }
+
+    jack_midi_data_t * reserve(const jack_nframes_t time, const size_t size)
+    {
+      return m_bus ? m_bus->reserve(time, size) : jack_midi_event_reserve(m_jack, time, size);
+    }
+
+    int write(const jack_nframes_t time, const jack_midi_data_t * data, const size_t size)
+    {
+      return m_bus ? m_bus->write(time, data, size) : jack_midi_event_write(m_jack, time, data, size);
+    }
+
+  private:
+    void * m_jack;
+    MidiBuffer * m_bus;
+  };
+
+  /*
+    A MIDI port of a handler.
+    Before activation it is bound either to a JACK port (at the edges of the chain)
+    or to the in-process buffer of a connection between 2 handlers (zero copy).
+  */
+  class MidiPort
+  {
+  public:
+    MidiPort(const unsigned long flags);
+
+    MidiPortBuffer getBuffer(const jack_nframes_t nframes) const
+    {
+      return MidiPortBuffer(m_bus ? nullptr : jack_port_get_buffer(m_jackPort, nframes), m_bus.get());
+    }
+
+    unsigned long getFlags() const;
+
+    void setJackPort(jack_port_t * port);
+    void setBus(const std::shared_ptr<MidiBuffer> & bus);
+
+    bool isBound() const;
+    bool isConnected() const;   // in-process
+
+    jack_port_t * getJackPort() const;
+    const std::shared_ptr<MidiBuffer> & getBus() const;
+
+  private:
+    const unsigned long m_flags;
+
+    jack_port_t * m_jackPort;
+    std::shared_ptr<MidiBuffer> m_bus;
+  };
+
+}
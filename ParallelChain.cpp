@@ -0,0 +1,240 @@
+#include "ParallelChain.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <thread>
+#include <sched.h>
+#include <cerrno>
+
+// then give up the core to the other threads
+#define SPINS_BEFORE_YIELD 1000
+
+namespace
+{
+
+  // while waiting for the other threads
+  // yielding lets a thread of the same (SCHED_FIFO) priority progress on this core
+  inline void relax(size_t & spins)
+  {
+    if (++spins < SPINS_BEFORE_YIELD)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+      _mm_pause();
+#endif
+    }
+    else
+    {
+      sched_yield();
+    }
+  }
+
+}
+
+namespace ASI
+{
+
+  ParallelChain::ParallelChain(jack_client_t * client, const std::vector<std::shared_ptr<I_JackHandler> > & handlers,
+			       const std::vector<std::vector<size_t> > & dependencies, const size_t threads)
+    : m_client(client), m_nodes(handlers.size()), m_nframes(0)
+    , m_pending(new std::atomic<size_t>[handlers.size()]), m_ready(new std::atomic<size_t>[handlers.size()])
+    , m_head(0), m_tail(0), m_completed(0), m_running(0), m_quit(false)
+  {
+    if (dependencies.size() != handlers.size())
+    {
+      throw std::runtime_error("Handler dependencies do not match the handlers");
+    }
+
+    for (size_t i = 0; i < m_nodes.size(); ++i)
+    {
+      Node & node = m_nodes[i];
+      node.handler = handlers[i];
+      node.dependencies = dependencies[i].size();
+      node.elapsed = 0;
+
+      for (const size_t dependency : dependencies[i])
+      {
+	m_nodes.at(dependency).dependents.push_back(i);
+      }
+    }
+
+    if (sem_init(&m_start, 0, 0))
+    {
+      throw std::runtime_error("Cannot create semaphore");
+    }
+
+    // the process thread is a worker too
+    // and more threads than cores would just spin against each other
+    const size_t cores = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    const size_t workers = m_nodes.empty() ? 0 : std::min(std::min(threads, m_nodes.size() - 1), cores - 1);
+
+    const int priority = jack_client_real_time_priority(m_client);
+    const int realtime = jack_is_realtime(m_client);
+
+    for (size_t i = 0; i < workers; ++i)
+    {
+      jack_native_thread_t thread;
+      if (jack_client_create_thread(m_client, &thread, priority, realtime, &ParallelChain::worker, this))
+      {
+	stop();
+	sem_destroy(&m_start);
+	throw std::runtime_error("Cannot create worker thread");
+      }
+      m_threads.push_back(thread);
+    }
+  }
+
+  ParallelChain::~ParallelChain()
+  {
+    stop();
+    sem_destroy(&m_start);
+  }
+
+  void ParallelChain::stop()
+  {
+    m_quit = true;
+    for (size_t i = 0; i < m_threads.size(); ++i)
+    {
+      sem_post(&m_start);
+    }
+    for (const jack_native_thread_t & thread : m_threads)
+    {
+      jack_client_stop_thread(m_client, thread);
+    }
+    m_threads.clear();
+  }
+
+  void * ParallelChain::worker(void * arg)
+  {
+    ParallelChain & chain = *reinterpret_cast<ParallelChain *>(arg);
+
+    while (true)
+    {
+      if (sem_wait(&chain.m_start))
+      {
+	if (errno == EINTR)
+	{
+	  continue;
+	}
+	break;
+      }
+
+      if (chain.m_quit.load(std::memory_order_acquire))
+      {
+	break;
+      }
+
+      chain.run();
+      chain.m_running.fetch_sub(1, std::memory_order_release);
+    }
+
+    return nullptr;
+  }
+
+  void ParallelChain::push(const size_t i)
+  {
+    // each handler is queued exactly once per cycle
+    const size_t tail = m_tail.fetch_add(1, std::memory_order_relaxed);
+    m_ready[tail].store(i + 1, std::memory_order_release);
+  }
+
+  bool ParallelChain::tryExecute()
+  {
+    size_t head = m_head.load(std::memory_order_acquire);
+    while (head < m_nodes.size())
+    {
+      const size_t ready = m_ready[head].load(std::memory_order_acquire);
+      if (ready == 0)
+      {
+	// nothing ready (yet)
+	return false;
+      }
+
+      if (m_head.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel))
+      {
+	execute(ready - 1);
+	return true;
+      }
+    }
+
+    return false;
+  }
+
+  void ParallelChain::execute(const size_t i)
+  {
+    Node & node = m_nodes[i];
+
+    const ticks_t t0 = readTicks();
+    node.handler->process(m_nframes);
+    node.elapsed = readTicks() - t0;
+
+    for (const size_t dependent : node.dependents)
+    {
+      if (m_pending[dependent].fetch_sub(1, std::memory_order_acq_rel) == 1)
+      {
+	push(dependent);
+      }
+    }
+
+    m_completed.fetch_add(1, std::memory_order_release);
+  }
+
+  void ParallelChain::run()
+  {
+    size_t spins = 0;
+    while (m_completed.load(std::memory_order_acquire) < m_nodes.size())
+    {
+      if (tryExecute())
+      {
+	spins = 0;
+      }
+      else
+      {
+	relax(spins);
+      }
+    }
+  }
+
+  void ParallelChain::process(const jack_nframes_t nframes)
+  {
+    // all workers are asleep: plain stores would do, the semaphore publishes them
+    m_nframes = nframes;
+    m_head.store(0, std::memory_order_relaxed);
+    m_tail.store(0, std::memory_order_relaxed);
+    m_completed.store(0, std::memory_order_relaxed);
+    m_running.store(m_threads.size(), std::memory_order_relaxed);
+
+    for (size_t i = 0; i < m_nodes.size(); ++i)
+    {
+      m_pending[i].store(m_nodes[i].dependencies, std::memory_order_relaxed);
+      m_ready[i].store(0, std::memory_order_relaxed);
+    }
+
+    for (size_t i = 0; i < m_nodes.size(); ++i)
+    {
+      if (m_nodes[i].dependencies == 0)
+      {
+	push(i);
+      }
+    }
+
+    for (size_t i = 0; i < m_threads.size(); ++i)
+    {
+      sem_post(&m_start);
+    }
+
+    run();
+
+    // barrier: the state can only be reset once nobody is looking at it
+    size_t spins = 0;
+    while (m_running.load(std::memory_order_acquire) > 0)
+    {
+      relax(spins);
+    }
+  }
+
+  ticks_t ParallelChain::getElapsed(const size_t i) const
+  {
+    return m_nodes[i].elapsed;
+  }
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "I_JackHandler.h"
+#include "Timing.h"
+
+#include <vector>
+#include <memory>
+#include <atomic>
+
+#include <jack/jack.h>
+#include <jack/thread.h>
+#include <semaphore.h>
+
+namespace ASI
+{
+
+  /*
+    Runs the handlers of the process callback on the calling thread
+    plus a few real time threads created via jack_client_create_thread().
+
+    A handler starts as soon as all its dependencies have completed,
+    independent handlers (e.g. a display tap and the synth) run concurrently.
+
+    process() does not allocate or lock: workers are woken with a semaphore,
+    ready handlers are taken from a lock-free queue and the cycle ends
+    when all handlers have completed and all workers are back to sleep.
+  */
+  class ParallelChain
+  {
+  public:
+    // dependencies[i]: handlers which must complete before handler i
+    ParallelChain(jack_client_t * client, const std::vector<std::shared_ptr<I_JackHandler> > & handlers,
+		  const std::vector<std::vector<size_t> > & dependencies, const size_t threads);
+
+    // stops the workers: call it after jack_deactivate()
+    ~ParallelChain();
+
+    void process(const jack_nframes_t nframes);
+
+    // of handler i in the last cycle
+    ticks_t getElapsed(const size_t i) const;
+
+  private:
+    struct Node
+    {
+      std::shared_ptr<I_JackHandler> handler;
+      std::vector<size_t> dependents;
+      size_t dependencies;
+      ticks_t elapsed;
+    };
+
+    static void * worker(void * arg);
+    void stop();
+
+    void push(const size_t i);
+    bool tryExecute();
+    void execute(const size_t i);
+    void run();
+
+    jack_client_t * m_client;
+    std::vector<Node> m_nodes;
+    std::vector<jack_native_thread_t> m_threads;
+
+    // per cycle state
+    jack_nframes_t m_nframes;
+    std::unique_ptr<std::atomic<size_t>[]> m_pending;   // dependencies not yet completed
+    std::unique_ptr<std::atomic<size_t>[]> m_ready;     // handler + 1, 0 = not yet queued
+    std::atomic<size_t> m_head;
+    std::atomic<size_t> m_tail;
+    std::atomic<size_t> m_completed;
+    std::atomic<size_t> m_running;
+
+    sem_t m_start;
+    std::atomic<bool> m_quit;
+  };
+
+}
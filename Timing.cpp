@@ -0,0 +1,38 @@
+#include "Timing.h"
+
+#include <chrono>
+#include <thread>
+
+namespace
+{
+
+  double calibrate()
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    const auto c0 = std::chrono::steady_clock::now();
+    const ASI::ticks_t t0 = ASI::readTicks();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    const auto c1 = std::chrono::steady_clock::now();
+    const ASI::ticks_t t1 = ASI::readTicks();
+
+    const double seconds = std::chrono::duration<double>(c1 - c0).count();
+    return (t1 - t0) / seconds;
+#else
+    return 1000000000.0;
+#endif
+  }
+
+}
+
+namespace ASI
+{
+
+  double getTicksPerSecond()
+  {
+    static const double ticksPerSecond = calibrate();
+    return ticksPerSecond;
+  }
+
+}
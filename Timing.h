@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+namespace ASI
+{
+
+  typedef uint64_t ticks_t;
+
+  // cheap, monotonic, high resolution counter (TSC on x86)
+  // safe to call from the process callback
+  inline ticks_t readTicks()
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+  }
+
+  // calibrated against the steady clock on the first call (which takes ~100ms)
+  // call it before jack_activate()
+  double getTicksPerSecond();
+
+}
@@ -8,7 +8,6 @@ namespace ASI
   InputOutputHandler::InputOutputHandler(const std::shared_ptr<CommonControls> & common)
     : m_common(common)
     , m_sampleRate(jack_get_sample_rate(m_common->getClient()))
-    , m_inputPort(nullptr), m_outputPort(nullptr)
     , m_notes(127, 0)
   {
   }
@@ -36,7 +35,7 @@ namespace ASI
     }
   }
 
-  void InputOutputHandler::allNotesOff(void * buffer, const jack_midi_data_t time)
+  void InputOutputHandler::allNotesOff(MidiPortBuffer & buffer, const jack_midi_data_t time)
   {
     jack_midi_data_t data[3];
     data[0] = MIDI_NOTEOFF;
@@ -47,7 +46,7 @@ namespace ASI
       if (m_notes[i] > 0)
       {
 	data[1] = i;
-	jack_midi_event_write(buffer, time, data, 3);
+	buffer.write(time, data, 3);
 	m_notes[i] = 0;
       }
     }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "I_JackHandler.h"
+#include "MidiPort.h"
 
 #include <jack/midiport.h>
 #include <vector>
@@ -21,13 +22,13 @@ namespace ASI
     // keep track of which notes have been generated
     // so we can cancel them
     void noteChange(const jack_midi_data_t * data);
-    void allNotesOff(void * buffer, const jack_midi_data_t time);
+    void allNotesOff(MidiPortBuffer & buffer, const jack_midi_data_t time);
 
     const std::shared_ptr<CommonControls> m_common;
     const jack_nframes_t m_sampleRate;
 
-    jack_port_t *m_inputPort;
-    jack_port_t *m_outputPort;
+    std::shared_ptr<MidiPort> m_inputPort;
+    std::shared_ptr<MidiPort> m_outputPort;
 
 
   private:
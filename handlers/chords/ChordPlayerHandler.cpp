@@ -180,7 +180,7 @@ namespace
     }
   }
 
-  void execute(void * buffer, const int velocity, const jack_midi_event_t & event, const ASI::Chords::ChordPlayerHandler::ChordData & data, const jack_midi_data_t cmd)
+  void execute(ASI::MidiPortBuffer & buffer, const int velocity, const jack_midi_event_t & event, const ASI::Chords::ChordPlayerHandler::ChordData & data, const jack_midi_data_t cmd)
   {
     const std::vector<jack_midi_data_t> & notes = data.notes;
 
@@ -194,7 +194,7 @@ namespace
       data[1] = n;
       data[2] = actualVelocity;
 
-      jack_midi_event_write(buffer, event.time, data, 3);
+      buffer.write(event.time, data, 3);
     }
   }
 
@@ -208,8 +208,8 @@ namespace ASI
     ChordPlayerHandler::ChordPlayerHandler(const std::shared_ptr<CommonControls> & common, const std::string & filename, const int velocity)
       : InputOutputHandler(common), m_filename(filename), m_velocity(velocity)
     {
-      m_inputPort = m_common->registerPort("chord_in", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput);
-      m_outputPort = m_common->registerPort("chord_out", JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput);
+      m_inputPort = m_common->registerMidiPort("chord_in", JackPortIsInput);
+      m_outputPort = m_common->registerMidiPort("chord_out", JackPortIsOutput);
 
       m_previousState = JackTransportStopped;
 
@@ -254,10 +254,10 @@ namespace ASI
     {
       jack_client_t * client = m_common->getClient();
 
-      void* inPortBuf = jack_port_get_buffer(m_inputPort, nframes);
-      void* outPortBuf = jack_port_get_buffer(m_outputPort, nframes);
+      const MidiPortBuffer inPortBuf = m_inputPort->getBuffer(nframes);
+      MidiPortBuffer outPortBuf = m_outputPort->getBuffer(nframes);
 
-      jack_midi_clear_buffer(outPortBuf);
+      outPortBuf.clear();
 
       const jack_transport_state_t state = jack_transport_query(client, nullptr);
 
@@ -288,12 +288,12 @@ namespace ASI
 	}
       case JackTransportRolling:
 	{
-	  jack_nframes_t eventCount = jack_midi_get_event_count(inPortBuf);
+	  jack_nframes_t eventCount = inPortBuf.getEventCount();
 
 	  for (size_t i = 0; i < eventCount; ++i)
 	  {
 	    jack_midi_event_t inEvent;
-	    jack_midi_event_get(&inEvent, inPortBuf, i);
+	    inPortBuf.getEvent(&inEvent, i);
 
 	    if (m_next == m_chords.size())
 	    {
@@ -340,5 +340,10 @@ namespace ASI
     {
     }
 
+    const char * ChordPlayerHandler::getName() const
+    {
+      return "chords";
+    }
+
   }
 }
@@ -25,6 +25,8 @@ namespace ASI
 
       virtual void shutdown();
 
+      virtual const char * getName() const;
+
       struct ChordData
       {
 	jack_midi_data_t trigger;
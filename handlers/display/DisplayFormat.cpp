@@ -0,0 +1,78 @@
+#include "handlers/display/DisplayFormat.h"
+#include "MidiCommands.h"
+#include "MidiUtils.h"
+
+namespace ASI
+{
+
+  namespace Display
+  {
+
+    CsvFormatter::CsvFormatter()
+      : m_onTimes(256, 0.0)
+    {
+    }
+
+    void CsvFormatter::writeHeader(std::ostream & out) const
+    {
+      out << "Time,Code,Command,Channel,Note,Velocity,Name,On,Duration" << '\n';
+    }
+
+    void CsvFormatter::write(std::ostream & out, const double time, const jack_midi_data_t * data)
+    {
+      const jack_midi_data_t cmd = data[0] & 0xf0;
+      const jack_midi_data_t channel = data[0] & 0x0f;
+
+      out << time;
+      out << std::hex;
+      out << "," << (int)data[0];
+      out << "," << (int)cmd;
+      out << "," << (int)channel;
+      out << std::dec;
+
+      switch (cmd)
+      {
+      case MIDI_NOTEON:
+	{
+	  const jack_midi_data_t note = data[1];
+	  const jack_midi_data_t velocity = data[2];
+	  m_onTimes[note] = time;
+
+	  out << "," << (int)note << "," << (int)velocity << ",";
+	  streamNoteName(out, note, BEST);
+	  break;
+	}
+      case MIDI_NOTEOFF:
+	{
+	  const jack_midi_data_t note = data[1];
+	  const jack_midi_data_t velocity = data[2];
+
+	  // this is a vector, not a map
+	  // initialised to 0.0 anyway
+	  const double onTime = m_onTimes[note];
+	  const double duration = time - onTime;
+
+	  out << "," << (int)note << "," << (int)velocity << ",";
+	  streamNoteName(out, note, BEST);
+	  out << "," << onTime << "," << duration;
+	  break;
+	}
+      case MIDI_CC:
+	{
+	  const jack_midi_data_t control = data[1];
+	  const jack_midi_data_t value = data[2];
+	  out << "," << (int)control << "," << (int)value;
+	  break;
+	}
+      case MIDI_PC:
+	{
+	  const jack_midi_data_t program = data[1];
+	  out << "," << (int)program;
+	}
+      }
+
+      out << '\n';
+    }
+
+  }
+}
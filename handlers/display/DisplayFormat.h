@@ -0,0 +1,61 @@
+#pragma once
+
+#include <jack/midiport.h>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// 8 bytes with the terminating 0
+#define DISPLAY_BINARY_MAGIC "ASIMIDI"
+#define DISPLAY_BINARY_VERSION 1
+
+namespace ASI
+{
+
+  namespace Display
+  {
+
+    /*
+      --display:format=binary
+
+      A BinaryHeader followed by BinaryRecord(s) in native endianness:
+      the file is only appended to, and can be mapped and used as an array.
+    */
+    struct BinaryHeader
+    {
+      char magic[8];
+      uint32_t version;
+      uint32_t sampleRate;
+      uint64_t startFrame;     // jack_frame_time() when the file was created
+      int64_t startTime;       // microseconds since the epoch, same moment
+    };
+
+    struct BinaryRecord
+    {
+      uint64_t frame;          // 64 bit JACK frame time, does not wrap
+      uint8_t size;            // bytes used in data
+      uint8_t data[3];         // status, data 1, data 2
+      uint32_t reserved;
+    };
+
+    static_assert(sizeof(BinaryHeader) == 32, "BinaryHeader must be 32 bytes");
+    static_assert(sizeof(BinaryRecord) == 16, "BinaryRecord must be 16 bytes");
+
+    // the columns of --display:format=csv
+    class CsvFormatter
+    {
+    public:
+      CsvFormatter();
+
+      void writeHeader(std::ostream & out) const;
+
+      // time in seconds since the start of the recording
+      void write(std::ostream & out, const double time, const jack_midi_data_t * data);
+
+    private:
+      // of the last NOTEON of each note
+      std::vector<double> m_onTimes;
+    };
+
+  }
+}
@@ -1,10 +1,16 @@
 #include "handlers/display/DisplayHandler.h"
-#include "MidiCommands.h"
-#include "MidiUtils.h"
 #include "CommonControls.h"
 
 #include <iostream>
-#include <fstream>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include <unistd.h>
+
+// how often the writer thread wakes up (and flushes)
+#define WRITER_INTERVAL_MS 20
 
 namespace ASI
 {
@@ -12,112 +18,160 @@ namespace ASI
   namespace Display
   {
 
-    DisplayHandler::DisplayHandler(const std::shared_ptr<CommonControls> & common, const std::string & filename)
-      : m_common(common)
+    DisplayHandler::DisplayHandler(const std::shared_ptr<CommonControls> & common, const std::string & filename, const std::string & format, const size_t syncSeconds)
+      : m_common(common), m_binary(format == "binary"), m_syncSeconds(syncSeconds), m_reportedLost(0)
     {
-      m_inputPort = m_common->registerPort("display_in", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput | JackPortIsTerminal);
-      m_offset = 0.0;
-      m_onTimes.resize(256, 0.0);
+      if (!m_binary && format != "csv")
+      {
+	throw std::runtime_error("Unknown display format: " + format);
+      }
+
+      m_inputPort = m_common->registerMidiPort("display_in", JackPortIsInput | JackPortIsTerminal);
+      m_offset = -1.0;
 
       if (filename == "-")
       {
 	// no deleter
-	m_output.reset(&std::cout, [](std::ostream*){});
+	m_file.reset(stdout, [](FILE*){});
       }
       else
       {
-	m_output = std::make_shared<std::ofstream>(filename);
+	m_file.reset(fopen(filename.c_str(), "w"), [](FILE* f){ if (f) fclose(f); });
+	if (!m_file)
+	{
+	  throw std::runtime_error("Cannot open " + filename + ": " + strerror(errno));
+	}
       }
 
       // write header
-      *m_output << "Time,Code,Command,Channel,Note,Velocity,Name,On,Duration" << std::endl;
+      if (m_binary)
+      {
+	jack_client_t * client = m_common->getClient();
+
+	BinaryHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, DISPLAY_BINARY_MAGIC, sizeof(header.magic));
+	header.version = DISPLAY_BINARY_VERSION;
+	header.sampleRate = jack_get_sample_rate(client);
+	header.startFrame = jack_frame_time(client);
+	header.startTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	fwrite(&header, sizeof(header), 1, m_file.get());
+      }
+      else
+      {
+	m_formatter.writeHeader(m_text);
+	const std::string text = m_text.str();
+	fwrite(text.data(), 1, text.size(), m_file.get());
+	m_text.str(std::string());
+      }
+      fflush(m_file.get());
+
+      m_lastSync = std::chrono::steady_clock::now();
+      m_tap.start(WRITER_INTERVAL_MS, &DisplayHandler::write, this);
     }
 
-    void DisplayHandler::process(const jack_nframes_t nframes)
+    DisplayHandler::~DisplayHandler()
     {
-      jack_client_t * client = m_common->getClient();
+      m_tap.stop();
 
-      void* inPortBuf = jack_port_get_buffer(m_inputPort, nframes);
+      if (m_syncSeconds > 0)
+      {
+	fsync(fileno(m_file.get()));
+      }
+    }
 
-      jack_nframes_t eventCount = jack_midi_get_event_count(inPortBuf);
+    void DisplayHandler::process(const jack_nframes_t nframes)
+    {
+      m_tap.write(m_common->getClient(), m_inputPort->getBuffer(nframes));
+    }
 
-      jack_nframes_t framesAtStart = jack_last_frame_time(client);
+    void DisplayHandler::formatText(const EventTap::Record & record)
+    {
+      jack_client_t * client = m_common->getClient();
 
-      if (eventCount > 0 && m_offset == 0.0)
+      if (m_offset < 0.0)
       {
-	m_offset = jack_frames_to_time(client, framesAtStart);
+	m_offset = jack_frames_to_time(client, jack_nframes_t(record.cycle));
       }
 
-      for(size_t i = 0; i < eventCount; ++i)
-      {
-	jack_midi_event_t inEvent;
-	jack_midi_event_get(&inEvent, inPortBuf, i);
+      const jack_nframes_t absTime = jack_nframes_t(record.cycle + record.time);
 
-	const jack_midi_data_t cmd = inEvent.buffer[0] & 0xf0;
-	const jack_midi_data_t channel = inEvent.buffer[0] & 0x0f;
+      const jack_time_t t = jack_frames_to_time(client, absTime); // microseconds
+      const double time = (t - m_offset) / 1000000.0;
 
-	const jack_nframes_t absTime = framesAtStart + inEvent.time;
+      m_formatter.write(m_text, time, record.data);
+    }
+
+    void DisplayHandler::formatBinary(const EventTap::Record & record)
+    {
+      BinaryRecord binary;
+      binary.frame = record.cycle + record.time;
+      binary.size = std::min<size_t>(record.size, sizeof(binary.data));
+      memcpy(binary.data, record.data, sizeof(binary.data));
+      binary.reserved = 0;
 
-	const jack_time_t t = jack_frames_to_time(client, absTime); // microseconds
-	const double time = (t - m_offset) / 1000000.0;
+      m_records.push_back(binary);
+    }
 
-	*m_output << time;
-	*m_output << std::hex;
-	*m_output << "," << (int)inEvent.buffer[0];
-	*m_output << "," << (int)cmd;
-	*m_output << "," << (int)channel;
-	*m_output << std::dec;
+    void DisplayHandler::write(void * context, const EventTap::Record * records, const size_t count)
+    {
+      DisplayHandler & handler = *static_cast<DisplayHandler *>(context);
 
-	switch (cmd)
+      for (size_t i = 0; i < count; ++i)
+      {
+	if (handler.m_binary)
 	{
-	case MIDI_NOTEON:
-	  {
-	    const jack_midi_data_t note = inEvent.buffer[1];
-	    const jack_midi_data_t velocity = inEvent.buffer[2];
-	    m_onTimes[note] = time;
-
-	    *m_output << "," << (int)note << "," << (int)velocity << ",";
-	    streamNoteName(*m_output, note, BEST);
-	    break;
-	  }
-	case MIDI_NOTEOFF:
-	  {
-	    const jack_midi_data_t note = inEvent.buffer[1];
-	    const jack_midi_data_t velocity = inEvent.buffer[2];
-
-	    // this is a vector, not a map
-	    // initialised to 0.0 anyway
-	    const double onTime = m_onTimes[note];
-	    const double duration = time - onTime;
-
-	    *m_output << "," << (int)note << "," << (int)velocity << ",";
-	    streamNoteName(*m_output, note, BEST);
-	    *m_output << "," << onTime << "," << duration;
-	    break;
-	  }
-	case MIDI_CC:
-	  {
-	    const jack_midi_data_t control = inEvent.buffer[1];
-	    const jack_midi_data_t value = inEvent.buffer[2];
-	    *m_output << "," << (int)control << "," << (int)value;
-	    break;
-	  }
-	case MIDI_PC:
-	  {
-	    const jack_midi_data_t program = inEvent.buffer[1];
-	    *m_output << "," << (int)program;
-	  }
+	  handler.formatBinary(records[i]);
 	}
+	else
+	{
+	  handler.formatText(records[i]);
+	}
+      }
 
-	*m_output << std::endl;
+      FILE * file = handler.m_file.get();
 
+      if (!handler.m_records.empty())
+      {
+	fwrite(handler.m_records.data(), sizeof(BinaryRecord), handler.m_records.size(), file);
+	fflush(file);
+	handler.m_records.clear();
       }
 
+      const std::string text = handler.m_text.str();
+      if (!text.empty())
+      {
+	fwrite(text.data(), 1, text.size(), file);
+	fflush(file);
+	handler.m_text.str(std::string());
+      }
+
+      if (handler.m_syncSeconds > 0)
+      {
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (now - handler.m_lastSync >= std::chrono::seconds(handler.m_syncSeconds))
+	{
+	  fsync(fileno(file));
+	  handler.m_lastSync = now;
+	}
+      }
+
+      const size_t lost = handler.m_tap.getLost();
+      if (lost != handler.m_reportedLost)
+      {
+	std::cerr << "Display: " << lost << " events lost" << std::endl;
+	handler.m_reportedLost = lost;
+      }
     }
 
     void DisplayHandler::shutdown()
     {
     }
 
+    const char * DisplayHandler::getName() const
+    {
+      return "display";
+    }
+
   }
 }
@@ -1,11 +1,17 @@
 #pragma once
 
 #include "I_JackHandler.h"
+#include "MidiPort.h"
+#include "EventTap.h"
+#include "handlers/display/DisplayFormat.h"
 
 #include <jack/midiport.h>
 #include <string>
 #include <vector>
 #include <memory>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
 
 namespace ASI
 {
@@ -15,27 +21,54 @@ namespace ASI
   namespace Display
   {
 
+    /*
+      The process callback only copies the events to an EventTap,
+      its thread formats them and writes them to the file.
+
+      If the writer falls behind and the ring is full, events are lost and counted.
+
+      format: "csv" (human readable) or "binary" (see DisplayFormat.h).
+    */
     class DisplayHandler : public I_JackHandler
     {
     public:
 
-      DisplayHandler(const std::shared_ptr<CommonControls> & common, const std::string & filename);
+      // fsync the file every syncSeconds (0 = never)
+      DisplayHandler(const std::shared_ptr<CommonControls> & common, const std::string & filename, const std::string & format, const size_t syncSeconds);
+      ~DisplayHandler();
 
       virtual void process(const jack_nframes_t nframes);
 
       virtual void shutdown();
 
+      virtual const char * getName() const;
+
     private:
 
+      // EventTap::Consume
+      static void write(void * context, const EventTap::Record * records, const size_t count);
+
+      void formatText(const EventTap::Record & record);
+      void formatBinary(const EventTap::Record & record);
+
       const std::shared_ptr<CommonControls> m_common;
-      jack_port_t *m_inputPort;
+      const bool m_binary;
+      const size_t m_syncSeconds;
+      std::shared_ptr<MidiPort> m_inputPort;
+
+      EventTap m_tap;
 
-      std::shared_ptr<std::ostream> m_output;
+      // only used by the thread of the tap
+      std::shared_ptr<FILE> m_file;
+      std::ostringstream m_text;
+      std::vector<BinaryRecord> m_records;
+      CsvFormatter m_formatter;
 
-      // so the first not is at time = 0.0
+      // so the first note is at time = 0.0 (negative until then)
       double m_offset;
 
-      std::vector<double> m_onTimes;
+      size_t m_reportedLost;
+      std::chrono::steady_clock::time_point m_lastSync;
     };
 
   }
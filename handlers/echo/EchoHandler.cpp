@@ -2,6 +2,8 @@
 #include "MidiCommands.h"
 #include "CommonControls.h"
 
+#include <iostream>
+
 namespace
 {
   ASI::MidiEvent createNewMidiEvent(const jack_nframes_t time, const jack_midi_event_t & org, const int transposition, const double velocityRatio)
@@ -32,25 +34,36 @@ namespace ASI
   namespace Echo
   {
 
-    EchoHandler::EchoHandler(const std::shared_ptr<CommonControls> & common, const double lagSeconds, const int transposition, const double velocityRatio)
+    EchoHandler::EchoHandler(const std::shared_ptr<CommonControls> & common, const double lagSeconds, const int transposition, const double velocityRatio, const size_t capacity)
       : InputOutputHandler(common), m_transposition(transposition), m_velocityRatio(velocityRatio)
+      , m_scheduler(capacity)
     {
-      m_inputPort = m_common->registerPort("echo_in", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput);
-      m_outputPort = m_common->registerPort("echo_out", JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput);
+      m_inputPort = m_common->registerMidiPort("echo_in", JackPortIsInput);
+      m_outputPort = m_common->registerMidiPort("echo_out", JackPortIsOutput);
       m_lagFrames = lagSeconds * m_sampleRate;
     }
 
+    EchoHandler::~EchoHandler()
+    {
+      if (m_scheduler.getDrops() > 0)
+      {
+	std::cerr << "Echo: " << m_scheduler.getDrops() << " events dropped, queue full (" << m_scheduler.getCapacity() << ")" << std::endl;
+      }
+    }
+
     void EchoHandler::process(const jack_nframes_t nframes)
     {
       jack_client_t * client = m_common->getClient();
 
-      void* inPortBuf = jack_port_get_buffer(m_inputPort, nframes);
-      void* outPortBuf = jack_port_get_buffer(m_outputPort, nframes);
+      const MidiPortBuffer inPortBuf = m_inputPort->getBuffer(nframes);
+      MidiPortBuffer outPortBuf = m_outputPort->getBuffer(nframes);
 
-      jack_midi_clear_buffer(outPortBuf);
+      outPortBuf.clear();
 
       const jack_transport_state_t state = jack_transport_query(client, nullptr);
 
+      const uint64_t framesAtStart = m_scheduler.startCycle(jack_last_frame_time(client));
+
       switch(state)
       {
       case JackTransportStopped:
@@ -59,20 +72,18 @@ namespace ASI
 	  {
 	    // stop them all now
 	    allNotesOff(outPortBuf, 0);
-	    m_queue.clear();
+	    m_scheduler.clear();
 	  }
 	  break;
 	}
       case JackTransportRolling:
 	{
-	  const jack_nframes_t eventCount = jack_midi_get_event_count(inPortBuf);
-
-	  const jack_nframes_t framesAtStart = jack_last_frame_time(client);
+	  const jack_nframes_t eventCount = inPortBuf.getEventCount();
 
 	  for (size_t i = 0; i < eventCount; ++i)
 	  {
 	    jack_midi_event_t inEvent;
-	    jack_midi_event_get(&inEvent, inPortBuf, i);
+	    inPortBuf.getEvent(&inEvent, i);
 
 	    const jack_midi_data_t cmd = inEvent.buffer[0] & 0xf0;
 
@@ -81,24 +92,28 @@ namespace ASI
 	    case MIDI_NOTEON:
 	    case MIDI_NOTEOFF:
 	      {
-		const jack_nframes_t newTime = framesAtStart + inEvent.time + m_lagFrames;
+		const uint64_t newTime = framesAtStart + inEvent.time + m_lagFrames;
 
-		m_queue.push_back(createNewMidiEvent(newTime, inEvent, m_transposition, m_velocityRatio));
+		// if full, the note is simply not echoed
+		// a lost NOTEOFF is recovered by allNotesOff() when the transport stops
+		m_scheduler.schedule(newTime, createNewMidiEvent(newTime, inEvent, m_transposition, m_velocityRatio));
 
 		break;
 	      }
 	    }
 	  }
 
-	  const jack_nframes_t lastFrame = framesAtStart + nframes;
+	  const uint64_t lastFrame = framesAtStart + nframes;
 
-	  while (!m_queue.empty() && m_queue.front().m_time >= framesAtStart && m_queue.front().m_time < lastFrame)
+	  while (m_scheduler.hasDue(lastFrame))
 	  {
-	    const MidiEvent & event = m_queue.front();
-	    const jack_nframes_t newOffset = event.m_time - framesAtStart;
-	    jack_midi_event_write(outPortBuf, newOffset, event.m_data, event.m_size);
+	    const ScheduledEvent & scheduled = m_scheduler.top();
+	    // late ones (should not happen) go out first
+	    const jack_nframes_t newOffset = scheduled.time > framesAtStart ? scheduled.time - framesAtStart : 0;
+	    const MidiEvent & event = scheduled.event;
+	    outPortBuf.write(newOffset, event.m_data, event.m_size);
 	    noteChange(event.m_data);
-	    m_queue.pop_front();
+	    m_scheduler.pop();
 	  }
 	  break;
 	}
@@ -114,5 +129,10 @@ namespace ASI
     {
     }
 
+    const char * EchoHandler::getName() const
+    {
+      return "echo";
+    }
+
   }
 }
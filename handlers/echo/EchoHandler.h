@@ -2,9 +2,9 @@
 
 #include "handlers/InputOutputHandler.h"
 #include "MidiEvent.h"
+#include "EventScheduler.h"
 
 #include <jack/midiport.h>
-#include <list>
 
 namespace ASI
 {
@@ -13,17 +13,23 @@ namespace ASI
 
     /*
       This class echoes all midi event coming in with a delay of lagSeconds
+
+      At most "capacity" events can be pending, newer ones are dropped.
     */
     class EchoHandler : public InputOutputHandler
     {
     public:
 
-      EchoHandler(const std::shared_ptr<CommonControls> & common, const double lagSeconds, const int transposition, const double velocityRatio);
+      EchoHandler(const std::shared_ptr<CommonControls> & common, const double lagSeconds, const int transposition, const double velocityRatio, const size_t capacity);
+
+      ~EchoHandler();
 
       virtual void process(const jack_nframes_t nframes);
 
       virtual void shutdown();
 
+      virtual const char * getName() const;
+
     private:
 
       const int m_transposition;
@@ -32,7 +38,7 @@ namespace ASI
       jack_nframes_t m_lagFrames;
 
       jack_transport_state_t m_previousState;
-      std::list<MidiEvent> m_queue;
+      EventScheduler m_scheduler;
 
     };
 
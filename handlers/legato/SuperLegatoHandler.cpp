@@ -4,17 +4,19 @@
 
 #include <cstdlib>
 #include <memory>
+#include <stdexcept>
+#include <iostream>
 
 namespace ASI
 {
   namespace Legato
   {
 
-    SuperLegatoHandler::SuperLegatoHandler(const std::shared_ptr<CommonControls> & common, const int delayMilliseconds)
-      : InputOutputHandler(common)
+    SuperLegatoHandler::SuperLegatoHandler(const std::shared_ptr<CommonControls> & common, const int delayMilliseconds, const size_t capacity)
+      : InputOutputHandler(common), m_scheduler(capacity)
     {
-      m_inputPort = m_common->registerPort("legato_in", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput);
-      m_outputPort = m_common->registerPort("legato_out", JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput);
+      m_inputPort = m_common->registerMidiPort("legato_in", JackPortIsInput);
+      m_outputPort = m_common->registerMidiPort("legato_out", JackPortIsOutput);
 
       if (delayMilliseconds < 0)
       {
@@ -25,25 +27,33 @@ namespace ASI
       m_delayFrames = delayMilliseconds * m_sampleRate / 1000;
     }
 
+    SuperLegatoHandler::~SuperLegatoHandler()
+    {
+      if (m_scheduler.getDrops() > 0)
+      {
+	std::cerr << "Legato: " << m_scheduler.getDrops() << " events dropped, queue full (" << m_scheduler.getCapacity() << ")" << std::endl;
+      }
+    }
+
     void SuperLegatoHandler::process(const jack_nframes_t nframes)
     {
       jack_client_t * client = m_common->getClient();
 
-      void* inPortBuf = jack_port_get_buffer(m_inputPort, nframes);
-      void* outPortBuf = jack_port_get_buffer(m_outputPort, nframes);
+      const MidiPortBuffer inPortBuf = m_inputPort->getBuffer(nframes);
+      MidiPortBuffer outPortBuf = m_outputPort->getBuffer(nframes);
 
-      jack_midi_clear_buffer(outPortBuf);
+      outPortBuf.clear();
 
       const jack_transport_state_t state = jack_transport_query(client, nullptr);
 
-      const jack_nframes_t eventCount = jack_midi_get_event_count(inPortBuf);
+      const jack_nframes_t eventCount = inPortBuf.getEventCount();
 
-      const jack_nframes_t framesAtStart = jack_last_frame_time(client);
+      const uint64_t framesAtStart = m_scheduler.startCycle(jack_last_frame_time(client));
 
       for (size_t i = 0; i < eventCount; ++i)
       {
 	jack_midi_event_t inEvent;
-	jack_midi_event_get(&inEvent, inPortBuf, i);
+	inPortBuf.getEvent(&inEvent, i);
 
 	const jack_midi_data_t cmd = inEvent.buffer[0] & 0xf0;
 	const jack_midi_data_t velocity = inEvent.buffer[2];
@@ -58,22 +68,22 @@ namespace ASI
 	  }
 	}
 
-	const jack_nframes_t newTime = framesAtStart + inEvent.time + delay;
+	const uint64_t newTime = framesAtStart + inEvent.time + delay;
 
-	// they will be inserted in order (< of the multiset)
-	m_queue.insert(MidiEvent(newTime, inEvent.buffer, inEvent.size));
+	// same time: they come out in the order they went in
+	m_scheduler.schedule(newTime, MidiEvent(newTime, inEvent.buffer, inEvent.size));
       }
 
-      const jack_nframes_t lastFrame = framesAtStart + nframes;
+      const uint64_t lastFrame = framesAtStart + nframes;
 
       // replay them in order
-      while (!m_queue.empty() && m_queue.begin()->m_time >= framesAtStart && m_queue.begin()->m_time < lastFrame)
+      while (m_scheduler.hasDue(lastFrame))
       {
-	const std::multiset<MidiEvent>::iterator it = m_queue.begin();
-	const MidiEvent & event = *it;
-	const jack_nframes_t newOffset = event.m_time - framesAtStart;
-	jack_midi_event_write(outPortBuf, newOffset, event.m_data, event.m_size);
-	m_queue.erase(it);
+	const ScheduledEvent & scheduled = m_scheduler.top();
+	const jack_nframes_t newOffset = scheduled.time > framesAtStart ? scheduled.time - framesAtStart : 0;
+	const MidiEvent & event = scheduled.event;
+	outPortBuf.write(newOffset, event.m_data, event.m_size);
+	m_scheduler.pop();
       }
     }
 
@@ -81,5 +91,10 @@ namespace ASI
     {
     }
 
+    const char * SuperLegatoHandler::getName() const
+    {
+      return "legato";
+    }
+
   }
 }
@@ -2,9 +2,9 @@
 
 #include "handlers/InputOutputHandler.h"
 #include "MidiEvent.h"
+#include "EventScheduler.h"
 
 #include <jack/midiport.h>
-#include <set>
 
 namespace ASI
 {
@@ -14,23 +14,28 @@ namespace ASI
 
     /*
       This class delays NOTEOFF to achieve extra legato effect
+
+      At most "capacity" events can be pending, newer ones are dropped.
     */
     class SuperLegatoHandler : public InputOutputHandler
     {
     public:
 
-      SuperLegatoHandler(const std::shared_ptr<CommonControls> & common, const int delayMilliseconds);
+      SuperLegatoHandler(const std::shared_ptr<CommonControls> & common, const int delayMilliseconds, const size_t capacity);
+
+      ~SuperLegatoHandler();
 
       virtual void process(const jack_nframes_t nframes);
 
       virtual void shutdown();
 
+      virtual const char * getName() const;
+
     private:
 
       jack_nframes_t m_delayFrames;
 
-      // these are sorted by event time
-      std::multiset<MidiEvent> m_queue;
+      EventScheduler m_scheduler;
 
     };
 
@@ -58,8 +58,8 @@ namespace ASI
     ModeHandler::ModeHandler(const std::shared_ptr<CommonControls> & common, const int offset, const std::string & target, const std::string & quirk)
       : InputOutputHandler(common), m_offset(offset % 12)
     {
-      m_inputPort = m_common->registerPort("mode_in", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput);
-      m_outputPort = m_common->registerPort("mode_out", JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput);
+      m_inputPort = m_common->registerMidiPort("mode_in", JackPortIsInput);
+      m_outputPort = m_common->registerMidiPort("mode_out", JackPortIsOutput);
 
       if (target == "minor")
       {
@@ -100,19 +100,19 @@ namespace ASI
     {
       jack_client_t * client = m_common->getClient();
 
-      void* inPortBuf = jack_port_get_buffer(m_inputPort, nframes);
-      void* outPortBuf = jack_port_get_buffer(m_outputPort, nframes);
+      const MidiPortBuffer inPortBuf = m_inputPort->getBuffer(nframes);
+      MidiPortBuffer outPortBuf = m_outputPort->getBuffer(nframes);
 
-      jack_midi_clear_buffer(outPortBuf);
+      outPortBuf.clear();
 
       const jack_transport_state_t state = jack_transport_query(client, nullptr);
 
-      const jack_nframes_t eventCount = jack_midi_get_event_count(inPortBuf);
+      const jack_nframes_t eventCount = inPortBuf.getEventCount();
 
       for (size_t i = 0; i < eventCount; ++i)
       {
 	jack_midi_event_t inEvent;
-	jack_midi_event_get(&inEvent, inPortBuf, i);
+	inPortBuf.getEvent(&inEvent, i);
 
 	const jack_midi_data_t cmd = inEvent.buffer[0] & 0xf0;
 
@@ -156,14 +156,14 @@ namespace ASI
 	      data[1] = noteToUse;
 	      data[2] = inEvent.buffer[2];
 
-	      jack_midi_event_write(outPortBuf, inEvent.time, data, 3);
+	      outPortBuf.write(inEvent.time, data, 3);
 	    }
 	    break;
 	  }
 	default:
 	  {
 	    // just forward everything else
-	    jack_midi_event_write(outPortBuf, inEvent.time, inEvent.buffer, inEvent.size);
+	    outPortBuf.write(inEvent.time, inEvent.buffer, inEvent.size);
 	  }
 	}
       }
@@ -173,5 +173,10 @@ namespace ASI
     {
     }
 
+    const char * ModeHandler::getName() const
+    {
+      return "mode";
+    }
+
   }
 }
@@ -28,6 +28,8 @@ namespace ASI
 
       virtual void shutdown();
 
+      virtual const char * getName() const;
+
     private:
 
       const int m_offset; // 0 C, 1 B, 2 B flat....
@@ -0,0 +1,310 @@
+#include "handlers/osc/OscHandler.h"
+#include "MidiCommands.h"
+#include "CommonControls.h"
+
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#define JACK_RINGBUFFER_SIZE 65536
+
+// datagrams read by each recvmmsg
+#define OSC_BATCH 32
+
+// larger datagrams are truncated (and then rejected by the parser)
+#define OSC_MAX_DATAGRAM 1536
+
+// how often the receiver thread checks if it should stop
+#define RECEIVE_TIMEOUT_MS 100
+
+// from 1900 (NTP) to 1970 (Unix)
+#define NTP_UNIX_OFFSET 2208988800ULL
+
+namespace
+{
+
+  int64_t wallMicroseconds()
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+  }
+
+  int64_t ntpToMicroseconds(const uint64_t timetag)
+  {
+    const int64_t seconds = int64_t(timetag >> 32) - int64_t(NTP_UNIX_OFFSET);
+    const int64_t fraction = ((timetag & 0xFFFFFFFF) * 1000000) >> 32;
+    return seconds * 1000000 + fraction;
+  }
+
+  // 1-based channel, 7 bit data
+  bool isValid(const int32_t channel, const int32_t data1, const int32_t data2)
+  {
+    return channel >= 1 && channel <= 16 && data1 >= 0 && data1 < 128 && data2 >= 0 && data2 < 128;
+  }
+
+}
+
+namespace ASI
+{
+
+  namespace Osc
+  {
+
+    OscHandler::OscHandler(const std::shared_ptr<CommonControls> & common, const std::string & address, const int port, const size_t capacity)
+      : m_common(common), m_scheduler(capacity), m_wallToJack(0)
+      , m_datagramCount(0), m_messageCount(0), m_invalid(0), m_ignored(0), m_lost(0), m_late(0)
+      , m_running(true)
+    {
+      m_outputPort = m_common->registerMidiPort("osc_out", JackPortIsOutput | JackPortIsTerminal);
+
+      m_buffer.reset(jack_ringbuffer_create(JACK_RINGBUFFER_SIZE), jack_ringbuffer_free);
+      m_datagrams.resize(OSC_BATCH * OSC_MAX_DATAGRAM);
+
+      sockaddr_in local;
+      memset(&local, 0, sizeof(local));
+      local.sin_family = AF_INET;
+      local.sin_port = htons(port);
+      if (inet_pton(AF_INET, address.c_str(), &local.sin_addr) != 1)
+      {
+	throw std::runtime_error("Invalid OSC address: " + address);
+      }
+
+      m_socket = socket(AF_INET, SOCK_DGRAM, 0);
+      if (m_socket == -1)
+      {
+	throw std::runtime_error(strerror(errno));
+      }
+
+      timeval timeout;
+      timeout.tv_sec = 0;
+      timeout.tv_usec = RECEIVE_TIMEOUT_MS * 1000;
+
+      if (setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0
+	  || bind(m_socket, reinterpret_cast<const sockaddr *>(&local), sizeof(local)) != 0)
+      {
+	const std::string error = strerror(errno);
+	close(m_socket);
+	throw std::runtime_error("Cannot bind OSC socket to " + address + ":" + std::to_string(port) + ": " + error);
+      }
+
+      m_receiverThread = std::thread(&OscHandler::receiver, this);
+    }
+
+    OscHandler::~OscHandler()
+    {
+      m_running = false;
+      if (m_receiverThread.joinable())
+      {
+	m_receiverThread.join();
+      }
+      close(m_socket);
+
+      std::cerr << "OSC: " << m_datagramCount << " datagrams, " << m_messageCount << " messages, "
+		<< m_invalid << " invalid, " << m_ignored << " ignored, " << m_lost << " lost, "
+		<< m_late << " late, " << m_scheduler.getDrops() << " dropped" << std::endl;
+    }
+
+    void OscHandler::receiver()
+    {
+      mmsghdr messages[OSC_BATCH];
+      iovec buffers[OSC_BATCH];
+
+      jack_client_t * client = m_common->getClient();
+
+      while (m_running)
+      {
+	memset(messages, 0, sizeof(messages));
+	for (size_t i = 0; i < OSC_BATCH; ++i)
+	{
+	  buffers[i].iov_base = m_datagrams.data() + i * OSC_MAX_DATAGRAM;
+	  buffers[i].iov_len = OSC_MAX_DATAGRAM;
+	  messages[i].msg_hdr.msg_iov = buffers + i;
+	  messages[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	// block for the first, then take what is already there
+	const int received = recvmmsg(m_socket, messages, OSC_BATCH, MSG_WAITFORONE, nullptr);
+	if (received <= 0)
+	{
+	  if (received == 0 || errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+	  {
+	    continue;
+	  }
+	  std::cerr << "OSC: " << strerror(errno) << std::endl;
+	  break;
+	}
+
+	// the same for the whole batch
+	const int64_t jackNow = jack_frames_to_time(client, jack_frame_time(client));
+	m_wallToJack = jackNow - wallMicroseconds();
+
+	for (int i = 0; i < received; ++i)
+	{
+	  const char * datagram = static_cast<const char *>(buffers[i].iov_base);
+	  const size_t size = messages[i].msg_len;
+
+	  if ((messages[i].msg_hdr.msg_flags & MSG_TRUNC) || !parseOscPacket(datagram, size, *this))
+	  {
+	    m_invalid.store(m_invalid.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	  }
+	}
+
+	m_datagramCount.store(m_datagramCount.load(std::memory_order_relaxed) + received, std::memory_order_relaxed);
+      }
+    }
+
+    void OscHandler::onMessage(const OscMessage & message, const uint64_t timetag)
+    {
+      m_messageCount.store(m_messageCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+      jack_midi_data_t data[3];
+      size_t size = 0;
+
+      int32_t channel = 0, data1 = 0, data2 = 0;
+
+      if (strcmp(message.address, "/note/on") == 0)
+      {
+	if (message.getInt(0, channel) && message.getInt(1, data1) && message.getInt(2, data2) && isValid(channel, data1, data2))
+	{
+	  data[0] = MIDI_NOTEON | (channel - 1);
+	  size = 3;
+	}
+      }
+      else if (strcmp(message.address, "/note/off") == 0)
+      {
+	if (message.getInt(0, channel) && message.getInt(1, data1) && (message.numberOfArguments < 3 || message.getInt(2, data2))
+	    && isValid(channel, data1, data2))
+	{
+	  data[0] = MIDI_NOTEOFF | (channel - 1);
+	  size = 3;
+	}
+      }
+      else if (strcmp(message.address, "/cc") == 0)
+      {
+	if (message.getInt(0, channel) && message.getInt(1, data1) && message.getInt(2, data2) && isValid(channel, data1, data2))
+	{
+	  data[0] = MIDI_CC | (channel - 1);
+	  size = 3;
+	}
+      }
+      else if (strcmp(message.address, "/midi") == 0)
+      {
+	if (message.numberOfArguments >= 1 && message.arguments[0].type == 'm')
+	{
+	  const uint8_t * midi = message.arguments[0].midi;
+	  if (midi[1] >= 0x80 && midi[1] < MIDI_SYS && midi[2] < 0x80 && midi[3] < 0x80)
+	  {
+	    data[0] = midi[1];
+	    data1 = midi[2];
+	    data2 = midi[3];
+	    // program change and channel pressure have 1 data byte
+	    size = (midi[1] & 0xE0) == 0xC0 ? 2 : 3;
+	  }
+	}
+      }
+      else
+      {
+	m_ignored.store(m_ignored.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	return;
+      }
+
+      if (size == 0)
+      {
+	m_invalid.store(m_invalid.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	return;
+      }
+
+      data[1] = data1;
+      data[2] = data2;
+      push(timetag, data, size);
+    }
+
+    void OscHandler::push(const uint64_t timetag, const jack_midi_data_t * data, const size_t size)
+    {
+      jack_ringbuffer_t * buffer = m_buffer.get();
+      if (jack_ringbuffer_write_space(buffer) < sizeof(Record))
+      {
+	m_lost.store(m_lost.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	return;
+      }
+
+      Record record;
+      record.timed = timetag != OSC_IMMEDIATELY;
+      record.time = 0;
+      if (record.timed)
+      {
+	jack_client_t * client = m_common->getClient();
+	const int64_t jackTime = ntpToMicroseconds(timetag) + m_wallToJack;
+	record.time = jack_time_to_frames(client, std::max<int64_t>(jackTime, 0));
+      }
+      record.size = size;
+      memcpy(record.data, data, size);
+
+      jack_ringbuffer_write(buffer, (const char *)&record, sizeof(Record));
+    }
+
+    void OscHandler::process(const jack_nframes_t nframes)
+    {
+      jack_client_t * client = m_common->getClient();
+
+      MidiPortBuffer outPortBuf = m_outputPort->getBuffer(nframes);
+      outPortBuf.clear();
+
+      const uint64_t framesAtStart = m_scheduler.startCycle(jack_last_frame_time(client));
+
+      jack_ringbuffer_t * buffer = m_buffer.get();
+
+      Record record;
+      while (jack_ringbuffer_read_space(buffer) >= sizeof(Record))
+      {
+	jack_ringbuffer_read(buffer, (char *)&record, sizeof(Record));
+
+	uint64_t time = framesAtStart;
+	if (record.timed)
+	{
+	  // within +/- 12h of now
+	  const int32_t delta = int32_t(record.time - jack_nframes_t(framesAtStart));
+	  time = framesAtStart + delta;
+	}
+
+	m_scheduler.schedule(time, MidiEvent(record.time, record.data, record.size));
+      }
+
+      const uint64_t lastFrame = framesAtStart + nframes;
+
+      while (m_scheduler.hasDue(lastFrame))
+      {
+	const ScheduledEvent & scheduled = m_scheduler.top();
+
+	jack_nframes_t offset = 0;
+	if (scheduled.time >= framesAtStart)
+	{
+	  offset = scheduled.time - framesAtStart;
+	}
+	else
+	{
+	  m_late.store(m_late.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	outPortBuf.write(offset, scheduled.event.m_data, scheduled.event.m_size);
+	m_scheduler.pop();
+      }
+    }
+
+    void OscHandler::shutdown()
+    {
+    }
+
+    const char * OscHandler::getName() const
+    {
+      return "osc";
+    }
+
+  }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "I_JackHandler.h"
+#include "MidiPort.h"
+#include "EventScheduler.h"
+#include "handlers/osc/OscParser.h"
+
+#include <jack/ringbuffer.h>
+#include <jack/midiport.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+
+namespace ASI
+{
+
+  class CommonControls;
+
+  namespace Osc
+  {
+
+    /*
+      MIDI events received as OSC messages over UDP.
+
+      /note/on  channel note velocity
+      /note/off channel note [velocity]
+      /cc       channel controller value
+      /midi     m (the OSC MIDI type: port, status, data1, data2)
+
+      channel is 1-based, integers can be sent as floats.
+
+      A receiver thread reads the datagrams in batches (recvmmsg), parses them
+      without allocating and passes the MIDI events to the process callback in a ring.
+      Messages in a bundle are played at the sample offset of its timetag
+      (the wall clock of this host), all others at the start of the next cycle.
+    */
+    class OscHandler : public I_JackHandler, private I_OscListener
+    {
+    public:
+
+      OscHandler(const std::shared_ptr<CommonControls> & common, const std::string & address, const int port, const size_t capacity);
+      ~OscHandler();
+
+      virtual void process(const jack_nframes_t nframes);
+
+      virtual void shutdown();
+
+      virtual const char * getName() const;
+
+    private:
+
+      struct Record
+      {
+	jack_nframes_t time;        // JACK frame, if timed
+	bool timed;
+	jack_midi_data_t size;
+	jack_midi_data_t data[3];
+      };
+
+      void receiver();
+      virtual void onMessage(const OscMessage & message, const uint64_t timetag);
+      void push(const uint64_t timetag, const jack_midi_data_t * data, const size_t size);
+
+      const std::shared_ptr<CommonControls> m_common;
+      std::shared_ptr<MidiPort> m_outputPort;
+
+      std::shared_ptr<jack_ringbuffer_t> m_buffer;
+
+      // used by the process callback only
+      EventScheduler m_scheduler;
+
+      // used by the receiver thread only
+      std::vector<char> m_datagrams;
+      int64_t m_wallToJack;         // microseconds, for the datagrams being parsed
+
+      std::atomic<size_t> m_datagramCount;
+      std::atomic<size_t> m_messageCount;
+      std::atomic<size_t> m_invalid;
+      std::atomic<size_t> m_ignored;
+      std::atomic<size_t> m_lost;
+      std::atomic<size_t> m_late;
+
+      int m_socket;
+
+      std::atomic<bool> m_running;
+      std::thread m_receiverThread;
+    };
+
+  }
+}
@@ -0,0 +1,250 @@
+#include "handlers/osc/OscParser.h"
+
+#include <cstring>
+#include <cmath>
+
+namespace
+{
+
+  using namespace ASI::Osc;
+
+  uint32_t readUInt32(const char * data)
+  {
+    const uint8_t * p = reinterpret_cast<const uint8_t *>(data);
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+  }
+
+  uint64_t readUInt64(const char * data)
+  {
+    return (uint64_t(readUInt32(data)) << 32) | readUInt32(data + 4);
+  }
+
+  // a null terminated string padded to 4 bytes, returns its padded size (0 if malformed)
+  size_t stringSize(const char * data, const size_t size)
+  {
+    const char * end = static_cast<const char *>(memchr(data, 0, size));
+    if (!end)
+    {
+      return 0;
+    }
+
+    const size_t padded = ((end - data) / 4 + 1) * 4;
+    return padded <= size ? padded : 0;
+  }
+
+  bool parseMessage(const char * data, const size_t size, const uint64_t timetag, I_OscListener & listener)
+  {
+    OscMessage message;
+    message.address = data;
+    message.numberOfArguments = 0;
+
+    size_t position = stringSize(data, size);
+    if (position == 0)
+    {
+      return false;
+    }
+
+    if (position == size)
+    {
+      // no type tag string: no arguments
+      listener.onMessage(message, timetag);
+      return true;
+    }
+
+    const char * types = data + position;
+    const size_t typesSize = stringSize(types, size - position);
+    if (typesSize == 0 || types[0] != ',')
+    {
+      return false;
+    }
+    position += typesSize;
+
+    for (const char * type = types + 1; *type; ++type)
+    {
+      OscArgument argument;
+      memset(&argument, 0, sizeof(argument));
+      argument.type = *type;
+
+      const char * value = data + position;
+      const size_t available = size - position;
+
+      switch (argument.type)
+      {
+      case 'i':
+      case 'c':
+      case 'r':
+	{
+	  if (available < 4)
+	  {
+	    return false;
+	  }
+	  argument.i = int32_t(readUInt32(value));
+	  position += 4;
+	  break;
+	}
+      case 'f':
+	{
+	  if (available < 4)
+	  {
+	    return false;
+	  }
+	  const uint32_t bits = readUInt32(value);
+	  memcpy(&argument.f, &bits, sizeof(argument.f));
+	  position += 4;
+	  break;
+	}
+      case 'm':
+	{
+	  if (available < 4)
+	  {
+	    return false;
+	  }
+	  memcpy(argument.midi, value, sizeof(argument.midi));
+	  position += 4;
+	  break;
+	}
+      case 'h':
+      case 't':
+      case 'd':
+	{
+	  if (available < 8)
+	  {
+	    return false;
+	  }
+	  position += 8;
+	  break;
+	}
+      case 's':
+      case 'S':
+	{
+	  const size_t length = stringSize(value, available);
+	  if (length == 0)
+	  {
+	    return false;
+	  }
+	  position += length;
+	  break;
+	}
+      case 'b':
+	{
+	  if (available < 4)
+	  {
+	    return false;
+	  }
+	  const size_t length = (size_t(readUInt32(value)) + 3) / 4 * 4;
+	  if (available - 4 < length)
+	  {
+	    return false;
+	  }
+	  position += 4 + length;
+	  break;
+	}
+      case 'T':
+      case 'F':
+      case 'N':
+      case 'I':
+	{
+	  // no data
+	  break;
+	}
+      default:
+	{
+	  // unknown size: cannot go on
+	  return false;
+	}
+      }
+
+      if (message.numberOfArguments < OSC_MAX_ARGUMENTS)
+      {
+	message.arguments[message.numberOfArguments] = argument;
+	++message.numberOfArguments;
+      }
+    }
+
+    listener.onMessage(message, timetag);
+    return true;
+  }
+
+  bool parsePacket(const char * data, const size_t size, const uint64_t timetag, I_OscListener & listener, const size_t depth)
+  {
+    if (size == 0 || size % 4 != 0)
+    {
+      return false;
+    }
+
+    if (size < 8 || memcmp(data, "#bundle", 8) != 0)
+    {
+      return parseMessage(data, size, timetag, listener);
+    }
+
+    // "#bundle" and the timetag
+    if (depth == OSC_MAX_DEPTH || size < 16)
+    {
+      return false;
+    }
+
+    const uint64_t bundleTimetag = readUInt64(data + 8);
+
+    size_t position = 16;
+    while (position < size)
+    {
+      if (size - position < 4)
+      {
+	return false;
+      }
+
+      const size_t elementSize = readUInt32(data + position);
+      position += 4;
+
+      if (elementSize > size - position)
+      {
+	return false;
+      }
+
+      if (!parsePacket(data + position, elementSize, bundleTimetag, listener, depth + 1))
+      {
+	return false;
+      }
+
+      position += elementSize;
+    }
+
+    return true;
+  }
+
+}
+
+namespace ASI
+{
+
+  namespace Osc
+  {
+
+    bool OscMessage::getInt(const size_t index, int32_t & value) const
+    {
+      if (index >= numberOfArguments)
+      {
+	return false;
+      }
+
+      const OscArgument & argument = arguments[index];
+      switch (argument.type)
+      {
+      case 'i':
+	value = argument.i;
+	return true;
+      case 'f':
+	value = int32_t(std::lround(argument.f));
+	return true;
+      default:
+	return false;
+      }
+    }
+
+    bool parseOscPacket(const char * data, const size_t size, I_OscListener & listener)
+    {
+      return parsePacket(data, size, OSC_IMMEDIATELY, listener, 0);
+    }
+
+  }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// more are ignored
+#define OSC_MAX_ARGUMENTS 8
+
+// nested bundles
+#define OSC_MAX_DEPTH 8
+
+// the special timetag "immediately"
+#define OSC_IMMEDIATELY 1
+
+namespace ASI
+{
+
+  namespace Osc
+  {
+
+    struct OscArgument
+    {
+      char type;            // OSC type tag: i, f, m, ... (s, b: no value)
+      int32_t i;            // i, c, r
+      float f;              // f
+      uint8_t midi[4];      // m: port id, status, data1, data2
+    };
+
+    // points into the datagram: valid only during onMessage()
+    struct OscMessage
+    {
+      const char * address;
+      size_t numberOfArguments;
+      OscArgument arguments[OSC_MAX_ARGUMENTS];
+
+      // i or f (rounded)
+      bool getInt(const size_t index, int32_t & value) const;
+    };
+
+    class I_OscListener
+    {
+    public:
+      virtual ~I_OscListener() = default;
+
+      // timetag: NTP 32.32 fixed point (OSC_IMMEDIATELY if not in a bundle)
+      virtual void onMessage(const OscMessage & message, const uint64_t timetag) = 0;
+    };
+
+    /*
+      Parses an OSC packet (a message or a bundle, possibly nested)
+      and calls the listener for each message, in order.
+
+      Never allocates. Returns false if the packet is malformed:
+      the messages before the error have already been delivered.
+    */
+    bool parseOscPacket(const char * data, const size_t size, I_OscListener & listener);
+
+  }
+}
@@ -26,6 +26,8 @@ namespace ASI
 
       virtual void shutdown();
 
+      virtual const char * getName() const;
+
     private:
 
       const size_t m_firstBeat;
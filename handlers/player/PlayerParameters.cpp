@@ -1,8 +1,10 @@
 #include "handlers/player/PlayerParameters.h"
+#include "MidiCommands.h"
 
 #include <vector>
 #include <string>
 #include <memory>
+#include <algorithm>
 
 #include <json.hpp>
 #include <fstream>
@@ -63,6 +65,13 @@ namespace
       velocity.push_back(k);
     }
   }
+
+  size_t getVelocity(const size_t beat, const std::vector<size_t> & velocity)
+  {
+    const size_t period = velocity.size();
+    const size_t position = beat % period;
+    return velocity[position];
+  }
 }
 
 namespace ASI
@@ -87,6 +96,36 @@ namespace ASI
       return melody;
     }
 
+    void processMelody(const Melody & melody, const jack_midi_data_t channel, const size_t sampleRate, const size_t firstBeat, std::vector<MidiEvent> & events)
+    {
+      events.clear();
+
+      const jack_midi_data_t on = MIDI_NOTEON | (channel - 1);
+      const jack_midi_data_t off = MIDI_NOTEOFF | (channel - 1);
+
+      size_t beat = 0;
+      for (const Chord & chord : melody.chords)
+      {
+	if (beat >= firstBeat)
+	{
+	  const size_t adjBeat = beat - firstBeat;
+	  const size_t velocity = getVelocity(beat, melody.velocity);
+
+	  const size_t start = adjBeat * 60 * sampleRate / melody.tempo;
+	  const size_t end = (adjBeat + chord.duration) * 60 * sampleRate / melody.tempo;
+	  const size_t adjustedEnd = start + (end - start) * melody.legatoCoeff;
+	  for (const size_t note : chord.notes)
+	  {
+	    events.emplace_back(start, on, note, velocity);
+	    events.emplace_back(adjustedEnd, off, note, velocity);
+	  }
+	}
+	++beat;
+      }
+
+      std::sort(events.begin(), events.end());
+    }
+
   }
 
 }
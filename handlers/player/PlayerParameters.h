@@ -1,3 +1,8 @@
+#pragma once
+
+#include "MidiEvent.h"
+
+#include <jack/midiport.h>
 #include <vector>
 #include <string>
 #include <memory>
@@ -23,5 +28,8 @@ namespace ASI
 
     std::shared_ptr<const Melody> loadPlayerMelody(const std::string & filename);
 
+    // events are sorted by time (in frames, relative to firstBeat)
+    void processMelody(const Melody & melody, const jack_midi_data_t channel, const size_t sampleRate, const size_t firstBeat, std::vector<MidiEvent> & events);
+
   }
 }
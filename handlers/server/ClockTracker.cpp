@@ -0,0 +1,95 @@
+#include "handlers/server/ClockTracker.h"
+
+#include <algorithm>
+#include <cmath>
+
+// weight of the latest window in the drift estimate
+#define DRIFT_SMOOTHING 0.1
+
+// a jump larger than this many windows means the sender has restarted its clock
+#define RESET_WINDOWS 10
+
+namespace ASI
+{
+
+  namespace Server
+  {
+
+    ClockTracker::ClockTracker(const int64_t window)
+      : m_window(window), m_valid(false), m_offset(0.0)
+      , m_windowStart(0), m_windowMin(0.0)
+      , m_hasPrevious(false), m_previousTime(0), m_previousMin(0.0), m_drift(0.0)
+    {
+    }
+
+    void ClockTracker::reset(const int64_t remote, const double offset)
+    {
+      m_valid = true;
+      m_offset = offset;
+      m_windowStart = remote;
+      m_windowMin = offset;
+      m_hasPrevious = false;
+      m_drift = 0.0;
+    }
+
+    void ClockTracker::add(const int64_t remote, const int64_t local)
+    {
+      const double offset = double(local - remote);
+
+      if (!m_valid || std::abs(offset - m_offset) > RESET_WINDOWS * m_window)
+      {
+	reset(remote, offset);
+	return;
+      }
+
+      m_windowMin = std::min(m_windowMin, offset);
+
+      if (remote - m_windowStart >= m_window)
+      {
+	if (m_hasPrevious)
+	{
+	  const double slope = (m_windowMin - m_previousMin) / double(remote - m_previousTime);
+	  m_drift += (slope - m_drift) * DRIFT_SMOOTHING;
+	}
+
+	m_hasPrevious = true;
+	m_previousTime = remote;
+	m_previousMin = m_windowMin;
+
+	m_windowStart = remote;
+	m_windowMin = offset;
+      }
+
+      if (m_hasPrevious)
+      {
+	const double extrapolated = m_previousMin + m_drift * double(remote - m_previousTime);
+	m_offset = std::min(extrapolated, m_windowMin);
+      }
+      else
+      {
+	m_offset = m_windowMin;
+      }
+    }
+
+    int64_t ClockTracker::toLocal(const int64_t remote) const
+    {
+      return remote + std::llround(m_offset);
+    }
+
+    bool ClockTracker::isValid() const
+    {
+      return m_valid;
+    }
+
+    double ClockTracker::getOffset() const
+    {
+      return m_offset;
+    }
+
+    double ClockTracker::getDrift() const
+    {
+      return m_drift * 1000000.0;
+    }
+
+  }
+}
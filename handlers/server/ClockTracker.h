@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+
+namespace ASI
+{
+
+  namespace Server
+  {
+
+    /*
+      Estimates local = remote + offset, where the offset drifts slowly.
+
+      The offset of each message includes the network delay:
+      the minimum over a window is the best estimate (least delayed message),
+      the drift is the slope between the minima of consecutive windows.
+
+      Times are in (local) frames.
+      Not thread safe: used by the receiving thread only.
+    */
+    class ClockTracker
+    {
+    public:
+      // window in frames (e.g. 1 second)
+      explicit ClockTracker(const int64_t window);
+
+      // a message sent at "remote" has been received at "local"
+      void add(const int64_t remote, const int64_t local);
+
+      int64_t toLocal(const int64_t remote) const;
+
+      bool isValid() const;
+      double getOffset() const;       // frames
+      double getDrift() const;        // ppm
+
+    private:
+      void reset(const int64_t remote, const double offset);
+
+      const int64_t m_window;
+
+      bool m_valid;
+      double m_offset;
+
+      int64_t m_windowStart;
+      double m_windowMin;
+
+      bool m_hasPrevious;
+      int64_t m_previousTime;
+      double m_previousMin;
+      double m_drift;           // frames per frame
+    };
+
+  }
+}
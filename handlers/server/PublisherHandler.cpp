@@ -0,0 +1,141 @@
+#include "handlers/server/PublisherHandler.h"
+#include "handlers/server/WireFormat.h"
+#include "handlers/server/ZmqContext.h"
+#include "CommonControls.h"
+
+#include <zmq.h>
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// longest event published
+#define MAX_EVENT_SIZE 4
+
+namespace
+{
+
+  void throw_errno(const bool ok)
+  {
+    if (!ok)
+    {
+      const char * str = strerror(errno);
+      throw std::runtime_error(str);
+    }
+  }
+
+}
+
+namespace ASI
+{
+
+  namespace Server
+  {
+
+    PublisherHandler::PublisherHandler(const std::shared_ptr<CommonControls> & common, const std::string & endpoint,
+				       const size_t intervalMilliseconds, const size_t batch)
+      : m_common(common), m_intervalMilliseconds(intervalMilliseconds), m_batch(std::max<size_t>(batch, 1))
+      , m_pending(0), m_messages(0), m_failed(0), m_events(0), m_skipped(0)
+    {
+      m_inputPort = m_common->registerMidiPort("publish_in", JackPortIsInput | JackPortIsTerminal);
+
+      m_message.reserve(m_batch * (sizeof(TimedHeader) + MAX_EVENT_SIZE));
+
+      m_context = getZmqContext();
+
+      m_socket.reset(zmq_socket(m_context.get(), ZMQ_PUB), zmq_close);
+      throw_errno(bool(m_socket));
+
+      // do not block the shutdown on subscribers that do not read
+      const int linger = 0;
+      int rc = zmq_setsockopt(m_socket.get(), ZMQ_LINGER, &linger, sizeof(linger));
+      throw_errno(rc == 0);
+
+      const bool connect = !endpoint.empty() && endpoint[0] == '>';
+      const std::string address = !endpoint.empty() && (endpoint[0] == '>' || endpoint[0] == '@') ? endpoint.substr(1) : endpoint;
+      rc = connect ? zmq_connect(m_socket.get(), address.c_str()) : zmq_bind(m_socket.get(), address.c_str());
+      throw_errno(rc == 0);
+
+      m_tap.start(m_intervalMilliseconds, &PublisherHandler::publish, this);
+    }
+
+    PublisherHandler::~PublisherHandler()
+    {
+      m_tap.stop();
+
+      std::cerr << "Publisher: " << m_messages << " messages (" << m_failed << " failed), " << m_events << " events, "
+		<< m_tap.getLost() << " lost, " << m_skipped << " not published (too long)" << std::endl;
+    }
+
+    void PublisherHandler::process(const jack_nframes_t nframes)
+    {
+      m_tap.write(m_common->getClient(), m_inputPort->getBuffer(nframes));
+    }
+
+    void PublisherHandler::send()
+    {
+      if (m_pending > 0)
+      {
+	// PUB never blocks: with slow subscribers, messages are dropped by ZMQ
+	if (zmq_send(m_socket.get(), m_message.data(), m_message.size(), ZMQ_DONTWAIT) >= 0)
+	{
+	  ++m_messages;
+	}
+	else
+	{
+	  ++m_failed;
+	}
+	m_message.clear();
+	m_pending = 0;
+      }
+    }
+
+    void PublisherHandler::publish(void * context, const EventTap::Record * records, const size_t count)
+    {
+      PublisherHandler & handler = *static_cast<PublisherHandler *>(context);
+
+      for (size_t i = 0; i < count; ++i)
+      {
+	const EventTap::Record & record = records[i];
+
+	static_assert(sizeof(record.data) >= MAX_EVENT_SIZE, "short events are whole");
+	if (record.size == 0 || record.size > MAX_EVENT_SIZE)
+	{
+	  ++handler.m_skipped;
+	  continue;
+	}
+
+	TimedHeader header;
+	header.version = 1;
+	header.reference = SENDER_FRAMES;
+	header.size = record.size;
+	header.reserved = 0;
+	header.time = record.cycle + record.time;
+
+	const char * begin = (const char *)&header;
+	handler.m_message.insert(handler.m_message.end(), begin, begin + sizeof(header));
+	handler.m_message.insert(handler.m_message.end(), record.data, record.data + record.size);
+	++handler.m_pending;
+	++handler.m_events;
+
+	if (handler.m_pending == handler.m_batch)
+	{
+	  handler.send();
+	}
+      }
+
+      handler.send();
+    }
+
+    void PublisherHandler::shutdown()
+    {
+    }
+
+    const char * PublisherHandler::getName() const
+    {
+      return "publish";
+    }
+
+  }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "I_JackHandler.h"
+#include "MidiPort.h"
+#include "EventTap.h"
+
+#include <jack/midiport.h>
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace ASI
+{
+
+  class CommonControls;
+
+  namespace Server
+  {
+
+    /*
+      MIDI events published on a ZMQ PUB socket, the counterpart of ServerHandler.
+
+      The process callback only copies the events to an EventTap,
+      its thread batches them in messages of the "timed" format (see WireFormat.h),
+      stamped with the 64 bit JACK frame (SENDER_FRAMES).
+
+      The audio thread pays the same, however many subscribers there are.
+      If the sender falls behind and the ring is full, events are lost and counted.
+      Events longer than 4 bytes (sysex) are not published.
+    */
+    class PublisherHandler : public I_JackHandler
+    {
+    public:
+
+      // endpoint: [@|>]address, bind (default) or connect
+      // batch: max events per message
+      PublisherHandler(const std::shared_ptr<CommonControls> & common, const std::string & endpoint,
+		       const size_t intervalMilliseconds, const size_t batch);
+      ~PublisherHandler();
+
+      virtual void process(const jack_nframes_t nframes);
+
+      virtual void shutdown();
+
+      virtual const char * getName() const;
+
+    private:
+
+      // EventTap::Consume
+      static void publish(void * context, const EventTap::Record * records, const size_t count);
+
+      void send();
+
+      const std::shared_ptr<CommonControls> m_common;
+      const size_t m_intervalMilliseconds;
+      const size_t m_batch;
+      std::shared_ptr<MidiPort> m_inputPort;
+
+      EventTap m_tap;
+
+      // only used by the thread of the tap
+      std::vector<char> m_message;
+      size_t m_pending;
+      size_t m_messages;          // sent
+      size_t m_failed;            // zmq_send() returned an error
+      size_t m_events;
+      size_t m_skipped;
+
+      // the context must outlive the socket
+      std::shared_ptr<void> m_context;
+      std::shared_ptr<void> m_socket;
+    };
+
+  }
+}
@@ -2,16 +2,69 @@
 #include "MidiCommands.h"
 #include "MidiUtils.h"
 #include "CommonControls.h"
+#include "handlers/server/WireFormat.h"
+#include "handlers/server/ZmqContext.h"
 
 #include <zmq.h>
 #include <cassert>
 #include <cstring>
+#include <iostream>
+#include <algorithm>
 
-#define JACK_RINGBUFFER_SIZE 16384
+// how often the receiving thread checks if it should stop
+#define POLL_TIMEOUT_MS 100
 
 namespace
 {
 
+  // length of the MIDI event at the beginning of data, 0 if not valid
+  size_t eventLength(const jack_midi_data_t * data, const size_t size)
+  {
+    const jack_midi_data_t status = data[0];
+    size_t length;
+
+    if (status < 0x80)
+    {
+      // no running status
+      return 0;
+    }
+    else if (status == MIDI_SYS)
+    {
+      // up to and including the terminating 0xF7 (or the end of the message)
+      const jack_midi_data_t * end = std::find(data + 1, data + size, 0xF7);
+      return end == data + size ? size : end - data + 1;
+    }
+    else if (status < 0xC0 || (status >= 0xE0 && status < 0xF0) || status == 0xF2)
+    {
+      length = 3;
+    }
+    else if (status < 0xE0 || status == 0xF1 || status == 0xF3)
+    {
+      length = 2;
+    }
+    else
+    {
+      length = 1;
+    }
+
+    return length <= size ? length : 0;
+  }
+
+  // publish all of it at once, so the reader never sees a partial message
+  void writeAll(jack_ringbuffer_t * ring, const char * data, const size_t size)
+  {
+    jack_ringbuffer_data_t vec[2];
+    jack_ringbuffer_get_write_vector(ring, vec);
+
+    const size_t first = std::min(size, vec[0].len);
+    memcpy(vec[0].buf, data, first);
+    if (size > first)
+    {
+      memcpy(vec[1].buf, data + first, size - first);
+    }
+    jack_ringbuffer_write_advance(ring, size);
+  }
+
   void throw_errno(const bool ok)
   {
     if (!ok)
@@ -21,24 +74,42 @@ namespace
     }
   }
 
-  void server_thread(ASI::Server::ServerHandler * server, const std::shared_ptr<void> socket)
+  // splits "[sub:|pull:][@|>]address[#channel]"
+  void parseEndpoint(const std::string & spec, int & type, bool & bind, std::string & address, int & channel)
   {
-    while (true)
+    std::string rest = spec;
+
+    type = ZMQ_SUB;
+    if (rest.compare(0, 4, "sub:") == 0)
     {
-      zmq_msg_t message;
-      zmq_msg_init(&message);
-      int rc = zmq_msg_recv(&message, socket.get(), 0);
-      if (rc == -1)
-      {
-	break;
-      }
-      const size_t size = zmq_msg_size(&message);
-      const void * data = zmq_msg_data(&message);
+      rest = rest.substr(4);
+    }
+    else if (rest.compare(0, 5, "pull:") == 0)
+    {
+      type = ZMQ_PULL;
+      rest = rest.substr(5);
+    }
 
-      server->write(data, size);
+    bind = false;
+    if (!rest.empty() && (rest[0] == '@' || rest[0] == '>'))
+    {
+      bind = rest[0] == '@';
+      rest = rest.substr(1);
+    }
 
-      zmq_msg_close(&message);
+    channel = -1;
+    const size_t hash = rest.rfind('#');
+    if (hash != std::string::npos)
+    {
+      channel = std::stoi(rest.substr(hash + 1)) - 1;
+      if (channel < 0 || channel > 15)
+      {
+	throw std::runtime_error("Invalid channel in endpoint: " + spec);
+      }
+      rest = rest.substr(0, hash);
     }
+
+    address = rest;
   }
 
 }
@@ -49,44 +120,217 @@ namespace ASI
   namespace Server
   {
 
-    ServerHandler::ServerHandler(const std::shared_ptr<CommonControls> & common, const std::string & endpoint)
-      : m_common(common)
+    ServerHandler::Source::Source(const int64_t window)
+      : output(0), channel(-1), clock(window)
+      , messages(0), events(0), invalid(0), droppedMessages(0), droppedEvents(0)
     {
-      m_outputPort = m_common->registerPort("server_out", JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput | JackPortIsTerminal);
+    }
+
+    ServerHandler::Output::Output(const size_t capacity)
+      : scheduler(capacity)
+    {
+    }
+
+    ServerHandler::ServerHandler(const std::shared_ptr<CommonControls> & common, const ServerOptions & options)
+      : m_common(common), m_timed(options.format == "timed")
+      , m_delayFrames(options.delay * jack_get_sample_rate(common->getClient()) / 1000.0)
+      , m_drainLimit(options.drain)
+      , m_cycleFrames(0), m_late(0), m_start(std::chrono::steady_clock::now())
+      , m_running(true)
+    {
+      if (!m_timed && options.format != "raw")
+      {
+	throw std::runtime_error("Unknown server format: " + options.format);
+      }
+
+      if (options.endpoints.empty())
+      {
+	throw std::runtime_error("No server endpoint");
+      }
+
+      const size_t numberOfOutputs = options.ports ? options.endpoints.size() : 1;
+      for (size_t i = 0; i < numberOfOutputs; ++i)
+      {
+	// server_out, server_out_2, ...
+	const std::string name = i == 0 ? std::string("server_out") : "server_out_" + std::to_string(i + 1);
+	m_outputs.emplace_back(new Output(options.capacity));
+	m_outputs.back()->port = m_common->registerMidiPort(name.c_str(), JackPortIsOutput | JackPortIsTerminal);
+      }
+
+      m_ring.reset(jack_ringbuffer_create(options.buffer), jack_ringbuffer_free);
+      throw_errno(bool(m_ring));
+      // the ring holds size - 1 bytes: nothing bigger could ever fit
+      m_staging.reserve(jack_ringbuffer_write_space(m_ring.get()));
+
+      m_context = getZmqContext();
 
-      // this idea comes from RtMidi
-      m_buffSize.reset(jack_ringbuffer_create(JACK_RINGBUFFER_SIZE), jack_ringbuffer_free);
-      m_buffMessage.reset(jack_ringbuffer_create(JACK_RINGBUFFER_SIZE), jack_ringbuffer_free);
+      const int64_t sampleRate = jack_get_sample_rate(m_common->getClient());
+
+      for (size_t i = 0; i < options.endpoints.size(); ++i)
+      {
+	int type;
+	bool bind;
+	std::string address;
+	std::unique_ptr<Source> source(new Source(sampleRate));
+
+	parseEndpoint(options.endpoints[i], type, bind, address, source->channel);
+	source->endpoint = options.endpoints[i];
+	source->output = options.ports ? i : 0;
+
+	source->socket.reset(zmq_socket(m_context.get(), type), zmq_close);
+	throw_errno(bool(source->socket));
+
+	int rc = bind ? zmq_bind(source->socket.get(), address.c_str()) : zmq_connect(source->socket.get(), address.c_str());
+	throw_errno(rc == 0);
+
+	if (type == ZMQ_SUB)
+	{
+	  rc = zmq_setsockopt(source->socket.get(), ZMQ_SUBSCRIBE, nullptr, 0);
+	  throw_errno(rc == 0);
+	}
+
+	m_sources.push_back(std::move(source));
+      }
+
+      m_serverThread = std::thread(&ServerHandler::run, this);
+    }
+
+    void ServerHandler::run()
+    {
+      std::vector<zmq_pollitem_t> items(m_sources.size());
+      for (size_t i = 0; i < m_sources.size(); ++i)
+      {
+	items[i].socket = m_sources[i]->socket.get();
+	items[i].fd = 0;
+	items[i].events = ZMQ_POLLIN;
+	items[i].revents = 0;
+      }
+
+      while (m_running)
+      {
+	const int rc = zmq_poll(items.data(), items.size(), POLL_TIMEOUT_MS);
+	if (rc == -1)
+	{
+	  if (errno == EINTR)
+	  {
+	    continue;
+	  }
+	  break;
+	}
 
-      m_context.reset(zmq_ctx_new(), zmq_ctx_destroy);
-      throw_errno(bool(m_context));
+	for (size_t i = 0; i < items.size(); ++i)
+	{
+	  if (items[i].revents & ZMQ_POLLIN)
+	  {
+	    drain(i);
+	  }
+	}
+      }
+    }
 
-      std::shared_ptr<void> socket(zmq_socket(m_context.get(), ZMQ_SUB), zmq_close);
-      throw_errno(bool(socket));
+    void ServerHandler::drain(const size_t source)
+    {
+      // everything already queued on this socket, without going back to zmq_poll
+      void * socket = m_sources[source]->socket.get();
+      while (true)
+      {
+	zmq_msg_t message;
+	zmq_msg_init(&message);
+	const int rc = zmq_msg_recv(&message, socket, ZMQ_DONTWAIT);
+	if (rc == -1)
+	{
+	  zmq_msg_close(&message);
+	  break;
+	}
 
-      int rc = zmq_connect(socket.get(), endpoint.c_str());
-      throw_errno(rc == 0);
+	const size_t size = zmq_msg_size(&message);
+	const void * data = zmq_msg_data(&message);
 
-      rc = zmq_setsockopt(socket.get(), ZMQ_SUBSCRIBE, nullptr, 0);
-      throw_errno(rc == 0);
+	receive(source, data, size);
 
-      m_serverThread = std::thread(server_thread, this, socket);
+	zmq_msg_close(&message);
+      }
     }
 
     void ServerHandler::process(const jack_nframes_t nframes)
     {
-      void * outPortBuf = jack_port_get_buffer(m_outputPort, nframes);
-      jack_midi_clear_buffer(outPortBuf);
+      jack_client_t * client = m_common->getClient();
+      const jack_nframes_t frameTime = jack_last_frame_time(client);
+
+      const uint64_t framesAtStart = m_frames.update(frameTime);
+      m_cycleFrames.store(framesAtStart, std::memory_order_release);
+
+      for (const std::unique_ptr<Output> & output : m_outputs)
+      {
+	output->port->getBuffer(nframes).clear();
+	output->scheduler.startCycle(frameTime);
+      }
 
-      jack_ringbuffer_t * buffSize = m_buffSize.get();
+      jack_ringbuffer_t * ring = m_ring.get();
 
-      while (jack_ringbuffer_read_space(buffSize) > 0)
+      size_t drained = 0;
+      while ((m_drainLimit == 0 || drained < m_drainLimit) && jack_ringbuffer_read_space(ring) >= sizeof(Frame))
       {
-	size_t space;
-	jack_ringbuffer_read(buffSize, (char *)&space, sizeof(space));
-	jack_midi_data_t * midiData = jack_midi_event_reserve(outPortBuf, 0, space);
+	++drained;
 
-	jack_ringbuffer_read(m_buffMessage.get(), (char *)midiData, space);
+	Frame frame;
+	jack_ringbuffer_read(ring, (char *)&frame, sizeof(frame));
+
+	Output & output = *m_outputs[frame.output];
+
+	if (!frame.timed)
+	{
+	  jack_midi_data_t * midiData = output.port->getBuffer(nframes).reserve(0, frame.size);
+	  if (midiData)
+	  {
+	    jack_ringbuffer_read(ring, (char *)midiData, frame.size);
+	  }
+	  else
+	  {
+	    jack_ringbuffer_read_advance(ring, frame.size);
+	  }
+	  continue;
+	}
+
+	// checked by stageTimed()
+	jack_midi_data_t data[4];
+	assert(frame.size <= sizeof(data));
+	jack_ringbuffer_read(ring, (char *)data, frame.size);
+
+	// within +/- 12h of now
+	const int32_t delta = int32_t(frame.time - jack_nframes_t(framesAtStart));
+	const uint64_t time = framesAtStart + delta;
+	output.scheduler.schedule(time, MidiEvent(frame.time, data, frame.size));
+      }
+
+      const uint64_t lastFrame = framesAtStart + nframes;
+
+      for (const std::unique_ptr<Output> & output : m_outputs)
+      {
+	EventScheduler & scheduler = output->scheduler;
+	if (!scheduler.hasDue(lastFrame))
+	{
+	  continue;
+	}
+
+	MidiPortBuffer outPortBuf = output->port->getBuffer(nframes);
+	while (scheduler.hasDue(lastFrame))
+	{
+	  const ScheduledEvent & scheduled = scheduler.top();
+
+	  jack_nframes_t offset = 0;
+	  if (scheduled.time >= framesAtStart)
+	  {
+	    offset = scheduled.time - framesAtStart;
+	  }
+	  else
+	  {
+	    m_late.store(m_late.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	  }
+
+	  outPortBuf.write(offset, scheduled.event.m_data, scheduled.event.m_size);
+	  scheduler.pop();
+	}
       }
     }
 
@@ -94,9 +338,14 @@ namespace ASI
     {
     }
 
+    const char * ServerHandler::getName() const
+    {
+      return "server";
+    }
+
     ServerHandler::~ServerHandler()
     {
-      m_context.reset();
+      m_running = false;
       try
       {
 	m_serverThread.join();
@@ -104,14 +353,165 @@ namespace ASI
       catch(const std::exception &)
       {
       }
+
+      const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+
+      for (const std::unique_ptr<Source> & source : m_sources)
+      {
+	std::cerr << "Server " << source->endpoint << ": " << source->messages << " messages ("
+		  << source->messages / elapsed << "/s), " << source->events << " events, " << source->invalid << " invalid, ";
+	std::cerr << source->droppedMessages << " dropped messages (" << source->droppedEvents << " events)";
+	if (m_timed && source->clock.isValid())
+	{
+	  std::cerr << ", clock offset " << source->clock.getOffset() << " frames, drift " << source->clock.getDrift() << " ppm";
+	}
+	std::cerr << std::endl;
+      }
+
+      if (m_timed)
+      {
+	size_t drops = 0;
+	for (const std::unique_ptr<Output> & output : m_outputs)
+	{
+	  drops += output->scheduler.getDrops();
+	}
+	std::cerr << "Server: " << m_late << " late, " << drops << " dropped by the jitter buffer" << std::endl;
+      }
     }
 
-    void ServerHandler::write(const void * message, const size_t size)
+    void ServerHandler::receive(const size_t index, const void * message, const size_t size)
     {
-      jack_ringbuffer_write(m_buffMessage.get(), (const char *)message, size);
-      // make sure we write the size only after the data
-      // as as soon as the size is read, the data is read as well
-      jack_ringbuffer_write(m_buffSize.get(), (const char *)&size, sizeof(size));
+      Source & source = *m_sources[index];
+
+      // single writer: no need for atomic increments
+      source.messages.store(source.messages.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+      const jack_midi_data_t * data = (const jack_midi_data_t *)message;
+      size_t events = 0;
+      m_staging.clear();
+
+      const bool ok = m_timed ? stageTimed(source, data, size, events) : stageRaw(source, data, size, events);
+      if (!ok)
+      {
+	source.invalid.store(source.invalid.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	return;
+      }
+
+      jack_ringbuffer_t * ring = m_ring.get();
+      if (jack_ringbuffer_write_space(ring) < m_staging.size())
+      {
+	source.droppedMessages.store(source.droppedMessages.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	source.droppedEvents.store(source.droppedEvents.load(std::memory_order_relaxed) + events, std::memory_order_relaxed);
+	return;
+      }
+
+      writeAll(ring, m_staging.data(), m_staging.size());
+      source.events.store(source.events.load(std::memory_order_relaxed) + events, std::memory_order_relaxed);
+    }
+
+    bool ServerHandler::stageRaw(const Source & source, const jack_midi_data_t * data, const size_t size, size_t & events)
+    {
+      size_t position = 0;
+      while (position < size)
+      {
+	const size_t length = eventLength(data + position, size - position);
+	if (length == 0)
+	{
+	  return false;
+	}
+
+	stage(source, data + position, length, false, 0);
+	position += length;
+	++events;
+      }
+      return true;
+    }
+
+    bool ServerHandler::stageTimed(Source & source, const jack_midi_data_t * data, const size_t size, size_t & events)
+    {
+      jack_client_t * client = m_common->getClient();
+      const int64_t sampleRate = jack_get_sample_rate(client);
+
+      // all events in a message have been received together
+      // jack_frame_time() is within a few cycles of the last one seen by process()
+      const uint64_t cycleFrames = m_cycleFrames.load(std::memory_order_acquire);
+      const int64_t local = cycleFrames + int32_t(jack_frame_time(client) - jack_nframes_t(cycleFrames));
+
+      size_t position = 0;
+      while (position < size)
+      {
+	TimedHeader header;
+	if (size - position < sizeof(header))
+	{
+	  return false;
+	}
+
+	memcpy(&header, data + position, sizeof(header));
+	position += sizeof(header);
+
+	// only short messages in the jitter buffer
+	if (header.version != 1 || header.size == 0 || header.size > 4 || size - position < header.size)
+	{
+	  return false;
+	}
+
+	int64_t playout;
+	switch (header.reference)
+	{
+	case SENDER_MICROSECONDS:
+	case SENDER_FRAMES:
+	  {
+	    // split to avoid overflow with times since the epoch
+	    const int64_t remote = header.reference == SENDER_FRAMES ? header.time :
+	      (header.time / 1000000) * sampleRate + (header.time % 1000000) * sampleRate / 1000000;
+
+	    source.clock.add(remote, local);
+	    playout = source.clock.toLocal(remote) + m_delayFrames;
+	    break;
+	  }
+	case JACK_MICROSECONDS:
+	  {
+	    playout = jack_time_to_frames(client, header.time);
+	    break;
+	  }
+	case JACK_FRAMES:
+	  {
+	    playout = header.time;
+	    break;
+	  }
+	default:
+	  {
+	    return false;
+	  }
+	}
+
+	stage(source, data + position, header.size, true, jack_nframes_t(playout));
+	position += header.size;
+	++events;
+      }
+      return true;
+    }
+
+    void ServerHandler::stage(const Source & source, const jack_midi_data_t * data, const size_t size, const bool timed, const jack_nframes_t time)
+    {
+      Frame frame;
+      frame.size = size;
+      frame.time = time;
+      frame.output = source.output;
+      frame.timed = timed;
+
+      const char * header = (const char *)&frame;
+      m_staging.insert(m_staging.end(), header, header + sizeof(frame));
+
+      const size_t first = m_staging.size();
+      m_staging.insert(m_staging.end(), data, data + size);
+
+      // channel messages only
+      const jack_midi_data_t status = data[0];
+      if (source.channel >= 0 && status >= 0x80 && status < MIDI_SYS)
+      {
+	m_staging[first] = (status & 0xF0) | source.channel;
+      }
     }
 
   }
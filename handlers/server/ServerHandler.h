@@ -1,6 +1,10 @@
 #pragma once
 
 #include "I_JackHandler.h"
+#include "MidiPort.h"
+#include "EventScheduler.h"
+#include "FrameCounter.h"
+#include "handlers/server/ClockTracker.h"
 
 #include <jack/ringbuffer.h>
 #include <jack/midiport.h>
@@ -8,6 +12,8 @@
 #include <vector>
 #include <memory>
 #include <thread>
+#include <atomic>
+#include <chrono>
 
 namespace ASI
 {
@@ -17,33 +23,127 @@ namespace ASI
   namespace Server
   {
 
+    struct ServerOptions
+    {
+      // [sub:|pull:][@|>]address[#channel]
+      // sub (default) or pull socket, bind (@) or connect (> default),
+      // events on a different (1-based) channel
+      std::vector<std::string> endpoints;
+
+      std::string format;        // raw / timed
+      double delay;              // ms, timed only
+      size_t capacity;           // jitter buffer events, timed only
+      size_t buffer;             // receive ring bytes
+      size_t drain;              // max events read per cycle (0 = all)
+      bool ports;                // 1 output port per endpoint
+    };
+
+    /*
+      MIDI events received from ZMQ.
+
+      format "raw": each message is 1 or more MIDI events, played at the start of the next cycle.
+      format "timed": each message is 1 or more timestamped events (see WireFormat.h),
+      events wait in a jitter buffer and are played at their sample offset.
+
+      A single thread services all the endpoints with zmq_poll,
+      and passes complete messages to the process callback in a single ring:
+      if there is not enough space, the whole message is dropped (and counted).
+    */
     class ServerHandler : public I_JackHandler
     {
     public:
 
-      ServerHandler(const std::shared_ptr<CommonControls> & common, const std::string & endpoint);
+      ServerHandler(const std::shared_ptr<CommonControls> & common, const ServerOptions & options);
       ~ServerHandler();
 
       virtual void process(const jack_nframes_t nframes);
 
       virtual void shutdown();
 
-      void write(const void * message, const size_t size);
+      virtual const char * getName() const;
+
+      // called by the receiving thread
+      void receive(const size_t source, const void * message, const size_t size);
 
      private:
 
+      struct Source
+      {
+	explicit Source(const int64_t window);
+
+	std::string endpoint;
+	std::shared_ptr<void> socket;
+	size_t output;
+	int channel;              // 0 based, -1 to leave unchanged
+
+	// each sender has its own clock
+	ClockTracker clock;
+
+	// written by the receiving thread only
+	std::atomic<size_t> messages;
+	std::atomic<size_t> events;
+	std::atomic<size_t> invalid;
+	std::atomic<size_t> droppedMessages;
+	std::atomic<size_t> droppedEvents;
+      };
+
+      struct Output
+      {
+	explicit Output(const size_t capacity);
+
+	std::shared_ptr<MidiPort> port;
+
+	// the jitter buffer, used by the process callback only
+	EventScheduler scheduler;
+      };
+
+      // in the ring, followed by "size" bytes
+      struct Frame
+      {
+	uint32_t size;
+	jack_nframes_t time;    // JACK frame, if timed
+	uint16_t output;
+	bool timed;
+      };
+
+      void run();
+      void drain(const size_t source);
+
+      bool stageRaw(const Source & source, const jack_midi_data_t * data, const size_t size, size_t & events);
+      bool stageTimed(Source & source, const jack_midi_data_t * data, const size_t size, size_t & events);
+      void stage(const Source & source, const jack_midi_data_t * data, const size_t size, const bool timed, const jack_nframes_t time);
+
       const std::shared_ptr<CommonControls> m_common;
 
-      jack_port_t *m_outputPort;
+      const bool m_timed;
+      const int64_t m_delayFrames;
+
+      // max events read from the ring in a cycle (0 = all)
+      const size_t m_drainLimit;
+
+      std::vector<std::unique_ptr<Output> > m_outputs;
 
-      std::shared_ptr<jack_ringbuffer_t> m_buffSize;
-      std::shared_ptr<jack_ringbuffer_t> m_buffMessage;
+      std::shared_ptr<jack_ringbuffer_t> m_ring;
 
+      // 64 bit jack_last_frame_time(), extended by the process callback in every cycle
+      // and read by the receiving thread, which cannot see every wrap by itself
+      FrameCounter m_frames;
+      std::atomic<uint64_t> m_cycleFrames;
+
+      // used by the receiving thread only
+      std::vector<char> m_staging;
+
+      std::atomic<size_t> m_late;
+
+      const std::chrono::steady_clock::time_point m_start;
+
+      // the context must outlive the sockets
       std::shared_ptr<void> m_context;
+      std::vector<std::unique_ptr<Source> > m_sources;
 
+      std::atomic<bool> m_running;
       std::thread m_serverThread;
 
-
     };
 
   }
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+
+namespace ASI
+{
+
+  namespace Server
+  {
+
+    /*
+      --server:format=timed
+
+      Each ZMQ message is a TimedHeader (16 bytes, little endian) followed by "size" MIDI bytes.
+
+      SENDER_*: the sender's own clock, with any origin.
+      The handler tracks its offset and drift against the JACK frame time
+      and plays the event "playout delay" after the estimated send time.
+
+      JACK_*: the JACK clock of this server (jack_frame_time() / jack_get_time()).
+      The event is played at exactly that time (or as soon as possible if late).
+    */
+    enum TimeReference
+    {
+      SENDER_MICROSECONDS = 0,
+      SENDER_FRAMES = 1,
+      JACK_MICROSECONDS = 2,
+      JACK_FRAMES = 3
+    };
+
+    struct TimedHeader
+    {
+      uint8_t version;         // 1
+      uint8_t reference;       // TimeReference
+      uint16_t size;           // MIDI bytes after the header
+      uint32_t reserved;
+      int64_t time;
+    };
+
+    static_assert(sizeof(TimedHeader) == 16, "TimedHeader must be 16 bytes");
+
+  }
+}
@@ -0,0 +1,42 @@
+#include "handlers/server/ZmqContext.h"
+
+#include <zmq.h>
+#include <mutex>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+
+namespace
+{
+
+  std::mutex contextMutex;
+  std::weak_ptr<void> sharedContext;
+
+}
+
+namespace ASI
+{
+
+  namespace Server
+  {
+
+    std::shared_ptr<void> getZmqContext()
+    {
+      std::lock_guard<std::mutex> lock(contextMutex);
+
+      std::shared_ptr<void> context = sharedContext.lock();
+      if (!context)
+      {
+	context.reset(zmq_ctx_new(), zmq_ctx_destroy);
+	if (!context)
+	{
+	  throw std::runtime_error(strerror(errno));
+	}
+	sharedContext = context;
+      }
+
+      return context;
+    }
+
+  }
+}
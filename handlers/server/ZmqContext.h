@@ -0,0 +1,21 @@
+#pragma once
+
+#include <memory>
+
+namespace ASI
+{
+
+  namespace Server
+  {
+
+    /*
+      The ZMQ context shared by all the handlers of the process:
+      "inproc://" endpoints only work between sockets of the same context.
+
+      Created on first use, destroyed when the last handler releases it
+      (after all its sockets have been closed).
+    */
+    std::shared_ptr<void> getZmqContext();
+
+  }
+}
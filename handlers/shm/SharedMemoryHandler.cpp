@@ -0,0 +1,143 @@
+#include "handlers/shm/SharedMemoryHandler.h"
+#include "CommonControls.h"
+
+#include <iostream>
+#include <cstring>
+#include <stdexcept>
+#include <new>
+#include <algorithm>
+
+namespace
+{
+
+  uint32_t nextPowerOf2(const size_t value)
+  {
+    uint32_t result = 1;
+    while (result < value)
+    {
+      result <<= 1;
+    }
+    return result;
+  }
+
+}
+
+namespace ASI
+{
+
+  namespace Shm
+  {
+
+    SharedMemoryHandler::SharedMemoryHandler(const std::shared_ptr<CommonControls> & common, const std::string & name, const size_t capacity)
+      : m_common(common), m_name(name), m_late(0)
+    {
+      m_outputPort = m_common->registerMidiPort("shm_out", JackPortIsOutput | JackPortIsTerminal);
+
+      const uint32_t events = nextPowerOf2(capacity);
+      const size_t size = sharedMemorySize(events);
+
+      const int fd = shm_open(m_name.c_str(), O_CREAT | O_RDWR, 0600);
+      if (fd == -1)
+      {
+	throw std::runtime_error("Cannot create " + m_name + ": " + strerror(errno));
+      }
+
+      // a ring left behind by a previous run is reinitialised
+      if (ftruncate(fd, size) != 0)
+      {
+	close(fd);
+	throw std::runtime_error("Cannot resize " + m_name + ": " + strerror(errno));
+      }
+
+      void * memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      close(fd);
+      if (memory == MAP_FAILED)
+      {
+	throw std::runtime_error("Cannot map " + m_name + ": " + strerror(errno));
+      }
+      m_memory.reset(memory, [size](void * p) { munmap(p, size); });
+
+      // touch all the pages now, not in the process callback
+      memset(memory, 0, size);
+
+      m_header = new (memory) SharedHeader;
+      m_header->version = ASI_SHM_VERSION;
+      m_header->capacity = events;
+      m_header->head.store(0, std::memory_order_relaxed);
+      m_header->drops.store(0, std::memory_order_relaxed);
+      m_header->tail.store(0, std::memory_order_relaxed);
+      // producers check it before anything else
+      m_header->magic.store(ASI_SHM_MAGIC, std::memory_order_release);
+
+      m_events = sharedEvents(m_header);
+      m_mask = events - 1;
+    }
+
+    SharedMemoryHandler::~SharedMemoryHandler()
+    {
+      std::cerr << "Shm: " << m_header->head.load() << " events, " << m_header->drops.load() << " dropped by the producers, "
+		<< m_late << " late" << std::endl;
+
+      m_header->magic.store(0);
+      shm_unlink(m_name.c_str());
+    }
+
+    void SharedMemoryHandler::process(const jack_nframes_t nframes)
+    {
+      jack_client_t * client = m_common->getClient();
+
+      MidiPortBuffer outPortBuf = m_outputPort->getBuffer(nframes);
+      outPortBuf.clear();
+
+      const jack_nframes_t framesAtStart = jack_last_frame_time(client);
+
+      const uint64_t head = m_header->head.load(std::memory_order_acquire);
+      uint64_t tail = m_header->tail.load(std::memory_order_relaxed);
+
+      // events must be written in increasing offsets
+      jack_nframes_t lastOffset = 0;
+
+      while (tail != head)
+      {
+	const SharedEvent & event = m_events[tail & m_mask];
+
+	jack_nframes_t offset = lastOffset;
+	if (event.time != 0)
+	{
+	  // within +/- 12h of now
+	  const int32_t delta = int32_t(jack_time_to_frames(client, event.time) - framesAtStart);
+	  if (delta >= int32_t(nframes))
+	  {
+	    // in a later cycle
+	    break;
+	  }
+
+	  if (delta < 0)
+	  {
+	    m_late.store(m_late.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	  }
+	  else
+	  {
+	    offset = std::max<jack_nframes_t>(delta, lastOffset);
+	  }
+	}
+
+	outPortBuf.write(offset, event.data, std::min<size_t>(event.size, sizeof(event.data)));
+	lastOffset = offset;
+	++tail;
+      }
+
+      m_header->tail.store(tail, std::memory_order_release);
+    }
+
+    void SharedMemoryHandler::shutdown()
+    {
+    }
+
+    const char * SharedMemoryHandler::getName() const
+    {
+      return "shm";
+    }
+
+  }
+}
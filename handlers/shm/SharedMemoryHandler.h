@@ -0,0 +1,58 @@
+#pragma once
+
+#include "I_JackHandler.h"
+#include "MidiPort.h"
+#include "handlers/shm/SharedMemoryRing.h"
+
+#include <jack/midiport.h>
+#include <string>
+#include <memory>
+#include <atomic>
+
+namespace ASI
+{
+
+  class CommonControls;
+
+  namespace Shm
+  {
+
+    /*
+      MIDI events written by local processes in a named shared memory ring (see SharedMemoryRing.h).
+
+      No thread and no system call: the process callback reads the ring directly,
+      and plays each event at its sample offset.
+      Events are in time order: the first one after the end of the cycle waits for the next cycle,
+      late ones are played at the start of the cycle (and counted).
+    */
+    class SharedMemoryHandler : public I_JackHandler
+    {
+    public:
+
+      // name as in shm_open ("/asisynth"), capacity in events (rounded up to a power of 2)
+      SharedMemoryHandler(const std::shared_ptr<CommonControls> & common, const std::string & name, const size_t capacity);
+      ~SharedMemoryHandler();
+
+      virtual void process(const jack_nframes_t nframes);
+
+      virtual void shutdown();
+
+      virtual const char * getName() const;
+
+    private:
+
+      const std::shared_ptr<CommonControls> m_common;
+      const std::string m_name;
+
+      std::shared_ptr<MidiPort> m_outputPort;
+
+      std::shared_ptr<void> m_memory;
+      SharedHeader * m_header;
+      SharedEvent * m_events;
+      uint64_t m_mask;
+
+      std::atomic<size_t> m_late;
+    };
+
+  }
+}
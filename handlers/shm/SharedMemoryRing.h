@@ -0,0 +1,170 @@
+#pragma once
+
+/*
+  Client header for --shm: a producer on the same host writes MIDI events
+  directly into the memory read by the JACK process callback.
+
+  Self contained (no JACK, no asisynth library), link with -lrt on older glibc.
+
+    ASI::Shm::SharedMemoryProducer producer("/asisynth");
+    const uint8_t noteOn[] = {0x90, 60, 100};
+    producer.push(0, noteOn, sizeof(noteOn));                           // as soon as possible
+    producer.push(ASI::Shm::monotonicMicroseconds() + 5000, noteOn, 3); // in 5 ms
+
+  Times are microseconds of jack_get_time() (0 = as soon as possible),
+  and must be written in order: the callback waits for the first event in the future.
+
+  Single producer, single consumer: a process with several threads writing must serialise them.
+*/
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <ctime>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define ASI_SHM_MAGIC 0x4d495341     // "ASIM"
+#define ASI_SHM_VERSION 1
+
+// head and tail on different cache lines
+#define ASI_SHM_CACHE_LINE 64
+
+namespace ASI
+{
+
+  namespace Shm
+  {
+
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "Shared memory needs lock free 64 bit atomics");
+
+    struct SharedEvent
+    {
+      uint64_t time;            // jack_get_time(), 0 = as soon as possible
+      uint8_t size;
+      uint8_t data[7];
+    };
+
+    static_assert(sizeof(SharedEvent) == 16, "SharedEvent must be 16 bytes");
+
+    struct SharedHeader
+    {
+      std::atomic<uint32_t> magic;      // set last by the consumer
+      uint32_t version;
+      uint32_t capacity;                // events, power of 2
+
+      // written by the producer
+      alignas(ASI_SHM_CACHE_LINE) std::atomic<uint64_t> head;
+      std::atomic<uint64_t> drops;      // ring full
+
+      // written by the consumer
+      alignas(ASI_SHM_CACHE_LINE) std::atomic<uint64_t> tail;
+
+      // followed by "capacity" SharedEvent
+    };
+
+    inline size_t sharedMemorySize(const uint32_t capacity)
+    {
+      return sizeof(SharedHeader) + capacity * sizeof(SharedEvent);
+    }
+
+    inline SharedEvent * sharedEvents(SharedHeader * header)
+    {
+      return reinterpret_cast<SharedEvent *>(header + 1);
+    }
+
+    // the clock of jack_get_time() with JACK2 on Linux
+    inline uint64_t monotonicMicroseconds()
+    {
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+    }
+
+    class SharedMemoryProducer
+    {
+    public:
+      // the ring must have been created by asisynth --shm
+      explicit SharedMemoryProducer(const std::string & name)
+      {
+	const int fd = shm_open(name.c_str(), O_RDWR, 0);
+	if (fd == -1)
+	{
+	  throw std::runtime_error("Cannot open " + name + ": " + strerror(errno));
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(SharedHeader))
+	{
+	  close(fd);
+	  throw std::runtime_error("Not an asisynth ring: " + name);
+	}
+
+	m_size = st.st_size;
+	void * memory = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (memory == MAP_FAILED)
+	{
+	  throw std::runtime_error("Cannot map " + name + ": " + strerror(errno));
+	}
+
+	m_header = static_cast<SharedHeader *>(memory);
+	if (m_header->magic.load(std::memory_order_acquire) != ASI_SHM_MAGIC || m_header->version != ASI_SHM_VERSION
+	    || sharedMemorySize(m_header->capacity) > m_size)
+	{
+	  munmap(memory, m_size);
+	  throw std::runtime_error("Not an asisynth ring: " + name);
+	}
+
+	m_events = sharedEvents(m_header);
+	m_mask = m_header->capacity - 1;
+      }
+
+      ~SharedMemoryProducer()
+      {
+	munmap(m_header, m_size);
+      }
+
+      SharedMemoryProducer(const SharedMemoryProducer &) = delete;
+      SharedMemoryProducer & operator=(const SharedMemoryProducer &) = delete;
+
+      // false if the ring is full (the event is dropped and counted) or the event too long
+      bool push(const uint64_t time, const uint8_t * data, const size_t size)
+      {
+	if (size == 0 || size > sizeof(SharedEvent::data))
+	{
+	  return false;
+	}
+
+	const uint64_t head = m_header->head.load(std::memory_order_relaxed);
+	const uint64_t tail = m_header->tail.load(std::memory_order_acquire);
+	if (head - tail > m_mask)
+	{
+	  m_header->drops.fetch_add(1, std::memory_order_relaxed);
+	  return false;
+	}
+
+	SharedEvent & event = m_events[head & m_mask];
+	event.time = time;
+	event.size = size;
+	memcpy(event.data, data, size);
+
+	m_header->head.store(head + 1, std::memory_order_release);
+	return true;
+      }
+
+    private:
+      size_t m_size;
+      SharedHeader * m_header;
+      SharedEvent * m_events;
+      uint64_t m_mask;
+    };
+
+  }
+}
@@ -5,12 +5,24 @@
 #include <vector>
 #include <array>
 #include <cstring>
+#include <algorithm>
+#include <stdexcept>
 
 namespace ASI
 {
   namespace Synth
   {
 
+    // the implementations of Filter::process()
+    enum class FilterKernel
+    {
+      AUTO,                     // process_2, or process_block from the block threshold
+	PROCESS_0,
+	PROCESS_1,
+	PROCESS_2,
+	BLOCK
+	};
+
     class InitFilter
     {
     public:
@@ -29,6 +41,8 @@ namespace ASI
 	m_a.fill(0.0);
 
 	m_buffer.resize(8192);
+	m_blockThreshold = DEFAULT_BLOCK_THRESHOLD;
+	m_kernel = FilterKernel::AUTO;
 	resetData();
 	resetFilter();
       }
@@ -50,12 +64,19 @@ namespace ASI
 	  throw std::invalid_argument("IIR a is empty");
 	}
 
+	// before any change, so a rejected filter is left as it was
+	const size_t sizeOfAB = std::max(b.size(), a.size());
+	if (sizeOfAB > MAX_SIZE_OF_AB)
+	{
+	  throw std::invalid_argument("IIR order is too large, use a FilterBank");
+	}
+
 	m_b.fill(0.0);
 	m_a.fill(0.0);
 	std::copy(b.begin(), b.end(), m_b.begin());
 	std::copy(a.begin(), a.end(), m_a.begin());
 
-	m_sizeOfAB = std::max(b.size(), a.size());
+	m_sizeOfAB = sizeOfAB;
 
 	// normalise so we do not need to worry about m_a[0] later
 	for (ssize_t i = 1; i < m_sizeOfAB; ++i)
@@ -64,6 +85,20 @@ namespace ASI
 	}
 	m_a[0] = 0.0;
 
+	prepareBlock();
+	resetData();
+      }
+
+      // blocks of at least this many frames use process_block() (0 = never)
+      void setBlockThreshold(const ssize_t threshold)
+      {
+	m_blockThreshold = threshold;
+      }
+
+      // the kernels do not share their state: this resets it
+      void setKernel(const FilterKernel kernel)
+      {
+	m_kernel = kernel;
 	resetData();
       }
 
@@ -125,7 +160,8 @@ namespace ASI
 	void process_1(Real_t * x, const ssize_t n)
       {
 	// calculation of x
-	for (ssize_t j = 0; j < sizeOfAB; ++j)
+	const ssize_t head = std::min(sizeOfAB, n);
+	for (ssize_t j = 0; j < head; ++j)
 	{
 	  Real_t dot = 0.0;
 	  for (ssize_t i = 0; i < sizeOfAB; ++i)
@@ -158,7 +194,7 @@ namespace ASI
 	}
 	else
 	{
-	  memcpy(&m_x[n + 1], &m_x[1], sizeof(Real_t) * (sizeOfAB - 1 - n));
+	  memmove(&m_x[n + 1], &m_x[1], sizeof(Real_t) * (sizeOfAB - 1 - n));
 	  for (ssize_t i = 1; i <= n; ++i)
 	  {
 	    m_x[i] = x[n - i];
@@ -167,7 +203,7 @@ namespace ASI
 
 	// calculation of y
 	// x is the output
-	for (ssize_t j = 0; j < sizeOfAB; ++j)
+	for (ssize_t j = 0; j < head; ++j)
 	{
 	  Real_t dot = 0.0;
 	  for (ssize_t i = 1; i < sizeOfAB; ++i)
@@ -200,7 +236,7 @@ namespace ASI
 	}
 	else
 	{
-	  memcpy(&m_y[n + 1], &m_y[1], sizeof(Real_t) * (sizeOfAB - 1 - n));
+	  memmove(&m_y[n + 1], &m_y[1], sizeof(Real_t) * (sizeOfAB - 1 - n));
 	  for (ssize_t i = 1; i <= n; ++i)
 	  {
 	    m_y[i] = x[n - i];
@@ -212,13 +248,21 @@ namespace ASI
       // new
       template <ssize_t sizeOfAB>
 	void process_2(Real_t * x, const ssize_t n)
+      {
+	feedForward<sizeOfAB>(x, n);
+	feedBack<sizeOfAB>(m_buffer.data(), x, n);
+      }
+
+      // m_buffer = b * x
+      template <ssize_t sizeOfAB>
+	void feedForward(const Real_t * x, const ssize_t n)
       {
 	memset(m_buffer.data(), 0, sizeof(Real_t) * n);
 
 	// calculation of x
 	for (ssize_t i = 0; i < sizeOfAB; ++i)
 	{
-	  for (ssize_t j = 0; j < i; ++j)
+	  for (ssize_t j = 0; j < std::min(i, n); ++j)
 	  {
 	    // i - j >= 1
 	    m_buffer[j] += m_x[i - j] * m_b[i];
@@ -240,16 +284,21 @@ namespace ASI
 	}
 	else
 	{
-	  memcpy(&m_x[n + 1], &m_x[1], sizeof(Real_t) * (sizeOfAB - 1 - n));
+	  memmove(&m_x[n + 1], &m_x[1], sizeof(Real_t) * (sizeOfAB - 1 - n));
 	  for (ssize_t i = 1; i <= n; ++i)
 	  {
 	    m_x[i] = x[n - i];
 	  }
 	}
+      }
 
-	// calculation of y
-	// x is the output
-	for (ssize_t j = 0; j < sizeOfAB; ++j)
+      // x = v - a * x, v from feedForward()
+      template <ssize_t sizeOfAB>
+	void feedBack(const Real_t * v, Real_t * x, const ssize_t n)
+      {
+	// x is the output (only the first n values)
+	const ssize_t head = std::min(sizeOfAB, n);
+	for (ssize_t j = 0; j < head; ++j)
 	{
 	  Real_t dot = 0.0;
 	  for (ssize_t i = 1; i <= j; ++i)
@@ -260,7 +309,7 @@ namespace ASI
 	  {
 	    dot += m_y[i - j] * m_a[i];
 	  }
-	  x[j] = m_buffer[j] - dot;
+	  x[j] = v[j] - dot;
 	}
 
 	for (ssize_t j = sizeOfAB; j < n; ++j)
@@ -270,7 +319,7 @@ namespace ASI
 	  {
 	    dot += x[j - i] * m_a[i];
 	  }
-	  x[j] = m_buffer[j] - dot;
+	  x[j] = v[j] - dot;
 	}
 
 	if (n >= sizeOfAB - 1)
@@ -283,7 +332,7 @@ namespace ASI
 	}
 	else
 	{
-	  memcpy(&m_y[n + 1], &m_y[1], sizeof(Real_t) * (sizeOfAB - 1 - n));
+	  memmove(&m_y[n + 1], &m_y[1], sizeof(Real_t) * (sizeOfAB - 1 - n));
 	  for (ssize_t i = 1; i <= n; ++i)
 	  {
 	    m_y[i] = x[n - i];
@@ -292,6 +341,67 @@ namespace ASI
 
       }
 
+      // state space, BLOCK outputs at a time: the recursion is only between blocks
+      // on top of feedForward(): y = T v + O s, s = previous outputs (m_y)
+      // all the BLOCK outputs are independent and accumulate in double
+      // the state is the same as process_2(): they can alternate
+      template <ssize_t sizeOfAB>
+	void process_block(Real_t * x, const ssize_t n)
+      {
+	const ssize_t order = sizeOfAB - 1;
+	const ssize_t blocks = n / BLOCK;
+
+	feedForward<sizeOfAB>(x, n);
+
+	double state[order];
+	for (ssize_t i = 0; i < order; ++i)
+	{
+	  state[i] = m_y[i + 1];
+	}
+
+	for (ssize_t k = 0; k < blocks; ++k)
+	{
+	  const Real_t * v = m_buffer.data() + k * BLOCK;
+
+	  double y[BLOCK] = {0.0};
+	  for (ssize_t j = 0; j < BLOCK; ++j)
+	  {
+	    const double * column = m_blockT.data() + j * BLOCK;
+	    const double vj = v[j];
+	    for (ssize_t i = 0; i < BLOCK; ++i)
+	    {
+	      y[i] += column[i] * vj;
+	    }
+	  }
+	  for (ssize_t j = 0; j < order; ++j)
+	  {
+	    const double * column = m_blockO.data() + j * BLOCK;
+	    for (ssize_t i = 0; i < BLOCK; ++i)
+	    {
+	      y[i] += column[i] * state[j];
+	    }
+	  }
+
+	  for (ssize_t i = 0; i < order; ++i)
+	  {
+	    state[i] = y[BLOCK - 1 - i];
+	  }
+	  std::copy(y, y + BLOCK, x + k * BLOCK);
+	}
+
+	for (ssize_t i = 0; i < order; ++i)
+	{
+	  m_y[i + 1] = state[i];
+	}
+
+	// the tail
+	const ssize_t done = blocks * BLOCK;
+	if (done < n)
+	{
+	  feedBack<sizeOfAB>(m_buffer.data() + done, x + done, n - done);
+	}
+      }
+
       void process(Real_t * x, const ssize_t n)
       {
 	if (n == 0)
@@ -303,15 +413,103 @@ namespace ASI
 	{
 	case 1:
 	  return; // this is just y_i = x_i, so we skip it.
+	case 2:
+	  return process_n<2>(x, n);
 	case 3:
-	  return process_2<3>(x, n);
+	  return process_n<3>(x, n);
+	case 4:
+	  return process_n<4>(x, n);
 	case 5:
-	  return process_2<5>(x, n);
+	  return process_n<5>(x, n);
+	case 6:
+	  return process_n<6>(x, n);
+	case 7:
+	  return process_n<7>(x, n);
+	case 8:
+	  return process_n<8>(x, n);
+	case MAX_SIZE_OF_AB:
+	  return process_n<MAX_SIZE_OF_AB>(x, n);
 	};
       }
 
     private:
 
+      // direct form is not stable in float at high order
+      static const ssize_t MAX_SIZE_OF_AB = 9;
+
+      // outputs computed together by process_block()
+      static const ssize_t BLOCK = 8;
+
+      // below this the serial recursion is faster
+      static const ssize_t DEFAULT_BLOCK_THRESHOLD = 256;
+
+      template <ssize_t sizeOfAB>
+	void process_n(Real_t * x, const ssize_t n)
+      {
+	switch (m_kernel)
+	{
+	case FilterKernel::PROCESS_0:
+	  return process_0<sizeOfAB>(x, n);
+	case FilterKernel::PROCESS_1:
+	  return process_1<sizeOfAB>(x, n);
+	case FilterKernel::PROCESS_2:
+	  return process_2<sizeOfAB>(x, n);
+	case FilterKernel::BLOCK:
+	  return process_block<sizeOfAB>(x, n);
+	case FilterKernel::AUTO:
+	default:
+	  if (m_blockThreshold > 0 && n >= m_blockThreshold)
+	  {
+	    return process_block<sizeOfAB>(x, n);
+	  }
+	  else
+	  {
+	    return process_2<sizeOfAB>(x, n);
+	  }
+	}
+      }
+
+      // the matrices of process_block(), by running the recursion in double
+      void prepareBlock()
+      {
+	const ssize_t order = m_sizeOfAB - 1;
+
+	// y_i = v_i - sum a_k y_{i - k} for i in [0, BLOCK), with h[k] = y_{-k}
+	const auto run = [this, order](const std::array<double, BLOCK> & v, const std::array<double, MAX_SIZE_OF_AB> & h, double * out)
+	  {
+	    std::array<double, BLOCK> y;
+	    for (ssize_t i = 0; i < BLOCK; ++i)
+	    {
+	      double value = v[i];
+	      for (ssize_t k = 1; k <= order; ++k)
+	      {
+		value -= double(m_a[k]) * (i - k >= 0 ? y[i - k] : h[k - i]);
+	      }
+	      y[i] = value;
+	      out[i] = value;
+	    }
+	  };
+
+	const std::array<double, BLOCK> zeroV = {{0.0}};
+	const std::array<double, MAX_SIZE_OF_AB> zeroH = {{0.0}};
+
+	// O: 1 column per previous output
+	for (ssize_t j = 0; j < order; ++j)
+	{
+	  std::array<double, MAX_SIZE_OF_AB> h = zeroH;
+	  h[j + 1] = 1.0;
+	  run(zeroV, h, m_blockO.data() + j * BLOCK);
+	}
+
+	// T: 1 column per input
+	for (ssize_t j = 0; j < BLOCK; ++j)
+	{
+	  std::array<double, BLOCK> v = zeroV;
+	  v[j] = 1.0;
+	  run(v, zeroH, m_blockT.data() + j * BLOCK);
+	}
+      }
+
       ssize_t m_pos;
       std::array<Real_t, 1 << N> m_x;
       std::array<Real_t, 1 << N> m_y;
@@ -321,6 +519,11 @@ namespace ASI
       std::array<Real_t, 1 << N> m_a;
 
       std::vector<Real_t> m_buffer;
+
+      FilterKernel m_kernel;
+      ssize_t m_blockThreshold;
+      std::array<double, (MAX_SIZE_OF_AB - 1) * BLOCK> m_blockO;
+      std::array<double, BLOCK * BLOCK> m_blockT;
     };
 
   }
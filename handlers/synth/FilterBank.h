@@ -0,0 +1,145 @@
+#pragma once
+
+#include "handlers/synth/SynthParameters.h"
+
+#include <vector>
+#include <array>
+#include <cstddef>
+
+namespace ASI
+{
+  namespace Synth
+  {
+
+    // y = (b0 + b1 z^-1 + b2 z^-2) / (1 + a1 z^-1 + a2 z^-2) x
+    struct Biquad
+    {
+      Real_t b0;
+      Real_t b1;
+      Real_t b2;
+      Real_t a1;
+      Real_t a2;
+    };
+
+    /*
+      LANES independent cascades of biquads (second order sections), 1 per voice.
+
+      The signals are interleaved (frame major: x[i * LANES + lane])
+      so every step runs all the lanes together in SIMD registers.
+      Transposed direct form II: stable in float at any order.
+    */
+    template <size_t LANES>
+      class FilterBank
+    {
+    public:
+
+      // does not allocate below "capacity" sections
+      void initialise(const size_t capacity)
+      {
+	m_sections.reserve(capacity);
+	setNumberOfSections(0);
+      }
+
+      // all the lanes become pass through
+      void setNumberOfSections(const size_t sections)
+      {
+	m_sections.resize(sections);
+	for (size_t lane = 0; lane < LANES; ++lane)
+	{
+	  resetLane(lane);
+	}
+      }
+
+      size_t getNumberOfSections() const
+      {
+	return m_sections.size();
+      }
+
+      // sos has getNumberOfSections() biquads
+      void load(const size_t lane, const Biquad * sos)
+      {
+	for (size_t s = 0; s < m_sections.size(); ++s)
+	{
+	  Section & section = m_sections[s];
+	  section.b0[lane] = sos[s].b0;
+	  section.b1[lane] = sos[s].b1;
+	  section.b2[lane] = sos[s].b2;
+	  section.a1[lane] = sos[s].a1;
+	  section.a2[lane] = sos[s].a2;
+	  section.z1[lane] = 0.0;
+	  section.z2[lane] = 0.0;
+	}
+      }
+
+      // in place, n frames of LANES values
+      void process(Real_t * x, const size_t n)
+      {
+	for (Section & section : m_sections)
+	{
+	  // local copies: no aliasing with x
+	  Real_t b0[LANES], b1[LANES], b2[LANES], a1[LANES], a2[LANES];
+	  Real_t z1[LANES], z2[LANES];
+	  for (size_t j = 0; j < LANES; ++j)
+	  {
+	    b0[j] = section.b0[j];
+	    b1[j] = section.b1[j];
+	    b2[j] = section.b2[j];
+	    a1[j] = section.a1[j];
+	    a2[j] = section.a2[j];
+	    z1[j] = section.z1[j];
+	    z2[j] = section.z2[j];
+	  }
+
+	  for (size_t i = 0; i < n; ++i)
+	  {
+	    Real_t * frame = x + i * LANES;
+	    for (size_t j = 0; j < LANES; ++j)
+	    {
+	      const Real_t in = frame[j];
+	      const Real_t out = b0[j] * in + z1[j];
+	      z1[j] = b1[j] * in - a1[j] * out + z2[j];
+	      z2[j] = b2[j] * in - a2[j] * out;
+	      frame[j] = out;
+	    }
+	  }
+
+	  for (size_t j = 0; j < LANES; ++j)
+	  {
+	    section.z1[j] = z1[j];
+	    section.z2[j] = z2[j];
+	  }
+	}
+      }
+
+    private:
+
+      struct Section
+      {
+	std::array<Real_t, LANES> b0;
+	std::array<Real_t, LANES> b1;
+	std::array<Real_t, LANES> b2;
+	std::array<Real_t, LANES> a1;
+	std::array<Real_t, LANES> a2;
+	std::array<Real_t, LANES> z1;
+	std::array<Real_t, LANES> z2;
+      };
+
+      void resetLane(const size_t lane)
+      {
+	for (Section & section : m_sections)
+	{
+	  section.b0[lane] = 1.0;
+	  section.b1[lane] = 0.0;
+	  section.b2[lane] = 0.0;
+	  section.a1[lane] = 0.0;
+	  section.a2[lane] = 0.0;
+	  section.z1[lane] = 0.0;
+	  section.z2[lane] = 0.0;
+	}
+      }
+
+      std::vector<Section> m_sections;
+    };
+
+  }
+}
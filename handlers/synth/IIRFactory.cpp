@@ -2,12 +2,93 @@
 #include "handlers/synth/Filter.h"
 
 #include <cstdlib>
+#include <cmath>
+#include <complex>
+#include <memory>
+#include <stdexcept>
 
 extern "C"
 {
 #include "sigproc/iir.h"
 }
 
+namespace
+{
+  using ASI::Synth::Real_t;
+  using ASI::Synth::Pass;
+  using ASI::Synth::Biquad;
+  using ASI::Synth::InitFilter;
+
+  typedef std::complex<double> Complex_t;
+
+  // the edges of the band must stay below Nyquist (in fractions of the sample rate)
+  // a band beyond it is squeezed below
+  const double MAX_LOWER = 0.45;
+  const double MAX_UPPER = 0.49;
+
+  // the sigproc functions return malloc'ed arrays
+  template <typename C>
+  void initFilter(C * ccof, double * dcof, const double scalingFactor, const size_t numberOfCoefficients, InitFilter & filter)
+  {
+    const std::unique_ptr<C, decltype(&free)> c(ccof, &free);
+    const std::unique_ptr<double, decltype(&free)> d(dcof, &free);
+    if (!c || !d)
+    {
+      throw std::runtime_error("Cannot create filter");
+    }
+
+    std::vector<Real_t> b(ccof, ccof + numberOfCoefficients);
+    for (Real_t & value: b)
+    {
+      value *= scalingFactor;
+    }
+
+    std::vector<Real_t> a(dcof, dcof + numberOfCoefficients);
+
+    filter.init(b, a);
+  }
+
+  // analog frequency, for a bilinear transform with T = 1
+  double prewarp(const Real_t frequency, const size_t sr, const double limit)
+  {
+    const double f = std::min<double>(frequency / sr, limit);
+    return 2.0 * std::tan(M_PI * f);
+  }
+
+  Complex_t bilinear(const Complex_t & s)
+  {
+    return (2.0 + s) / (2.0 - s);
+  }
+
+  // the 2 roots of s^2 - b s + c
+  void quadraticRoots(const Complex_t & b, const double c, Complex_t & s1, Complex_t & s2)
+  {
+    const Complex_t delta = std::sqrt(b * b - 4.0 * c);
+    s1 = 0.5 * (b + delta);
+    s2 = 0.5 * (b - delta);
+  }
+
+  struct Section
+  {
+    double b0, b1, b2;
+    Complex_t p1, p2;    // s plane, a conjugate pair or 2 real ones
+    bool single;         // only p1 (real)
+  };
+
+  Complex_t response(const Section & section, const Complex_t & z)
+  {
+    const Complex_t q1 = bilinear(section.p1);
+    const Complex_t numerator = section.b0 + (section.b1 + section.b2 / z) / z;
+    if (section.single)
+    {
+      return numerator / (1.0 - q1 / z);
+    }
+    const Complex_t q2 = bilinear(section.p2);
+    return numerator / ((1.0 - q1 / z) * (1.0 - q2 / z));
+  }
+
+}
+
 namespace ASI
 {
   namespace Synth
@@ -17,11 +98,30 @@ namespace ASI
     {
       switch (pass)
       {
+      case Pass::LOWPASS:
+	{
+	  const double f = 2.0 * upper / sr;
+	  initFilter(ccof_bwlp(order), dcof_bwlp(order, f), sf_bwlp(order, f), order + 1, filter);
+	  break;
+	}
+      case Pass::HIGHPASS:
+	{
+	  const double f = 2.0 * lower / sr;
+	  initFilter(ccof_bwhp(order), dcof_bwhp(order, f), sf_bwhp(order, f), order + 1, filter);
+	  break;
+	}
       case Pass::BANDPASS:
 	{
 	  createButterBandPassFilter(order, sr, lower, upper, filter);
 	  break;
 	}
+      case Pass::BANDSTOP:
+	{
+	  const double wl = 2.0 * lower / sr;
+	  const double wh = 2.0 * upper / sr;
+	  initFilter(ccof_bwbs(order, wl, wh), dcof_bwbs(order, wl, wh), sf_bwbs(order, wl, wh), 2 * order + 1, filter);
+	  break;
+	}
       case Pass::NONE:
       default:
 	{
@@ -31,36 +131,151 @@ namespace ASI
       }
     }
 
-
     void createButterBandPassFilter(const size_t order, const size_t sr, const Real_t lower, const Real_t upper, InitFilter & filter)
     {
       const Real_t wl = 2.0 * lower / sr;
       const Real_t wh = 2.0 * upper / sr;
 
-      int * ccof = ccof_bwbp(order);             // b
-      double * dcof = dcof_bwbp(order, wl, wh);  // a
-      if (!ccof || !dcof)
+      initFilter(ccof_bwbp(order), dcof_bwbp(order, wl, wh), sf_bwbp(order, wl, wh), 2 * order + 1, filter);
+    }
+
+    std::vector<Biquad> designButterworth(const Pass pass, const size_t order, const size_t sr, const Real_t lower, const Real_t upper)
+    {
+      std::vector<Section> sections;
+
+      if (pass == Pass::NONE || order == 0)
       {
-	throw std::runtime_error("Cannot create filter");
+	return std::vector<Biquad>();
       }
 
-      const Real_t scalingFactor = sf_bwbp(order, wl, wh);
+      const double w1 = prewarp(lower, sr, MAX_LOWER);
+      const double w2 = prewarp(upper, sr, MAX_UPPER);
+      const double bandwidth = w2 - w1;
+      const double w0 = std::sqrt(w1 * w2);
+
+      // zeros of the band stop, on the unit circle
+      const double bandStop = -2.0 * bilinear(Complex_t(0.0, w0)).real();
+
+      // normalised lowpass prototype: the poles in the upper half plane, then the real one
+      for (size_t k = 0; k < (order + 1) / 2; ++k)
+      {
+	const Complex_t p = std::polar(1.0, M_PI * (2 * k + order + 1) / (2 * order));
+	const bool real = 2 * k + 1 == order;
+
+	switch (pass)
+	{
+	case Pass::LOWPASS:
+	  {
+	    const Complex_t s = w2 * (real ? Complex_t(-1.0) : p);
+	    sections.push_back(real ? Section{1.0, 1.0, 0.0, s, s, true} : Section{1.0, 2.0, 1.0, s, std::conj(s), false});
+	    break;
+	  }
+	case Pass::HIGHPASS:
+	  {
+	    const Complex_t s = w1 / (real ? Complex_t(-1.0) : p);
+	    sections.push_back(real ? Section{1.0, -1.0, 0.0, s, s, true} : Section{1.0, -2.0, 1.0, s, std::conj(s), false});
+	    break;
+	  }
+	case Pass::BANDPASS:
+	case Pass::BANDSTOP:
+	  {
+	    // p -> 2 poles, roots of s^2 - p bw s + w0^2 (band pass) or s^2 - bw / p s + w0^2 (band stop)
+	    const Complex_t pr = real ? Complex_t(-1.0) : p;
+	    const Complex_t b = pass == Pass::BANDPASS ? pr * bandwidth : bandwidth / pr;
+	    const double b1 = pass == Pass::BANDPASS ? 0.0 : bandStop;
+	    const double b2 = pass == Pass::BANDPASS ? -1.0 : 1.0;
 
-      const size_t numberOfCoefficients = 2 * order + 1;
+	    Complex_t s1, s2;
+	    quadraticRoots(b, w0 * w0, s1, s2);
+	    if (real)
+	    {
+	      // the roots are conjugate or both real
+	      sections.push_back(Section{1.0, b1, b2, s1, s2, false});
+	    }
+	    else
+	    {
+	      sections.push_back(Section{1.0, b1, b2, s1, std::conj(s1), false});
+	      sections.push_back(Section{1.0, b1, b2, s2, std::conj(s2), false});
+	    }
+	    break;
+	  }
+	default:
+	  break;
+	}
+      }
 
-      std::vector<Real_t> b(ccof, ccof + numberOfCoefficients);
-      for (Real_t & value: b)
+      // unit gain in the pass band
+      Complex_t reference;
+      switch (pass)
       {
-	value *= scalingFactor;
+      case Pass::HIGHPASS:
+	reference = -1.0;
+	break;
+      case Pass::BANDPASS:
+	reference = bilinear(Complex_t(0.0, w0));
+	break;
+      default:
+	reference = 1.0;
+	break;
       }
 
-      std::vector<Real_t> a(dcof, dcof + numberOfCoefficients);
+      Complex_t total = 1.0;
+      for (const Section & section : sections)
+      {
+	total *= response(section, reference);
+      }
 
-      filter.init(b, a);
+      // spread the gain across the sections
+      const double gain = std::pow(1.0 / std::abs(total), 1.0 / sections.size());
 
-      // we are probably leaking if an exception is thrown above
-      free(ccof);
-      free(dcof);
+      std::vector<Biquad> sos;
+      for (const Section & section : sections)
+      {
+	const Complex_t q1 = bilinear(section.p1);
+	const Complex_t q2 = section.single ? Complex_t(0.0) : bilinear(section.p2);
+
+	Biquad biquad;
+	biquad.b0 = gain * section.b0;
+	biquad.b1 = gain * section.b1;
+	biquad.b2 = gain * section.b2;
+	biquad.a1 = -(q1 + q2).real();
+	biquad.a2 = (q1 * q2).real();
+	sos.push_back(biquad);
+      }
+
+      return sos;
+    }
+
+    void IIRTable::build(const IIR & iir, const size_t sr, const size_t capacity)
+    {
+      m_sections = 0;
+      m_biquads.clear();
+
+      for (size_t n = 0; n < NUMBER_OF_NOTES; ++n)
+      {
+	const Real_t base = std::pow(2.0, (Real_t(n) - 69) / 12.0) * 440.0;
+	const Real_t lower = base / iir.lower;
+	const Real_t upper = base * iir.upper;
+
+	const std::vector<Biquad> sos = designButterworth(iir.pass, iir.order, sr, lower, upper);
+	m_sections = sos.size();
+	m_biquads.insert(m_biquads.end(), sos.begin(), sos.end());
+      }
+
+      if (m_sections > capacity)
+      {
+	throw std::runtime_error("IIR order is too large");
+      }
+    }
+
+    size_t IIRTable::getNumberOfSections() const
+    {
+      return m_sections;
+    }
+
+    const Biquad * IIRTable::getSections(const size_t n) const
+    {
+      return m_biquads.data() + n * m_sections;
     }
 
   }
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "handlers/synth/SynthParameters.h"
+#include "handlers/synth/FilterBank.h"
 #include <cstddef>
+#include <vector>
 
 namespace ASI
 {
@@ -11,5 +13,35 @@ namespace ASI
 
     void createButterBandPassFilter(const size_t order, const size_t sr, const Real_t lower, const Real_t upper, InitFilter & filter);
     void createFilter(const Pass pass, const size_t order, const size_t sr, const Real_t lower, const Real_t upper, InitFilter & filter);
+
+    // Butterworth as a cascade of second order sections (designed in double)
+    // lowpass: cutoff upper, highpass: cutoff lower
+    // bandpass / bandstop: order sections, lowpass / highpass: (order + 1) / 2
+    std::vector<Biquad> designButterworth(const Pass pass, const size_t order, const size_t sr, const Real_t lower, const Real_t upper);
+
+    /*
+      The filter of every MIDI note, designed once (outside the process callback):
+      a note on only copies the coefficients.
+
+      Note n (frequency f) gets the band [f / iir.lower, f * iir.upper].
+    */
+    class IIRTable
+    {
+    public:
+      static const size_t NUMBER_OF_NOTES = 128;
+
+      // capacity: max number of sections the filters can take
+      void build(const IIR & iir, const size_t sr, const size_t capacity);
+
+      // the same for all the notes
+      size_t getNumberOfSections() const;
+
+      const Biquad * getSections(const size_t n) const;
+
+    private:
+      size_t m_sections;
+      std::vector<Biquad> m_biquads;
+    };
+
   }
 }
@@ -0,0 +1,267 @@
+#include "handlers/synth/KernelTuner.h"
+#include "handlers/synth/IIRFactory.h"
+
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <chrono>
+#include <limits>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+// samples of noise each kernel is timed on
+#define TUNE_SAMPLES 65536
+
+// timed runs of each kernel, the fastest counts
+#define TUNE_REPEATS 5
+
+// a kernel is accepted if its error is at most this times the one of process_2
+#define KERNEL_TOLERANCE 2.0
+
+// or if its error is below this (relative to the largest output)
+#define KERNEL_EXACT 0.000001
+
+namespace
+{
+  using ASI::Synth::Real_t;
+  using ASI::Synth::FilterKernel;
+  using ASI::Synth::InitFilter;
+  using ASI::Synth::MasterFilter;
+
+  struct Kernel
+  {
+    FilterKernel kernel;
+    const char * name;
+  };
+
+  // process_2 first: it is the reference for the accuracy
+  const Kernel KERNELS[] = {
+    {FilterKernel::PROCESS_2, "process_2"},
+    {FilterKernel::PROCESS_0, "process_0"},
+    {FilterKernel::PROCESS_1, "process_1"},
+    {FilterKernel::BLOCK, "block"},
+  };
+
+  // keeps the coefficients createFilter() produces
+  class Coefficients : public InitFilter
+  {
+  public:
+    virtual void init(std::vector<Real_t> b, std::vector<Real_t> a) override
+    {
+      m_b = b;
+      m_a = a;
+    }
+
+    virtual void resetFilter() override
+    {
+      m_b.assign(1, 1.0);
+      m_a.assign(1, 1.0);
+    }
+
+    // direct form in double
+    void filter(const std::vector<Real_t> & x, std::vector<double> & y) const
+    {
+      y.resize(x.size());
+      for (size_t j = 0; j < x.size(); ++j)
+      {
+	double value = 0.0;
+	for (size_t i = 0; i < m_b.size() && i <= j; ++i)
+	{
+	  value += double(m_b[i]) * x[j - i];
+	}
+	for (size_t i = 1; i < m_a.size() && i <= j; ++i)
+	{
+	  value -= double(m_a[i]) * y[j - i];
+	}
+	y[j] = value / m_a[0];
+      }
+    }
+
+  private:
+    std::vector<Real_t> m_b;
+    std::vector<Real_t> m_a;
+  };
+
+  // std::isfinite() is folded to true by -ffast-math: look at the exponent
+  bool isFinite(const float x)
+  {
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    return (bits & 0x7f800000) != 0x7f800000;
+  }
+
+  std::string getCPUModel()
+  {
+    std::ifstream in("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(in, line))
+    {
+      if (line.compare(0, 10, "model name") == 0)
+      {
+	const size_t colon = line.find(':');
+	if (colon != std::string::npos)
+	{
+	  return line.substr(std::min(colon + 2, line.size()));
+	}
+      }
+    }
+    return "unknown";
+  }
+
+  // everything the coefficients and the timing depend on
+  std::string getKey(const ASI::Synth::IIR & iir, const size_t sampleRate, const size_t frames)
+  {
+    return getCPUModel() + "|" + std::to_string(int(iir.pass)) + "|" + std::to_string(iir.order)
+      + "|" + std::to_string(iir.lower) + "|" + std::to_string(iir.upper)
+      + "|" + std::to_string(sampleRate) + "|" + std::to_string(frames);
+  }
+
+  // lines are "key<TAB>kernel", the last one for a key wins
+  bool readCache(const std::string & cacheFile, const std::string & key, Kernel & kernel)
+  {
+    bool found = false;
+
+    std::ifstream in(cacheFile);
+    std::string line;
+    while (std::getline(in, line))
+    {
+      const size_t tab = line.rfind('\t');
+      if (tab == std::string::npos || line.substr(0, tab) != key)
+      {
+	continue;
+      }
+
+      const std::string name = line.substr(tab + 1);
+      for (const Kernel & k : KERNELS)
+      {
+	if (name == k.name)
+	{
+	  kernel = k;
+	  found = true;
+	}
+      }
+    }
+
+    return found;
+  }
+
+  void writeCache(const std::string & cacheFile, const std::string & key, const Kernel & kernel)
+  {
+    std::ofstream out(cacheFile, std::ios::app);
+    out << key << '\t' << kernel.name << std::endl;
+    if (!out)
+    {
+      std::cerr << "Synth: cannot write " << cacheFile << std::endl;
+    }
+  }
+
+  // the filtered signal, 1 call to process() every "frames"
+  void run(MasterFilter & filter, const std::vector<Real_t> & signal, const size_t frames, std::vector<Real_t> & output)
+  {
+    output = signal;
+    for (size_t i = 0; i < output.size(); i += frames)
+    {
+      filter.process(output.data() + i, std::min(frames, output.size() - i));
+    }
+  }
+
+}
+
+namespace ASI
+{
+  namespace Synth
+  {
+
+    FilterKernel tuneFilterKernel(const IIR & iir, const size_t sampleRate, const size_t frames, const std::string & cacheFile)
+    {
+      if (iir.pass == Pass::NONE || frames == 0)
+      {
+	// process() does nothing
+	return FilterKernel::AUTO;
+      }
+
+      const std::string key = getKey(iir, sampleRate, frames);
+
+      Kernel best = KERNELS[0];
+      if (!cacheFile.empty() && readCache(cacheFile, key, best))
+      {
+	std::cerr << "Synth: filter kernel " << best.name << " (cached)" << std::endl;
+	return best.kernel;
+      }
+
+      std::vector<Real_t> signal(TUNE_SAMPLES);
+      std::mt19937 generator;
+      std::uniform_real_distribution<Real_t> distribution(-1.0, 1.0);
+      std::generate(signal.begin(), signal.end(), [&generator, &distribution]() { return distribution(generator); });
+
+      Coefficients coefficients;
+      createFilter(iir.pass, iir.order, sampleRate, iir.lower, iir.upper, coefficients);
+
+      std::vector<double> reference;
+      coefficients.filter(signal, reference);
+      double largest = 0.0;
+      for (const double value : reference)
+      {
+	largest = std::max(largest, std::abs(value));
+      }
+
+      double bestTime = std::numeric_limits<double>::max();
+      double tolerance = KERNEL_EXACT;
+
+      std::vector<Real_t> output;
+      for (const Kernel & kernel : KERNELS)
+      {
+	MasterFilter filter;
+	createFilter(iir.pass, iir.order, sampleRate, iir.lower, iir.upper, filter);
+	filter.setKernel(kernel.kernel);
+
+	run(filter, signal, frames, output);
+	bool finite = true;
+	double error = 0.0;
+	for (size_t i = 0; i < output.size(); ++i)
+	{
+	  finite = finite && isFinite(output[i]);
+	  error = std::max(error, std::abs(output[i] - reference[i]));
+	}
+	error /= std::max(largest, std::numeric_limits<double>::min());
+
+	double time = std::numeric_limits<double>::max();
+	for (size_t i = 0; i < TUNE_REPEATS; ++i)
+	{
+	  filter.resetData();
+	  const auto start = std::chrono::steady_clock::now();
+	  run(filter, signal, frames, output);
+	  const auto end = std::chrono::steady_clock::now();
+	  time = std::min(time, std::chrono::duration<double, std::nano>(end - start).count() / signal.size());
+	}
+
+	if (kernel.kernel == FilterKernel::PROCESS_2 && finite)
+	{
+	  tolerance = std::max(tolerance, error * KERNEL_TOLERANCE);
+	}
+
+	// an unstable kernel overflows
+	const bool accepted = finite && error <= tolerance;
+
+	std::cerr << "Synth: filter kernel " << kernel.name << ": " << time << " ns/sample, error " << error << (accepted ? "" : " (rejected)") << std::endl;
+
+	if (accepted && time < bestTime)
+	{
+	  best = kernel;
+	  bestTime = time;
+	}
+      }
+
+      std::cerr << "Synth: using filter kernel " << best.name << " for " << frames << " frames" << std::endl;
+
+      if (!cacheFile.empty())
+      {
+	writeCache(cacheFile, key, best);
+      }
+
+      return best.kernel;
+    }
+
+  }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "handlers/synth/SynthParameters.h"
+#include "handlers/synth/Filter.h"
+
+#include <string>
+
+namespace ASI
+{
+  namespace Synth
+  {
+
+    typedef Filter<4> MasterFilter;
+
+    /*
+      Picks the fastest implementation of MasterFilter::process()
+      for a filter and the size of the blocks it will process, on this CPU.
+
+      Each kernel runs on white noise and is compared against the same filter in double:
+      the ones which are less accurate than process_2 are rejected.
+      The timings are logged, the decision is appended to "cacheFile" (if not empty)
+      and reused on the next run with the same CPU, filter, sample rate and block size.
+
+      Not real time safe: call it before the process callback starts.
+    */
+    FilterKernel tuneFilterKernel(const IIR & iir, const size_t sampleRate, const size_t frames, const std::string & cacheFile);
+
+  }
+}
@@ -10,6 +10,8 @@ namespace
   using ASI::Synth::Real_t;
   using ASI::Synth::Wave;
   using ASI::Synth::Pass;
+  using ASI::Synth::Interpolation;
+  using ASI::Synth::Stealing;
 
   Wave strToWave(const std::string & s)
   {
@@ -51,6 +53,31 @@ namespace
     throw std::runtime_error("Unknown pass type");
   }
 
+  Interpolation strToInterpolation(const std::string & s)
+  {
+    if (s == "linear")
+      return Interpolation::LINEAR;
+
+    if (s == "cubic")
+      return Interpolation::CUBIC;
+
+    throw std::runtime_error("Unknown interpolation type");
+  }
+
+  Stealing strToStealing(const std::string & s)
+  {
+    if (s == "oldest")
+      return Stealing::OLDEST;
+
+    if (s == "quietest")
+      return Stealing::QUIETEST;
+
+    if (s == "released")
+      return Stealing::RELEASED;
+
+    throw std::runtime_error("Unknown stealing policy");
+  }
+
   void readHarmonics(const json & params, std::vector<ASI::Synth::Harmonic> & harmonics)
   {
     for (const json & h : params)
@@ -66,6 +93,14 @@ namespace
     }
   }
 
+  void readIIR(const json & params, ASI::Synth::IIR & iir)
+  {
+    iir.pass = strToPass(params["type"]);
+    iir.order = params["order"];
+    iir.lower = params["lower"];
+    iir.upper = params["upper"];
+  }
+
 }
 
 namespace ASI
@@ -89,10 +124,12 @@ namespace ASI
       parameters->adsr.averageSize = inParams["adsr"]["lowpass"];
 
       parameters->poliphony = inParams["poliphony"];
+      parameters->stealing = strToStealing(inParams.value("stealing", "released"));
       parameters->volume = inParams["volume"];
       parameters->velocityPower = inParams["velocity"];
 
       parameters->sampleDepth = inParams["depth"];
+      parameters->interpolation = strToInterpolation(inParams.value("interpolation", "linear"));
 
       readHarmonics(inParams["harmonics"], parameters->harmonics);
 
@@ -104,10 +141,13 @@ namespace ASI
       parameters->tremolo.amplitude = inParams["lfo"]["tremolo"]["amplitude"];
       readHarmonics(inParams["lfo"]["tremolo"]["harmonics"], parameters->tremolo.harmonics);
 
-      parameters->iir.pass = strToPass(inParams["filter"]["type"]);
-      parameters->iir.order = inParams["filter"]["order"];
-      parameters->iir.lower = inParams["filter"]["lower"];
-      parameters->iir.upper = inParams["filter"]["upper"];
+      readIIR(inParams["filter"], parameters->iir);
+
+      parameters->master = {Pass::NONE, 0, 0.0, 0.0};
+      if (inParams.count("master"))
+      {
+	readIIR(inParams["master"], parameters->master);
+      }
 
       return parameters;
     }
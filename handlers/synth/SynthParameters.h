@@ -28,6 +28,20 @@ namespace ASI
 	BANDSTOP
 	};
 
+    enum class Interpolation
+    {
+      LINEAR,
+	CUBIC
+	};
+
+    // which voice is taken when they are all playing
+    enum class Stealing
+    {
+      OLDEST,
+	QUIETEST,
+	RELEASED                // the oldest released one (or the oldest)
+	};
+
     struct Harmonic
     {
       size_t mult;
@@ -64,6 +78,7 @@ namespace ASI
     struct Parameters
     {
       size_t poliphony;
+      Stealing stealing;
       Real_t volume;          // note volume
       Real_t velocityPower;   // velocity ^ power * volume
 
@@ -71,9 +86,11 @@ namespace ASI
       LFO vibrato;
       LFO tremolo;
 
-      IIR iir;
+      IIR iir;                // of each note
+      IIR master;             // of the mix (direct form)
 
-      size_t sampleDepth;
+      size_t sampleDepth;                // largest wavetable: 2 ^ depth
+      Interpolation interpolation;
 
       std::vector<Harmonic> harmonics;
     };
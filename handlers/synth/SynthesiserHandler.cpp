@@ -9,6 +9,29 @@
 #include <iomanip>
 #include <random>
 #include <iostream>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+
+#include <sys/stat.h>
+
+// how often the parameters file is checked for changes
+#define WATCH_INTERVAL_MS 500
+
+// frames of a group of voices rendered before filtering them
+#define RENDER_CHUNK 64
+
+// LFO tables: 2 ^ LFO_DEPTH points
+#define LFO_DEPTH 12
+
+// sections in a voice filter (order of a bandpass)
+#define MAX_FILTER_SECTIONS 16
+
+// seconds for a stolen voice to fade from the peak
+#define STEAL_FADE 0.005
+
+// below this, a note in OFF is silent
+#define SILENCE 0.00000001
 
 namespace
 {
@@ -53,6 +76,42 @@ namespace
     }
   }
 
+  // samples which can be rendered before a segment of the ADSR can end
+  // (the comparisons in renderVoices() decide the exact one)
+  size_t segmentLength(const Real_t current, const Real_t step, const Real_t limit, const Real_t direction,
+		       const Real_t amplitude, const Real_t silence, const Real_t logSmoothKeep, const size_t maximum)
+  {
+    // no infinities nor NaNs: -ffast-math assumes there are none
+    // each bound has 1 sample of margin for the rounding
+    double length = maximum;
+
+    // linear: current + k * step reaches limit
+    // (OFF and EMPTY have no limit, their step is 0)
+    const double distance = direction * (double(limit) - current);
+    const double progress = direction * step;
+    if (distance <= 0.0)
+    {
+      return 0;
+    }
+    if (progress > 0.0)
+    {
+      length = std::min(length, std::floor(distance / progress) - 1.0);
+    }
+
+    // exponential (OFF only, current is 0): amplitude * keep^k gets below silence
+    if (silence > 0.0)
+    {
+      if (amplitude <= silence || logSmoothKeep >= 0.0)
+      {
+	// already there, or no smoothing (keep = 0): the next sample
+	return 0;
+      }
+      length = std::min(length, std::floor(std::log(double(silence) / amplitude) / logSmoothKeep) - 1.0);
+    }
+
+    return length > 0.0 ? size_t(length) : 0;
+  }
+
   void generateSample(const size_t size, const std::vector<ASI::Synth::Harmonic> & harmonics, std::vector<Real_t> & samples)
   {
     samples.resize(size + 1);
@@ -85,12 +144,28 @@ namespace
     samples.back() = samples.front();
   }
 
-  Real_t interpolateSample(const size_t size, const std::vector<Real_t> & samples, const Real_t x)
+  timespec getModificationTime(const std::string & filename)
   {
+    struct stat buffer;
+    if (stat(filename.c_str(), &buffer))
+    {
+      // missing (e.g. while being replaced): keep the previous one
+      return timespec();
+    }
+    return buffer.st_mtim;
+  }
+
+  Real_t interpolateSample(const Real_t size, const std::vector<Real_t> & samples, const Real_t x)
+  {
+    // generateSample() adds a guard point
     const Real_t fx = x - size_t(x);
-    const size_t pos = size_t(fx * size);
-    const Real_t w = samples[pos];
-    return w;
+    const Real_t position = std::min<Real_t>(fx * size, size - 1);
+    return ASI::Synth::interpolate<ASI::Synth::Interpolation::LINEAR>(samples.data(), position);
+  }
+
+  Real_t noteFrequency(const int n)
+  {
+    return std::pow(2.0, (n - 69) / 12.0) * 440.0;
   }
 
 }
@@ -100,61 +175,342 @@ namespace ASI
 
   namespace Synth
   {
-    SynthesiserHandler::SynthesiserHandler(const std::shared_ptr<CommonControls> & common, const std::string & parametersFile)
-      : InputOutputHandler(common), m_parametersFile(parametersFile)
+    SynthesiserHandler::SynthesiserHandler(const std::shared_ptr<CommonControls> & common, const std::string & parametersFile, const bool watch, const std::string & kernelCache, const size_t threads)
+      : InputOutputHandler(common), m_parametersFile(parametersFile), m_kernelCache(kernelCache), m_next(nullptr), m_retired(nullptr), m_steals(0), m_dropped(0), m_quit(false)
     {
-      m_inputPort = m_common->registerPort("synth_in", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput);
-      m_outputPort = m_common->registerPort("synth_out", JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput);
+      m_inputPort = m_common->registerMidiPort("synth_in", JackPortIsInput);
+      m_audioPort = m_common->registerPort("synth_out", JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput);
 
-      m_parameters = loadSynthParameters(m_parametersFile);
+      m_snapshot = createSnapshot(loadSynthParameters(m_parametersFile));
 
-      initialise();
+      initialise(threads);
+
+      if (watch)
+      {
+	m_watcher = std::thread(&SynthesiserHandler::watch, this);
+      }
     }
 
-    void SynthesiserHandler::initialise()
+    SynthesiserHandler::~SynthesiserHandler()
     {
-      m_work.time = 0;
-      m_work.sustain = false;
+      stopWatching();
+      m_workers.stop();
 
-      m_work.notes.resize(m_parameters->poliphony);
-      for (Note & note : m_work.notes)
-      {
-	note.status = EMPTY;
-      }
+      std::cerr << "Synth: poliphony high water " << m_work.allocator.getHighWater() << " / " << m_work.poliphony;
+      std::cerr << ", " << m_steals.load() << " voices stolen, " << m_dropped.load() << " notes dropped" << std::endl;
+
+      delete m_snapshot;
+      delete m_next.load();
+      delete m_retired.load();
+    }
+
+    SynthesiserHandler::Snapshot * SynthesiserHandler::createSnapshot(const std::shared_ptr<const Parameters> & parameters) const
+    {
+      std::unique_ptr<Snapshot> snapshot(new Snapshot);
+      snapshot->parameters = parameters;
 
-      m_work.interpolationMultiplier = 1 << m_parameters->sampleDepth;
+      snapshot->lfoSize = 1 << LFO_DEPTH;
 
-      generateSample(m_work.interpolationMultiplier, m_parameters->harmonics, m_work.samples);
-      generateSample(m_work.interpolationMultiplier, m_parameters->vibrato.harmonics, m_work.vibratoSamples);
-      generateSample(m_work.interpolationMultiplier, m_parameters->tremolo.harmonics, m_work.tremoloSamples);
+      generateSample(snapshot->lfoSize, parameters->vibrato.harmonics, snapshot->vibratoSamples);
+      generateSample(snapshot->lfoSize, parameters->tremolo.harmonics, snapshot->tremoloSamples);
 
       // adjust vibrato sample to include amplitude multiplier
       // the amplitude in the configuration file is in Number of Semitones
-      const Real_t vibratoAmplitude = m_parameters->vibrato.amplitude * log(2.0) / 12.0;
-      for (Real_t & value : m_work.vibratoSamples)
+      const Real_t vibratoAmplitude = parameters->vibrato.amplitude * log(2.0) / 12.0;
+      for (Real_t & value : snapshot->vibratoSamples)
       {
 	value = exp(value * vibratoAmplitude);
       }
+      const auto vibratoRange = std::minmax_element(snapshot->vibratoSamples.begin(), snapshot->vibratoSamples.end());
+      snapshot->maxVibrato = *vibratoRange.second;
+
+      // the lowest level must cover MIDI note 0, with the lowest vibrato
+      std::vector<Real_t> period;
+      generateSample(1 << parameters->sampleDepth, parameters->harmonics, period);
+      snapshot->wavetable.build(period, noteFrequency(0) * *vibratoRange.first / m_sampleRate);
 
       // adjust tremolo sample to include amplitude multiplier and offset to 1
-      for (Real_t & value : m_work.tremoloSamples)
+      for (Real_t & value : snapshot->tremoloSamples)
+      {
+	value = 1.0 + value * parameters->tremolo.amplitude;
+      }
+
+      snapshot->attackDelta = parameters->adsr.peak / parameters->adsr.attackTime / m_sampleRate;
+      snapshot->decayDelta = (parameters->adsr.peak - 1.0) / parameters->adsr.decayTime / m_sampleRate;
+      snapshot->sustainDelta = 1.0 / parameters->adsr.sustainTime / m_sampleRate;
+      snapshot->releaseDelta = 1.0 / parameters->adsr.releaseTime / m_sampleRate;
+      snapshot->stealDelta = parameters->adsr.peak / STEAL_FADE / m_sampleRate;
+      snapshot->timeMultiplier = 1.0 / m_sampleRate;
+
+      snapshot->filters.build(parameters->iir, m_sampleRate, MAX_FILTER_SECTIONS);
+
+      // amplitude = amplitude * smoothKeep + current * smoothTake
+      const Real_t averageSize = parameters->adsr.averageSize;
+      snapshot->smoothKeep = averageSize / (averageSize + 1.0);
+      snapshot->smoothTake = 1.0 / (averageSize + 1.0);
+      // 0 if there is no smoothing (log(0) is not finite)
+      snapshot->logSmoothKeep = snapshot->smoothKeep > 0.0 ? std::log(snapshot->smoothKeep) : 0.0;
+
+      return snapshot.release();
+    }
+
+    void SynthesiserHandler::initialise(const size_t threads)
+    {
+      m_work.time = 0;
+      m_work.sampleRate = m_sampleRate;
+      m_work.sustain = false;
+
+      m_work.actualReleaseDelta = m_work.sustain ? m_snapshot->sustainDelta : m_snapshot->releaseDelta;
+
+      // the number of voices cannot change on reload
+      m_work.poliphony = m_snapshot->parameters->poliphony;
+      const size_t numberOfVoices = (m_work.poliphony + VOICE_LANES - 1) / VOICE_LANES * VOICE_LANES;
+
+      Voices & voices = m_work.voices;
+      voices.n.assign(numberOfVoices, 0);
+      voices.t0.assign(numberOfVoices, 0);
+      voices.status.assign(numberOfVoices, EMPTY);
+      voices.frequency.assign(numberOfVoices, 0.0);
+      voices.phase.assign(numberOfVoices, 0.0);
+      voices.volume.assign(numberOfVoices, 0.0);
+      voices.current.assign(numberOfVoices, 0.0);
+      voices.amplitude.assign(numberOfVoices, 0.0);
+      voices.table.resize(numberOfVoices);
+      voices.tableSize.resize(numberOfVoices);
+      voices.step.resize(numberOfVoices);
+      voices.limit.resize(numberOfVoices);
+      voices.direction.resize(numberOfVoices);
+      voices.silence.resize(numberOfVoices);
+      voices.pendingNote.assign(numberOfVoices, 0);
+      voices.pendingVelocity.assign(numberOfVoices, 0);
+
+      // the padding is never allocated
+      m_work.allocator.initialise(m_work.poliphony, VOICE_LANES);
+
+      updateSegments();
+      updateTables();
+
+      m_work.filters.resize(numberOfVoices / VOICE_LANES);
+      for (FilterBank<VOICE_LANES> & bank : m_work.filters)
       {
-	value = 1.0 + value * m_parameters->tremolo.amplitude;
+	bank.initialise(MAX_FILTER_SECTIONS);
+	bank.setNumberOfSections(m_snapshot->filters.getNumberOfSections());
       }
 
+      // the master filter cannot change on reload either
+      m_work.master = m_snapshot->parameters->master;
+      const IIR & master = m_work.master;
+      createFilter(master.pass, master.order, m_sampleRate, master.lower, master.upper, m_work.filter);
+      const jack_nframes_t bufferSize = jack_get_buffer_size(m_common->getClient());
+      m_work.filter.setKernel(tuneFilterKernel(master, m_sampleRate, bufferSize, m_kernelCache));
+
       // so we do not allocate during "process callback"
-      m_work.buffer.resize(8192);
       m_work.vibratoBuffer.resize(8192);
+      m_work.buffers.resize(std::max<size_t>(threads, 1));
+      for (Workspace::Buffers & buffers : m_work.buffers)
+      {
+	buffers.voices.resize(RENDER_CHUNK * VOICE_LANES);
+	buffers.output.resize(8192);
+      }
+
+      // same scheduling as the process callback, or no workers at all
+      if (!m_workers.start(m_common->getClient(), m_work.buffers.size()))
+      {
+	std::cerr << "Synth: cannot create the worker threads, rendering on the process callback only" << std::endl;
+      }
+    }
+
+    void SynthesiserHandler::setStatus(const size_t voice, const Status status)
+    {
+      Voices & voices = m_work.voices;
+      const Snapshot & snapshot = *m_snapshot;
+
+      voices.status[voice] = status;
+
+      // current += step, until current reaches limit
+      // finite "never" values: the comparisons in renderVoices() must work with -ffast-math
+      const Real_t never = std::numeric_limits<Real_t>::max();
+      Real_t step = 0.0;
+      Real_t limit = never;
+      Real_t direction = -1.0;
+      Real_t silence = -never;
+
+      switch (status)
+      {
+      case ATTACK:
+	step = snapshot.attackDelta;
+	limit = snapshot.parameters->adsr.peak;
+	direction = 1.0;
+	break;
+      case DECAY:
+	step = -snapshot.decayDelta;
+	limit = 1.0;
+	break;
+      case SUSTAIN:
+	step = -snapshot.sustainDelta;
+	limit = 0.0;
+	break;
+      case RELEASE:
+	// same as SUSTAIN if the pedal is down
+	step = -m_work.actualReleaseDelta;
+	limit = 0.0;
+	break;
+      case FORCE_RELEASE:
+	// same as RELEASE but the pedal is ignored
+	step = -snapshot.releaseDelta;
+	limit = 0.0;
+	break;
+      case STOLEN:
+	step = -snapshot.stealDelta;
+	limit = 0.0;
+	break;
+      case OFF:
+	// linear ADSR = 0, wait for the smooth one
+	direction = 1.0;
+	silence = SILENCE;
+	break;
+      case EMPTY:
+	direction = 1.0;
+	break;
+      }
+
+      voices.step[voice] = step;
+      voices.limit[voice] = limit;
+      voices.direction[voice] = direction;
+      voices.silence[voice] = silence;
+    }
 
-      m_work.attackDelta = m_parameters->adsr.peak / m_parameters->adsr.attackTime / m_sampleRate;
-      m_work.decayDelta = (m_parameters->adsr.peak - 1.0) / m_parameters->adsr.decayTime / m_sampleRate;
-      m_work.sustainDelta = 1.0 / m_parameters->adsr.sustainTime / m_sampleRate;
-      m_work.releaseDelta = 1.0 / m_parameters->adsr.releaseTime / m_sampleRate;
-      m_work.actualReleaseDelta = m_work.sustain ? m_work.sustainDelta : m_work.releaseDelta;
-      m_work.timeMultiplier = 1.0 / m_sampleRate;
+    void SynthesiserHandler::updateSegments()
+    {
+      // after a change of the deltas (new parameters or the pedal)
+      const std::vector<Status> & status = m_work.voices.status;
+      for (size_t i = 0; i < status.size(); ++i)
+      {
+	setStatus(i, status[i]);
+      }
+    }
+
+    void SynthesiserHandler::setTable(const size_t voice)
+    {
+      // the highest frequency the vibrato can take the note to
+      const Real_t frequency = m_work.voices.frequency[voice] * m_snapshot->maxVibrato * m_snapshot->timeMultiplier;
+      const Wavetable::Level & level = m_snapshot->wavetable.getLevel(frequency);
+      m_work.voices.table[voice] = level.offset;
+      m_work.voices.tableSize[voice] = level.size;
+    }
+
+    void SynthesiserHandler::updateTables()
+    {
+      // after a new wavetable
+      for (size_t i = 0; i < m_work.voices.table.size(); ++i)
+      {
+	setTable(i);
+      }
+    }
+
+    void SynthesiserHandler::updateFilters()
+    {
+      // new notes get the new filters, unless the number of sections changes
+      const IIRTable & filters = m_snapshot->filters;
+      const size_t sections = filters.getNumberOfSections();
+      for (size_t group = 0; group < m_work.filters.size(); ++group)
+      {
+	FilterBank<VOICE_LANES> & bank = m_work.filters[group];
+	if (bank.getNumberOfSections() != sections)
+	{
+	  // within the capacity: no allocation
+	  bank.setNumberOfSections(sections);
+	  for (size_t j = 0; j < VOICE_LANES; ++j)
+	  {
+	    const size_t voice = group * VOICE_LANES + j;
+	    if (m_work.voices.status[voice] != EMPTY)
+	    {
+	      bank.load(j, filters.getSections(m_work.voices.n[voice]));
+	    }
+	  }
+	}
+      }
+    }
+
+    void SynthesiserHandler::swapSnapshot()
+    {
+      // wait free: 2 atomic operations
+      // if the watcher has not deleted the previous one yet, try again next cycle
+      if (m_retired.load(std::memory_order_acquire))
+      {
+	return;
+      }
+
+      const Snapshot * next = m_next.exchange(nullptr, std::memory_order_acq_rel);
+      if (next)
+      {
+	m_retired.store(m_snapshot, std::memory_order_release);
+	m_snapshot = next;
+	m_work.actualReleaseDelta = m_work.sustain ? m_snapshot->sustainDelta : m_snapshot->releaseDelta;
+	updateSegments();
+	updateTables();
+	updateFilters();
+      }
+    }
+
+    void SynthesiserHandler::watch()
+    {
+      timespec modified = getModificationTime(m_parametersFile);
+
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while (!m_quit)
+      {
+	m_condition.wait_for(lock, std::chrono::milliseconds(WATCH_INTERVAL_MS));
+
+	delete m_retired.exchange(nullptr, std::memory_order_acq_rel);
+
+	const timespec current = getModificationTime(m_parametersFile);
+	if (current.tv_sec == modified.tv_sec && current.tv_nsec == modified.tv_nsec)
+	{
+	  continue;
+	}
+	modified = current;
+
+	try
+	{
+	  const std::shared_ptr<const Parameters> parameters = loadSynthParameters(m_parametersFile);
+	  if (parameters->poliphony != m_work.poliphony)
+	  {
+	    std::cerr << "Synth: poliphony changes need a restart, using " << m_work.poliphony << std::endl;
+	  }
+	  const IIR & master = m_work.master;
+	  const IIR & next = parameters->master;
+	  if (next.pass != master.pass || next.order != master.order || next.lower != master.lower || next.upper != master.upper)
+	  {
+	    std::cerr << "Synth: master filter changes need a restart" << std::endl;
+	  }
+
+	  // if process() has not taken the previous one, it is ours to delete
+	  delete m_next.exchange(createSnapshot(parameters), std::memory_order_acq_rel);
+	  std::cerr << "Synth: reloaded " << m_parametersFile << std::endl;
+	}
+	catch (const std::exception & e)
+	{
+	  // keep playing with the old parameters
+	  std::cerr << "Synth: cannot reload " << m_parametersFile << ": " << e.what() << std::endl;
+	}
+      }
     }
 
-    void SynthesiserHandler::processMIDIEvent(const jack_nframes_t eventCount, const jack_nframes_t localTime, const jack_nframes_t absTime, void * portBuf, jack_nframes_t & eventIndex, jack_midi_event_t & event)
+    void SynthesiserHandler::stopWatching()
+    {
+      if (m_watcher.joinable())
+      {
+	{
+	  std::lock_guard<std::mutex> lock(m_mutex);
+	  m_quit = true;
+	}
+	m_condition.notify_one();
+	m_watcher.join();
+      }
+    }
+
+    void SynthesiserHandler::processMIDIEvent(const jack_nframes_t eventCount, const jack_nframes_t localTime, const jack_nframes_t absTime, const MidiPortBuffer & portBuf, jack_nframes_t & eventIndex, jack_midi_event_t & event)
     {
       while (eventIndex < eventCount && event.time == localTime)
       {
@@ -198,7 +554,8 @@ namespace ASI
 		// RELEASE behaves the same as SUSTAIN
 		// we could work on the status
 		// but this uses less "if"
-		m_work.actualReleaseDelta = m_work.sustain ? m_work.sustainDelta : m_work.releaseDelta;
+		m_work.actualReleaseDelta = m_work.sustain ? m_snapshot->sustainDelta : m_snapshot->releaseDelta;
+		updateSegments();
 
 		break;
 	      }
@@ -210,135 +567,271 @@ namespace ASI
 	++eventIndex;
 	if (eventIndex < eventCount)
 	{
-	  jack_midi_event_get(&event, portBuf, eventIndex);
+	  portBuf.getEvent(&event, eventIndex);
 	}
       }
 
     }
 
-    void SynthesiserHandler::processNote(const jack_nframes_t nframes, Note & note, jack_default_audio_sample_t * output)
+    template <Interpolation interpolation>
+      void SynthesiserHandler::renderVoices(const size_t first, const jack_nframes_t offset, const jack_nframes_t nframes, Real_t * output)
     {
-      if (note.status == EMPTY)
+      Voices & voices = m_work.voices;
+      const Snapshot & snapshot = *m_snapshot;
+
+      // local copies: no aliasing, the compiler keeps them in registers
+      Real_t phase[VOICE_LANES];
+      Real_t frequency[VOICE_LANES];
+      Real_t volume[VOICE_LANES];
+      Real_t current[VOICE_LANES];
+      Real_t amplitude[VOICE_LANES];
+      Real_t step[VOICE_LANES];
+      Real_t limit[VOICE_LANES];
+      Real_t direction[VOICE_LANES];
+      Real_t silence[VOICE_LANES];
+
+      std::copy_n(voices.phase.begin() + first, VOICE_LANES, phase);
+      std::copy_n(voices.frequency.begin() + first, VOICE_LANES, frequency);
+      std::copy_n(voices.volume.begin() + first, VOICE_LANES, volume);
+      std::copy_n(voices.current.begin() + first, VOICE_LANES, current);
+      std::copy_n(voices.amplitude.begin() + first, VOICE_LANES, amplitude);
+      std::copy_n(voices.step.begin() + first, VOICE_LANES, step);
+      std::copy_n(voices.limit.begin() + first, VOICE_LANES, limit);
+      std::copy_n(voices.direction.begin() + first, VOICE_LANES, direction);
+      std::copy_n(voices.silence.begin() + first, VOICE_LANES, silence);
+
+      // this is a low pass filter to smooth the ADSR
+      const Real_t keep = snapshot.smoothKeep;
+      const Real_t take = snapshot.smoothTake;
+      const Real_t timeMultiplier = snapshot.timeMultiplier;
+      const Real_t * samples = snapshot.wavetable.data();
+      const int32_t * table = voices.table.data() + first;
+      const Real_t * tableSize = voices.tableSize.data() + first;
+      const Real_t * vibrato = m_work.vibratoBuffer.data() + offset;
+
+      for (size_t i = 0; i < nframes; )
       {
-	return;
-      }
+	// the longest run where no voice changes segment
+	size_t run = nframes - i;
+	for (size_t j = 0; j < VOICE_LANES; ++j)
+	{
+	  run = segmentLength(current[j], step[j], limit[j], direction[j], amplitude[j], silence[j], snapshot.logSmoothKeep, run);
+	}
 
-      for (size_t i = 0; i < nframes; ++i)
-      {
-	switch (note.status)
+	if (run > 0)
 	{
-	case ATTACK:
+	  // whole ramps, no state machine
+	  for (size_t k = 0; k < run; ++k)
 	  {
-	    note.current += m_work.attackDelta;
-	    if (note.current >= m_parameters->adsr.peak)
+	    const Real_t vibratoStep = timeMultiplier * vibrato[i + k];
+	    const Real_t elapsed = k + 1;
+	    Real_t * out = output + (i + k) * VOICE_LANES;
+	    Real_t position[VOICE_LANES];
+	    Real_t w[VOICE_LANES];
+	    for (size_t j = 0; j < VOICE_LANES; ++j)
 	    {
-	      note.current = m_parameters->adsr.peak;
-	      note.status = DECAY;
-	    }
-	    break;
-	  }
-	case DECAY:
-	  {
-	    note.current -= m_work.decayDelta;
-	    if (note.current <= 1.0)
-	    {
-	      note.current = 1.0;
-	      note.status = SUSTAIN;
+	      amplitude[j] = amplitude[j] * keep + (current[j] + elapsed * step[j]) * take;
+
+	      // the phase is in [0, 1)
+	      position[j] = phase[j] * tableSize[j];
 	    }
-	    break;
-	  }
-	case SUSTAIN:
-	  {
-	    note.current -= m_work.sustainDelta;
-	    if (note.current <= 0.0)
+
+	    interpolateLanes<interpolation, VOICE_LANES>(samples, table, position, w);
+
+	    for (size_t j = 0; j < VOICE_LANES; ++j)
 	    {
-	      note.current = 0.0;
-	      note.status = OFF;
+	      out[j] = w[j] * amplitude[j] * volume[j];
+
+	      phase[j] = phase[j] + frequency[j] * vibratoStep;
+	      phase[j] -= phase[j] >= 1.0 ? 1.0 : 0.0;
 	    }
-	    break;
 	  }
-	case RELEASE:
+
+	  const Real_t elapsed = run;
+	  for (size_t j = 0; j < VOICE_LANES; ++j)
 	  {
-	    // same as SUSTAIN if the pedal is down
-	    note.current -= m_work.actualReleaseDelta;
-	    if (note.current <= 0.0)
-	    {
-	      note.current = 0.0;
-	      note.status = OFF;
-	    }
-	    break;
+	    current[j] += elapsed * step[j];
 	  }
-	case FORCE_RELEASE:
+
+	  i += run;
+	  continue;
+	}
+
+	// a segment might end at this sample: check all the voices
+	bool emptied[VOICE_LANES] = {false};
+
+	for (size_t j = 0; j < VOICE_LANES; ++j)
+	{
+	  const size_t voice = first + j;
+	  current[j] += step[j];
+	  if (direction[j] * current[j] >= direction[j] * limit[j])
 	  {
-	    // same as RELEASE but the pedal is ignored
-	    note.current -= m_work.releaseDelta;
-	    if (note.current <= 0.0)
+	    current[j] = limit[j];
+	    switch (voices.status[voice])
 	    {
-	      note.current = 0.0;
-	      note.status = OFF;
+	    case ATTACK:
+	      setStatus(voice, DECAY);
+	      break;
+	    case DECAY:
+	      setStatus(voice, SUSTAIN);
+	      break;
+	    default:
+	      setStatus(voice, OFF);
+	      break;
 	    }
-	    break;
 	  }
-	case OFF:
+	  else if (amplitude[j] <= silence[j])
 	  {
-	    if (note.amplitude <= 0.00000001)
-	    {
-	      note.status = EMPTY;
-	    }
-	    break;
+	    // OFF -> EMPTY: the note still plays this sample
+	    setStatus(voice, EMPTY);
+	    emptied[j] = true;
 	  }
-	case EMPTY:
+	  else
 	  {
-	    m_work.buffer[i] = 0.0;
 	    continue;
 	  }
-	};
 
-	// this is a low pass filter to smooth the ADSR
-	// is it needed?
-	note.amplitude = (note.amplitude * m_parameters->adsr.averageSize + note.current) / (m_parameters->adsr.averageSize + 1.0);
+	  step[j] = voices.step[voice];
+	  limit[j] = voices.limit[voice];
+	  direction[j] = voices.direction[voice];
+	  silence[j] = voices.silence[voice];
+	}
+
+	Real_t * out = output + i * VOICE_LANES;
+	Real_t position[VOICE_LANES];
+	Real_t w[VOICE_LANES];
+	for (size_t j = 0; j < VOICE_LANES; ++j)
+	{
+	  amplitude[j] = amplitude[j] * keep + current[j] * take;
+	  position[j] = phase[j] * tableSize[j];
+	}
 
-	const Real_t w = interpolateSample(m_work.interpolationMultiplier, m_work.samples, note.phase);
-	const Real_t value = w * note.amplitude * note.volume;
-	m_work.buffer[i] = value;
+	interpolateLanes<interpolation, VOICE_LANES>(samples, table, position, w);
 
-	const Real_t deltaPhase = note.frequency * m_work.timeMultiplier * m_work.vibratoBuffer[i];
-	note.phase = note.phase + deltaPhase;
-	if (note.phase >= 1.0)
+	for (size_t j = 0; j < VOICE_LANES; ++j)
 	{
-	  note.phase -= 1.0;
+	  out[j] = w[j] * amplitude[j] * volume[j];
+
+	  phase[j] = phase[j] + frequency[j] * timeMultiplier * vibrato[i];
+	  phase[j] -= phase[j] >= 1.0 ? 1.0 : 0.0;
+
+	  volume[j] = emptied[j] ? 0.0 : volume[j];
 	}
+
+	++i;
       }
 
-      note.filter.process(m_work.buffer.data(), nframes);
+      std::copy_n(phase, VOICE_LANES, voices.phase.begin() + first);
+      std::copy_n(volume, VOICE_LANES, voices.volume.begin() + first);
+      std::copy_n(current, VOICE_LANES, voices.current.begin() + first);
+      std::copy_n(amplitude, VOICE_LANES, voices.amplitude.begin() + first);
+    }
 
-      for (size_t i = 0; i < nframes; ++i)
+    void SynthesiserHandler::processVoices(const size_t first, const jack_nframes_t nframes, Real_t * buffer, jack_default_audio_sample_t * output)
+    {
+      for (jack_nframes_t offset = 0; offset < nframes; offset += RENDER_CHUNK)
       {
-	output[i] += m_work.buffer[i];
+	// EMPTY voices are filtered, but not added
+	bool playing[VOICE_LANES];
+	for (size_t j = 0; j < VOICE_LANES; ++j)
+	{
+	  playing[j] = m_work.voices.status[first + j] != EMPTY;
+	}
+
+	const jack_nframes_t chunk = std::min<jack_nframes_t>(RENDER_CHUNK, nframes - offset);
+	switch (m_snapshot->parameters->interpolation)
+	{
+	case Interpolation::LINEAR:
+	  renderVoices<Interpolation::LINEAR>(first, offset, chunk, buffer);
+	  break;
+	case Interpolation::CUBIC:
+	  renderVoices<Interpolation::CUBIC>(first, offset, chunk, buffer);
+	  break;
+	}
+
+	m_work.filters[first / VOICE_LANES].process(buffer, chunk);
+
+	for (size_t i = 0; i < chunk; ++i)
+	{
+	  const Real_t * frame = buffer + i * VOICE_LANES;
+	  Real_t total = 0.0;
+	  for (size_t j = 0; j < VOICE_LANES; ++j)
+	  {
+	    total += playing[j] ? frame[j] : 0.0;
+	  }
+	  output[offset + i] += total;
+	}
+
+	// the pending notes of stolen voices start at the end of the chunk
+	// the others are released by releaseVoices()
+	for (size_t j = 0; j < VOICE_LANES; ++j)
+	{
+	  const size_t voice = first + j;
+	  if (playing[j] && m_work.voices.status[voice] == EMPTY)
+	  {
+	    startPending(voice, m_work.time + offset + chunk);
+	  }
+	}
       }
     }
 
+    void SynthesiserHandler::renderGroup(void * context, const size_t worker, const size_t item)
+    {
+      // a group only touches its own voices and filters
+      SynthesiserHandler * handler = static_cast<SynthesiserHandler *>(context);
+      Workspace & work = handler->m_work;
+      Workspace::Buffers & buffers = work.buffers[worker];
+
+      const size_t group = work.allocator.getActiveGroups()[item];
+      handler->processVoices(group * VOICE_LANES, work.frames, buffers.voices.data(), buffers.output.data());
+    }
+
     void SynthesiserHandler::processNotes(const jack_nframes_t nframes, jack_default_audio_sample_t * output)
     {
       for (size_t i = 0; i < nframes; ++i)
       {
 	const jack_nframes_t absTime = m_work.time + i;
-	const Real_t phaseOfLFOVibrato = absTime * m_parameters->vibrato.frequency * m_work.timeMultiplier;
-	const Real_t coeffOfLFOVibrato = interpolateSample(m_work.interpolationMultiplier, m_work.vibratoSamples, phaseOfLFOVibrato);
+	const Real_t phaseOfLFOVibrato = absTime * m_snapshot->parameters->vibrato.frequency * m_snapshot->timeMultiplier;
+	const Real_t coeffOfLFOVibrato = interpolateSample(m_snapshot->lfoSize, m_snapshot->vibratoSamples, phaseOfLFOVibrato);
 
 	m_work.vibratoBuffer[i] = coeffOfLFOVibrato;
       }
 
-      for (Note & note : m_work.notes)
+      // waking the workers is only worth it for a whole chunk
+      const std::vector<size_t> & groups = m_work.allocator.getActiveGroups();
+      if (m_workers.getNumberOfWorkers() > 1 && groups.size() > 1 && nframes >= RENDER_CHUNK)
       {
-	processNote(nframes, note, output);
+	m_work.frames = nframes;
+	for (Workspace::Buffers & buffers : m_work.buffers)
+	{
+	  std::fill_n(buffers.output.begin(), nframes, 0.0);
+	}
+
+	m_workers.run(groups.size(), &SynthesiserHandler::renderGroup, this);
+
+	for (const Workspace::Buffers & buffers : m_work.buffers)
+	{
+	  for (size_t i = 0; i < nframes; ++i)
+	  {
+	    output[i] += buffers.output[i];
+	  }
+	}
+      }
+      else
+      {
+	for (const size_t group : groups)
+	{
+	  processVoices(group * VOICE_LANES, nframes, m_work.buffers[0].voices.data(), output);
+	}
       }
 
+      releaseVoices();
+
       for (size_t i = 0; i < nframes; ++i)
       {
 	const jack_nframes_t absTime = m_work.time + i;
-	const Real_t phaseOfLFOTremolo = absTime * m_parameters->tremolo.frequency * m_work.timeMultiplier;
-	const Real_t coeffOfLFOTremolo = interpolateSample(m_work.interpolationMultiplier, m_work.tremoloSamples, phaseOfLFOTremolo);
+	const Real_t phaseOfLFOTremolo = absTime * m_snapshot->parameters->tremolo.frequency * m_snapshot->timeMultiplier;
+	const Real_t coeffOfLFOTremolo = interpolateSample(m_snapshot->lfoSize, m_snapshot->tremoloSamples, phaseOfLFOTremolo);
 
 	output[i] *= coeffOfLFOTremolo;
       }
@@ -348,21 +841,23 @@ namespace ASI
 
     void SynthesiserHandler::process(const jack_nframes_t nframes)
     {
-      void* inPortBuf = jack_port_get_buffer(m_inputPort, nframes);
+      swapSnapshot();
+
+      const MidiPortBuffer inPortBuf = m_inputPort->getBuffer(nframes);
 
       // this is Real_t
-      jack_default_audio_sample_t* output = (jack_default_audio_sample_t *)jack_port_get_buffer(m_outputPort, nframes);
+      jack_default_audio_sample_t* output = (jack_default_audio_sample_t *)jack_port_get_buffer(m_audioPort, nframes);
 
       memset(output, 0, sizeof(jack_default_audio_sample_t) * nframes);
 
-      jack_nframes_t eventCount = jack_midi_get_event_count(inPortBuf);
+      jack_nframes_t eventCount = inPortBuf.getEventCount();
 
       jack_nframes_t eventIndex = 0;
 
       jack_midi_event_t inEvent;
       if (eventIndex < eventCount)
       {
-	jack_midi_event_get(&inEvent, inPortBuf, eventIndex);
+	inPortBuf.getEvent(&inEvent, eventIndex);
       }
 
       jack_nframes_t position = 0;
@@ -377,8 +872,12 @@ namespace ASI
 	{
 	  toProcess = nframes - position;
 	}
-	processNotes(toProcess, output + position);
-	position += toProcess;
+	// events at the same time (e.g. a chord) leave nothing to render
+	if (toProcess > 0)
+	{
+	  processNotes(toProcess, output + position);
+	  position += toProcess;
+	}
 	processMIDIEvent(eventCount, position, m_work.time, inPortBuf, eventIndex, inEvent);
       }
 
@@ -387,77 +886,205 @@ namespace ASI
 
     void SynthesiserHandler::shutdown()
     {
+      stopWatching();
+      m_workers.stop();
     }
 
-    void SynthesiserHandler::noteOn(const jack_nframes_t time, const jack_midi_data_t n, const jack_midi_data_t velocity)
+    const char * SynthesiserHandler::getName() const
     {
-      const Real_t base = std::pow(2.0, (n - 69) / 12.0) * 440.0;
-
-      const Real_t coeff = pow(velocity / 127.0, m_parameters->velocityPower);
-      const Real_t volume = m_parameters->volume * coeff;
+      return "synth";
+    }
 
-      Note * newNote = nullptr;
+    void SynthesiserHandler::noteOn(const jack_nframes_t time, const jack_midi_data_t n, const jack_midi_data_t velocity)
+    {
+      Voices & voices = m_work.voices;
 
-      for (Note & note : m_work.notes)
+      const size_t existing = m_work.allocator.getVoice(n);
+      if (existing != VoiceAllocator::NONE)
       {
-	if (note.status == EMPTY)
+	if (voices.status[existing] == STOLEN)
 	{
-	  newNote = &note;
+	  // it has not started yet
+	  voices.pendingVelocity[existing] = velocity;
 	}
 	else
 	{
-	  if (note.n == n)
-	  {
-	    // reuse existing note
-	    // rather than playing 2 notes at the same frequency
-	    note.status = ATTACK;
-	    note.volume = volume;
-	    return;
-	  }
+	  // reuse existing note
+	  // rather than playing 2 notes at the same frequency
+	  const Real_t coeff = pow(velocity / 127.0, m_snapshot->parameters->velocityPower);
+	  setStatus(existing, ATTACK);
+	  voices.volume[existing] = m_snapshot->parameters->volume * coeff;
 	}
+	return;
       }
 
-      if (newNote)
+      const size_t voice = m_work.allocator.allocate(n);
+      if (voice != VoiceAllocator::NONE)
       {
-	Note & note = *newNote;
-	note.n = n;
-	note.frequency = base;
+	startVoice(voice, time, n, velocity);
+      }
+      else
+      {
+	stealVoice(n, velocity);
+      }
+    }
+
+    void SynthesiserHandler::startVoice(const size_t voice, const jack_nframes_t time, const jack_midi_data_t n, const jack_midi_data_t velocity)
+    {
+      const Real_t base = noteFrequency(n);
+
+      const Real_t coeff = pow(velocity / 127.0, m_snapshot->parameters->velocityPower);
+      const Real_t volume = m_snapshot->parameters->volume * coeff;
+
+      Voices & voices = m_work.voices;
+      const size_t i = voice;
+
+      voices.n[i] = n;
+      voices.frequency[i] = base;
+      setTable(i);
 
-	note.t0 = time;
-	note.phase = 0.0;
-	note.volume = volume;
+      voices.t0[i] = time;
+      voices.phase[i] = 0.0;
+      voices.volume[i] = volume;
 
-	note.status = ATTACK;
-	note.current = 0.0;
-	note.amplitude = 0.0;
+      setStatus(i, ATTACK);
+      voices.current[i] = 0.0;
+      voices.amplitude[i] = 0.0;
 
-	const Real_t lower = base / m_parameters->iir.lower;
-	const Real_t upper = base * m_parameters->iir.upper;
-	createFilter(m_parameters->iir.pass, m_parameters->iir.order, m_work.sampleRate, lower, upper, note.filter);
+      m_work.filters[i / VOICE_LANES].load(i % VOICE_LANES, m_snapshot->filters.getSections(n));
+    }
+
+    void SynthesiserHandler::stealVoice(const jack_midi_data_t n, const jack_midi_data_t velocity)
+    {
+      const size_t victim = findVictim();
+      if (victim == VoiceAllocator::NONE)
+      {
+	// they are all fading already
+	m_dropped.fetch_add(1, std::memory_order_relaxed);
 	return;
       }
 
-      std::cerr << "Max polyphony!" << std::endl;
+      m_work.allocator.reassign(victim, n);
+      m_work.voices.pendingNote[victim] = n;
+      m_work.voices.pendingVelocity[victim] = velocity;
+      setStatus(victim, STOLEN);
+
+      m_steals.fetch_add(1, std::memory_order_relaxed);
     }
 
-    void SynthesiserHandler::noteOff(const jack_midi_data_t n)
+    size_t SynthesiserHandler::findVictim() const
     {
-      for (Note & note : m_work.notes)
+      const Voices & voices = m_work.voices;
+      const Stealing stealing = m_snapshot->parameters->stealing;
+
+      size_t victim = VoiceAllocator::NONE;
+      bool victimReleased = false;
+
+      for (const size_t voice : m_work.allocator.getActiveVoices())
       {
-	if (note.n == n && note.status < RELEASE)
+	const Status status = voices.status[voice];
+	if (status == STOLEN || status == EMPTY)
 	{
-	  note.status = RELEASE;
+	  continue;
+	}
+
+	// with the pedal down, they are still RELEASE
+	const bool released = status >= RELEASE;
+	// unsigned: it works across the wrap around
+	const jack_nframes_t age = m_work.time - voices.t0[voice];
+
+	bool better = victim == VoiceAllocator::NONE;
+	if (!better)
+	{
+	  const jack_nframes_t victimAge = m_work.time - voices.t0[victim];
+	  switch (stealing)
+	  {
+	  case Stealing::QUIETEST:
+	    better = voices.amplitude[voice] * voices.volume[voice] < voices.amplitude[victim] * voices.volume[victim];
+	    break;
+	  case Stealing::RELEASED:
+	    better = released != victimReleased ? released : age > victimAge;
+	    break;
+	  case Stealing::OLDEST:
+	    better = age > victimAge;
+	    break;
+	  }
 	}
+
+	if (better)
+	{
+	  victim = voice;
+	  victimReleased = released;
+	}
+      }
+
+      return victim;
+    }
+
+    void SynthesiserHandler::startPending(const size_t voice, const jack_nframes_t time)
+    {
+      Voices & voices = m_work.voices;
+      const jack_midi_data_t velocity = voices.pendingVelocity[voice];
+      if (velocity > 0)
+      {
+	voices.pendingVelocity[voice] = 0;
+	startVoice(voice, time, voices.pendingNote[voice], velocity);
+      }
+    }
+
+    void SynthesiserHandler::releaseVoices()
+    {
+      // not while rendering: the workers read the active groups
+      const std::vector<size_t> & active = m_work.allocator.getActiveVoices();
+      for (size_t k = 0; k < active.size(); )
+      {
+	const size_t voice = active[k];
+	if (m_work.voices.status[voice] == EMPTY)
+	{
+	  // the last one takes its place
+	  m_work.allocator.release(voice);
+	}
+	else
+	{
+	  ++k;
+	}
+      }
+    }
+
+    void SynthesiserHandler::noteOff(const jack_midi_data_t n)
+    {
+      Voices & voices = m_work.voices;
+      const size_t voice = m_work.allocator.getVoice(n);
+      if (voice == VoiceAllocator::NONE)
+      {
+	return;
+      }
+
+      if (voices.status[voice] == STOLEN)
+      {
+	// released before it started: it never will
+	voices.pendingVelocity[voice] = 0;
+	m_work.allocator.unmap(voice);
+      }
+      else if (voices.status[voice] < RELEASE)
+      {
+	setStatus(voice, RELEASE);
       }
     }
 
     void SynthesiserHandler::allNotesOff()
     {
-      for (Note & note : m_work.notes)
+      Voices & voices = m_work.voices;
+      for (const size_t voice : m_work.allocator.getActiveVoices())
       {
-	if (note.status < FORCE_RELEASE)
+	if (voices.status[voice] == STOLEN)
+	{
+	  voices.pendingVelocity[voice] = 0;
+	  m_work.allocator.unmap(voice);
+	}
+	else if (voices.status[voice] < FORCE_RELEASE)
 	{
-	  note.status = FORCE_RELEASE;
+	  setStatus(voice, FORCE_RELEASE);
 	}
       }
     }
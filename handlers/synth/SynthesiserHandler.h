@@ -4,10 +4,23 @@
 #include "MidiEvent.h"
 #include "handlers/synth/SynthParameters.h"
 #include "handlers/synth/Filter.h"
+#include "handlers/synth/FilterBank.h"
+#include "handlers/synth/Wavetable.h"
+#include "handlers/synth/IIRFactory.h"
+#include "handlers/synth/KernelTuner.h"
+#include "handlers/synth/VoiceAllocator.h"
+#include "handlers/synth/WorkerPool.h"
 
 #include <jack/midiport.h>
 #include <list>
 #include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// voices rendered together (16 floats: 1 AVX-512 or 2 AVX2 registers)
+#define VOICE_LANES 16
 
 namespace ASI
 {
@@ -16,17 +29,43 @@ namespace ASI
 
     /*
       Simple synthesiser
+
+      Voices are stored as a structure of arrays and rendered VOICE_LANES at a time,
+      so the compiler can keep a whole group of voices in SIMD registers
+      (table lookups become gathers).
+      Each voice reads the level of the band limited wavetable for its frequency.
+      The filters of a group are a FilterBank: 1 voice per SIMD lane.
+      The ADSR is rendered in runs of samples where no voice can change segment,
+      the state machine only runs at the (sample accurate) end of a segment.
+
+      Only the groups with active voices are rendered (see VoiceAllocator).
+      When all the voices are playing, one is stolen (see Stealing):
+      it fades out quickly and the new note starts on it right after.
+
+      With more than 1 thread, the active groups are shared by a WorkerPool
+      (the process callback is worker 0): each worker mixes its groups in a private buffer,
+      the buffers are added once all the groups are done.
+      MIDI events still split the buffer where they happen:
+      spans shorter than a render chunk are rendered by the process callback alone.
+
+      With "watch", the parameters file is polled by a background thread
+      which rebuilds all the tables and hands them over to the process callback.
+      Notes keep playing across the swap, the new parameters apply from the next sample.
     */
     class SynthesiserHandler : public InputOutputHandler
     {
     public:
 
-      SynthesiserHandler(const std::shared_ptr<CommonControls> & common, const std::string & parametersFile);
+      SynthesiserHandler(const std::shared_ptr<CommonControls> & common, const std::string & parametersFile, const bool watch, const std::string & kernelCache, const size_t threads);
+
+      ~SynthesiserHandler();
 
       virtual void process(const jack_nframes_t nframes);
 
       virtual void shutdown();
 
+      virtual const char * getName() const;
+
     private:
 
       enum Status
@@ -36,71 +75,162 @@ namespace ASI
 	SUSTAIN,                 // slow decay
 	RELEASE,                 // . -> 0
 	FORCE_RELEASE,           // this one ignores the pedal
+	STOLEN,                  // fast fade, then the pending note starts
 	OFF,                     // linear ADSR = 0, smooth going to 0
 	EMPTY                    // slot not used
       };
 
-      struct Note
+      // 1 entry per voice, rounded up to a multiple of VOICE_LANES
+      struct Voices
       {
-	jack_midi_data_t n;     // MIDI number
-	Real_t frequency;       // base frequency
-	jack_nframes_t t0;      // start time
-	Real_t phase;           // current phase
-	Real_t volume;          // note volume
+	std::vector<jack_midi_data_t> n;     // MIDI number
+	std::vector<jack_nframes_t> t0;      // start time
+	std::vector<Status> status;
+
+	std::vector<Real_t> frequency;       // base frequency
+	std::vector<Real_t> phase;           // current phase
+	std::vector<Real_t> volume;          // note volume (0 once EMPTY)
+	std::vector<Real_t> current;         // linear ADSR
+	std::vector<Real_t> amplitude;       // smooth ADSR
+
+	// the level of the wavetable (see setTable())
+	std::vector<int32_t> table;          // offset of the level
+	std::vector<Real_t> tableSize;       // points in the level
+
+	// the ADSR segment of the status (see setStatus())
+	std::vector<Real_t> step;            // added to current every sample
+	std::vector<Real_t> limit;           // the segment ends when it is reached
+	std::vector<Real_t> direction;       // +1 rising, -1 falling
+	std::vector<Real_t> silence;         // OFF: EMPTY when the amplitude gets below this
+
+	// STOLEN: the note which starts once EMPTY
+	std::vector<jack_midi_data_t> pendingNote;
+	std::vector<jack_midi_data_t> pendingVelocity;   // 0 = none
+      };
+
+      // everything derived from the parameters: read only once built
+      struct Snapshot
+      {
+	std::shared_ptr<const Parameters> parameters;
+
+	// band limited periods of the note
+	Wavetable wavetable;
+
+	std::vector<Real_t> vibratoSamples;
+	std::vector<Real_t> tremoloSamples;
+	Real_t maxVibrato;
 
-	Status status;
-	Real_t current;         // linear ADSR
-	Real_t amplitude;       // smooth ADSR
+	// the filter of each note
+	IIRTable filters;
 
-	Filter<4> filter;
+	Real_t attackDelta;
+	Real_t decayDelta;
+	Real_t sustainDelta;
+	Real_t releaseDelta;
+	Real_t stealDelta;
+	Real_t timeMultiplier;
+	Real_t lfoSize;
+
+	// ADSR smoothing: amplitude = amplitude * smoothKeep + current * smoothTake
+	Real_t smoothKeep;
+	Real_t smoothTake;
+	Real_t logSmoothKeep;                // 0 if smoothKeep is 0
       };
 
       struct Workspace
       {
 	jack_nframes_t time;
 
-	std::vector<Note> notes;
+	// the first "poliphony" are used, the others are padding
+	Voices voices;
+	size_t poliphony;
+	VoiceAllocator allocator;
+
+	std::vector<Real_t> vibratoBuffer;
 
-	// table with 1 period of the note
-	std::vector<Real_t> samples;
+	// 1 per worker
+	struct Buffers
+	{
+	  std::vector<Real_t> voices;        // a chunk of a group of voices, frame major
+	  std::vector<Real_t> output;        // the mix of its groups
+	};
+	std::vector<Buffers> buffers;
 
-	std::vector<Real_t> vibratoSamples;
-	std::vector<Real_t> tremoloSamples;
+	// of the current call to processNotes()
+	jack_nframes_t frames;
 
-	std::vector<Real_t> buffer;
-	std::vector<Real_t> vibratoBuffer;
+	// the filters of a group of VOICE_LANES voices
+	std::vector<FilterBank<VOICE_LANES> > filters;
 
 	jack_nframes_t sampleRate;
 
 	bool sustain;  // the pedal
 
-	Real_t attackDelta;
-	Real_t decayDelta;
-	Real_t sustainDelta;
-	Real_t releaseDelta;
 	Real_t actualReleaseDelta;
-	Real_t timeMultiplier;
-	Real_t interpolationMultiplier;
 
-	Filter<4> filter;
+	// it cannot change on reload, its kernel is tuned on startup
+	IIR master;
+	MasterFilter filter;
       };
 
       const std::string m_parametersFile;
+      const std::string m_kernelCache;
+
+      jack_port_t * m_audioPort;
 
       Workspace m_work;
 
-      std::shared_ptr<const Parameters> m_parameters;
+      // only used by the process callback
+      const Snapshot * m_snapshot;
+
+      // the watcher publishes to m_next and deletes m_retired
+      // process() takes m_next only after m_retired has been deleted
+      std::atomic<const Snapshot *> m_next;
+      std::atomic<const Snapshot *> m_retired;
+
+      // written by the process callback, reported by the destructor
+      std::atomic<size_t> m_steals;
+      std::atomic<size_t> m_dropped;
+
+      WorkerPool m_workers;
+
+      std::thread m_watcher;
+      std::mutex m_mutex;
+      std::condition_variable m_condition;
+      bool m_quit;
+
+      Snapshot * createSnapshot(const std::shared_ptr<const Parameters> & parameters) const;
+      void swapSnapshot();
+      void watch();
+      void stopWatching();
 
       void noteOn(const jack_nframes_t time, const jack_midi_data_t n, const jack_midi_data_t velocity);
       void noteOff(const jack_midi_data_t n);
       void allNotesOff();
 
-      void processMIDIEvent(const jack_nframes_t eventCount, const jack_nframes_t localTime, const jack_nframes_t absTime, void * portBuf, jack_nframes_t & eventIndex, jack_midi_event_t & event);
+      void startVoice(const size_t voice, const jack_nframes_t time, const jack_midi_data_t n, const jack_midi_data_t velocity);
+      void stealVoice(const jack_midi_data_t n, const jack_midi_data_t velocity);
+      size_t findVictim() const;
+      void startPending(const size_t voice, const jack_nframes_t time);
+      void releaseVoices();
+
+      void processMIDIEvent(const jack_nframes_t eventCount, const jack_nframes_t localTime, const jack_nframes_t absTime, const MidiPortBuffer & portBuf, jack_nframes_t & eventIndex, jack_midi_event_t & event);
+
+      void setStatus(const size_t voice, const Status status);
+      void updateSegments();
+      void setTable(const size_t voice);
+      void updateTables();
+      void updateFilters();
 
       void processNotes(const jack_nframes_t nframes, jack_default_audio_sample_t * output);
-      void processNote(const jack_nframes_t nframes, Note & note, jack_default_audio_sample_t * output);
+      void processVoices(const size_t first, const jack_nframes_t nframes, Real_t * buffer, jack_default_audio_sample_t * output);
+      template <Interpolation interpolation>
+	void renderVoices(const size_t first, const jack_nframes_t offset, const jack_nframes_t nframes, Real_t * output);
+
+      // WorkerPool::Work: item is the position in the active groups
+      static void renderGroup(void * context, const size_t worker, const size_t item);
 
-      void initialise();
+      void initialise(const size_t threads);
     };
 
   }
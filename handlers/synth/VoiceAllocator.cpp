@@ -0,0 +1,180 @@
+#include "handlers/synth/VoiceAllocator.h"
+
+#include <stdexcept>
+
+namespace
+{
+  const int NO_NOTE = -1;
+
+  // index of the lowest bit set (x != 0)
+  size_t lowestBit(const uint64_t x)
+  {
+    return __builtin_ctzll(x);
+  }
+}
+
+namespace ASI
+{
+  namespace Synth
+  {
+
+    const size_t VoiceAllocator::NONE;
+
+    void VoiceAllocator::initialise(const size_t voices, const size_t lanes)
+    {
+      if (lanes == 0 || lanes > 64)
+      {
+	throw std::invalid_argument("Voice groups must have 1 to 64 lanes");
+      }
+
+      m_lanes = lanes;
+      const size_t groups = (voices + lanes - 1) / lanes;
+
+      m_free.assign(groups, 0);
+      m_groupsWithFree.assign((groups + 63) / 64, 0);
+      for (size_t voice = 0; voice < voices; ++voice)
+      {
+	const size_t group = voice / lanes;
+	m_free[group] |= uint64_t(1) << (voice % lanes);
+	m_groupsWithFree[group / 64] |= uint64_t(1) << (group % 64);
+      }
+
+      m_active.clear();
+      m_active.reserve(voices);
+      m_position.assign(voices, NONE);
+
+      m_groups.clear();
+      m_groups.reserve(groups);
+      m_groupPosition.assign(groups, NONE);
+      m_count.assign(groups, 0);
+
+      m_voiceOfNote.fill(NONE);
+      m_noteOfVoice.assign(voices, NO_NOTE);
+
+      m_highWater = 0;
+    }
+
+    size_t VoiceAllocator::allocate(const jack_midi_data_t n)
+    {
+      // the lowest group with a free voice
+      size_t k = 0;
+      while (k < m_groupsWithFree.size() && m_groupsWithFree[k] == 0)
+      {
+	++k;
+      }
+      if (k == m_groupsWithFree.size())
+      {
+	return NONE;
+      }
+
+      const size_t group = k * 64 + lowestBit(m_groupsWithFree[k]);
+      const size_t lane = lowestBit(m_free[group]);
+      const size_t voice = group * m_lanes + lane;
+
+      m_free[group] &= ~(uint64_t(1) << lane);
+      if (m_free[group] == 0)
+      {
+	m_groupsWithFree[k] &= ~(uint64_t(1) << (group % 64));
+      }
+
+      m_position[voice] = m_active.size();
+      m_active.push_back(voice);
+      if (m_count[group] == 0)
+      {
+	m_groupPosition[group] = m_groups.size();
+	m_groups.push_back(group);
+      }
+      ++m_count[group];
+
+      if (m_active.size() > m_highWater.load(std::memory_order_relaxed))
+      {
+	m_highWater.store(m_active.size(), std::memory_order_relaxed);
+      }
+
+      map(voice, n);
+      return voice;
+    }
+
+    void VoiceAllocator::release(const size_t voice)
+    {
+      unmap(voice);
+
+      // swap with the last one
+      const size_t position = m_position[voice];
+      const size_t last = m_active.back();
+      m_active[position] = last;
+      m_position[last] = position;
+      m_active.pop_back();
+      m_position[voice] = NONE;
+
+      const size_t group = voice / m_lanes;
+      --m_count[group];
+      if (m_count[group] == 0)
+      {
+	const size_t groupPosition = m_groupPosition[group];
+	const size_t lastGroup = m_groups.back();
+	m_groups[groupPosition] = lastGroup;
+	m_groupPosition[lastGroup] = groupPosition;
+	m_groups.pop_back();
+	m_groupPosition[group] = NONE;
+      }
+
+      m_free[group] |= uint64_t(1) << (voice % m_lanes);
+      m_groupsWithFree[group / 64] |= uint64_t(1) << (group % 64);
+    }
+
+    void VoiceAllocator::reassign(const size_t voice, const jack_midi_data_t n)
+    {
+      unmap(voice);
+      map(voice, n);
+    }
+
+    void VoiceAllocator::unmap(const size_t voice)
+    {
+      const int n = m_noteOfVoice[voice];
+      if (n != NO_NOTE)
+      {
+	m_voiceOfNote[n] = NONE;
+	m_noteOfVoice[voice] = NO_NOTE;
+      }
+    }
+
+    void VoiceAllocator::map(const size_t voice, const jack_midi_data_t n)
+    {
+      // a note has at most 1 voice
+      const size_t previous = m_voiceOfNote[n & 0x7f];
+      if (previous != NONE)
+      {
+	m_noteOfVoice[previous] = NO_NOTE;
+      }
+      m_voiceOfNote[n & 0x7f] = voice;
+      m_noteOfVoice[voice] = n & 0x7f;
+    }
+
+    size_t VoiceAllocator::getVoice(const jack_midi_data_t n) const
+    {
+      return m_voiceOfNote[n & 0x7f];
+    }
+
+    bool VoiceAllocator::isActive(const size_t voice) const
+    {
+      return voice < m_position.size() && m_position[voice] != NONE;
+    }
+
+    const std::vector<size_t> & VoiceAllocator::getActiveVoices() const
+    {
+      return m_active;
+    }
+
+    const std::vector<size_t> & VoiceAllocator::getActiveGroups() const
+    {
+      return m_groups;
+    }
+
+    size_t VoiceAllocator::getHighWater() const
+    {
+      return m_highWater.load(std::memory_order_relaxed);
+    }
+
+  }
+}
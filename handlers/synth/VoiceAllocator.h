@@ -0,0 +1,87 @@
+#pragma once
+
+#include <jack/midiport.h>
+
+#include <vector>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+namespace ASI
+{
+  namespace Synth
+  {
+
+    /*
+      Book keeping of the voices of the synthesiser: which are free, which note each one plays.
+
+      Voices are rendered in groups of "lanes", so a new voice is the lowest free one
+      (active voices stay in as few groups as possible)
+      and the groups with at least 1 active voice are kept in a compact list.
+      Everything is O(1) (the free voices are bitmasks) and does not allocate after initialise().
+
+      It does not choose which voice to steal: it only moves a voice to a new note.
+    */
+    class VoiceAllocator
+    {
+    public:
+
+      static const size_t NONE = size_t(-1);
+
+      // "voices" can be used, rendered in groups of "lanes" (at most 64)
+      void initialise(const size_t voices, const size_t lanes);
+
+      // a free voice for note n, NONE if they are all active
+      size_t allocate(const jack_midi_data_t n);
+
+      // the voice is free again
+      void release(const size_t voice);
+
+      // the voice (active) plays n now
+      void reassign(const size_t voice, const jack_midi_data_t n);
+
+      // the voice (active) does not play any note (but it is still active)
+      void unmap(const size_t voice);
+
+      // the voice of note n, NONE if there is none
+      size_t getVoice(const jack_midi_data_t n) const;
+
+      bool isActive(const size_t voice) const;
+
+      // not ordered
+      const std::vector<size_t> & getActiveVoices() const;
+      const std::vector<size_t> & getActiveGroups() const;
+
+      // can be read from any thread
+      size_t getHighWater() const;
+
+    private:
+
+      size_t m_lanes;
+
+      // bit j of m_free[g]: voice g * lanes + j is free
+      std::vector<uint64_t> m_free;
+      // bit g of m_groupsWithFree[k]: group 64 * k + g has a free voice
+      std::vector<uint64_t> m_groupsWithFree;
+
+      // m_active[m_position[voice]] = voice
+      std::vector<size_t> m_active;
+      std::vector<size_t> m_position;
+
+      // same for the groups, m_count = active voices in a group
+      std::vector<size_t> m_groups;
+      std::vector<size_t> m_groupPosition;
+      std::vector<size_t> m_count;
+
+      // note <-> voice
+      std::array<size_t, 128> m_voiceOfNote;
+      std::vector<int> m_noteOfVoice;
+
+      std::atomic<size_t> m_highWater;
+
+      void map(const size_t voice, const jack_midi_data_t n);
+    };
+
+  }
+}
@@ -0,0 +1,144 @@
+#include "handlers/synth/Wavetable.h"
+
+#include <cmath>
+#include <complex>
+#include <algorithm>
+#include <stdexcept>
+
+// points per harmonic in a level
+#define WAVETABLE_OVERSAMPLING 16
+
+// smallest level
+#define WAVETABLE_MIN_SIZE 64
+
+namespace
+{
+  typedef std::complex<double> Complex_t;
+
+  // in place radix 2, not normalised
+  void fft(std::vector<Complex_t> & a, const bool inverse)
+  {
+    const size_t n = a.size();
+
+    for (size_t i = 1, j = 0; i < n; ++i)
+    {
+      size_t bit = n >> 1;
+      for (; j & bit; bit >>= 1)
+      {
+	j ^= bit;
+      }
+      j ^= bit;
+      if (i < j)
+      {
+	std::swap(a[i], a[j]);
+      }
+    }
+
+    for (size_t length = 2; length <= n; length <<= 1)
+    {
+      const double angle = 2.0 * M_PI / length * (inverse ? 1.0 : -1.0);
+      const Complex_t w(std::cos(angle), std::sin(angle));
+      for (size_t i = 0; i < n; i += length)
+      {
+	Complex_t wk(1.0);
+	for (size_t k = 0; k < length / 2; ++k)
+	{
+	  const Complex_t u = a[i + k];
+	  const Complex_t v = a[i + k + length / 2] * wk;
+	  a[i + k] = u + v;
+	  a[i + k + length / 2] = u - v;
+	  wk *= w;
+	}
+      }
+    }
+  }
+
+}
+
+namespace ASI
+{
+  namespace Synth
+  {
+
+    void Wavetable::build(const std::vector<Real_t> & period, const Real_t lowest)
+    {
+      const size_t n = period.size() - 1;
+      if (n < 2 || (n & (n - 1)))
+      {
+	throw std::runtime_error("Wavetable size must be a power of 2");
+      }
+
+      std::vector<Complex_t> spectrum(period.begin(), period.end() - 1);
+      fft(spectrum, false);
+
+      // no Nyquist
+      const size_t maxHarmonic = n / 2 - 1;
+
+      // the lowest note needs the most harmonics
+      const double needed = std::min<double>(0.5 / lowest, maxHarmonic);
+
+      m_samples.clear();
+      m_levels.clear();
+
+      std::vector<Complex_t> values;
+      for (size_t m = 0; ; ++m)
+      {
+	const size_t harmonics = std::min<size_t>(size_t(1) << m, maxHarmonic);
+	const size_t size = std::min(n, std::max<size_t>(WAVETABLE_MIN_SIZE, (size_t(1) << m) * WAVETABLE_OVERSAMPLING));
+
+	values.assign(size, Complex_t(0.0));
+	values[0] = spectrum[0];
+	for (size_t k = 1; k <= harmonics; ++k)
+	{
+	  values[k] = spectrum[k];
+	  values[size - k] = spectrum[n - k];
+	}
+	fft(values, true);
+
+	// 1 guard point before, 3 after (the phase might round up to 1)
+	const Level level = {int32_t(m_samples.size() + 1), Real_t(size)};
+	m_levels.push_back(level);
+
+	m_samples.push_back(values[size - 1].real() / n);
+	for (size_t i = 0; i < size; ++i)
+	{
+	  m_samples.push_back(values[i].real() / n);
+	}
+	m_samples.push_back(values[0].real() / n);
+	m_samples.push_back(values[1].real() / n);
+	m_samples.push_back(values[2].real() / n);
+
+	if (harmonics >= needed)
+	{
+	  break;
+	}
+      }
+    }
+
+    const Wavetable::Level & Wavetable::getLevel(const Real_t frequency) const
+    {
+      // explicit ranges, not the infinities of 0.5 / 0 (-ffast-math)
+      if (frequency > 0.25)
+      {
+	// fewer than 2 harmonics below Nyquist
+	return m_levels.front();
+      }
+      if (frequency <= 0.0)
+      {
+	return m_levels.back();
+      }
+
+      const Real_t harmonics = 0.5 / frequency;
+
+      // floor(log2(harmonics))
+      const size_t m = std::ilogb(harmonics);
+      return m_levels[std::min(m, m_levels.size() - 1)];
+    }
+
+    const Real_t * Wavetable::data() const
+    {
+      return m_samples.data();
+    }
+
+  }
+}
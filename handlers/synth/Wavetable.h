@@ -0,0 +1,160 @@
+#pragma once
+
+#include "handlers/synth/SynthParameters.h"
+
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+namespace ASI
+{
+  namespace Synth
+  {
+
+    /*
+      Band limited wavetable, 1 level per octave.
+
+      Level m only keeps the harmonics 1 ... 2^m of the period, so it does not alias
+      for frequencies up to sampleRate / 2^(m + 1).
+      Each level is just large enough for its harmonics (with some oversampling),
+      plus guard points so the interpolation never needs to wrap.
+    */
+    class Wavetable
+    {
+    public:
+
+      struct Level
+      {
+	int32_t offset;             // of the first point in data()
+	Real_t size;                // points in 1 period
+      };
+
+      // period: 1 period sampled on 2^n points (+ 1 guard point)
+      // lowest: the lowest frequency which will be played (cycles per sample)
+      void build(const std::vector<Real_t> & period, const Real_t lowest);
+
+      // the richest level which does not alias at this frequency (cycles per sample)
+      const Level & getLevel(const Real_t frequency) const;
+
+      const Real_t * data() const;
+
+    private:
+
+      std::vector<Real_t> m_samples;
+      std::vector<Level> m_levels;
+    };
+
+    // the formulas, for Real_t and the vector types below
+    // y0 = table[i - 1], y1 = table[i], ... with position = i + f
+
+    template <typename T>
+      inline T linear(const T y1, const T y2, const T f)
+    {
+      return y1 + f * (y2 - y1);
+    }
+
+    template <typename T>
+      inline T catmullRom(const T y0, const T y1, const T y2, const T y3, const T f)
+    {
+      const T c1 = 0.5f * (y2 - y0);
+      const T c2 = y0 - 2.5f * y1 + 2.0f * y2 - 0.5f * y3;
+      const T c3 = 0.5f * (y3 - y0) + 1.5f * (y1 - y2);
+      return ((c3 * f + c2) * f + c1) * f + y1;
+    }
+
+    // position in [0, size)
+    template <Interpolation interpolation>
+      inline Real_t interpolate(const Real_t * table, const Real_t position);
+
+    template <>
+      inline Real_t interpolate<Interpolation::LINEAR>(const Real_t * table, const Real_t position)
+    {
+      const int32_t i = int32_t(position);
+      const Real_t f = position - i;
+      return linear(table[i], table[i + 1], f);
+    }
+
+    template <>
+      inline Real_t interpolate<Interpolation::CUBIC>(const Real_t * table, const Real_t position)
+    {
+      // Catmull-Rom
+      const int32_t i = int32_t(position);
+      const Real_t f = position - i;
+      return catmullRom(table[i - 1], table[i], table[i + 1], table[i + 2], f);
+    }
+
+    /*
+      LANES voices at once: out[j] = interpolate(samples + table[j], position[j]).
+
+      The compiler does not vectorise the lookups on its own,
+      so they are explicit gathers (16 voices with AVX-512, 8 with AVX2)
+      of 1 int32 index per voice: table[j] + int32_t(position[j]).
+    */
+    template <Interpolation interpolation, size_t LANES>
+      inline void interpolateLanes(const Real_t * samples, const int32_t * table, const Real_t * position, Real_t * out)
+    {
+      static_assert(std::is_same<Real_t, float>::value, "gathers of float");
+
+      size_t j = 0;
+
+#if defined(__AVX512F__)
+      // the masked forms: the plain ones start from an undefined register, which GCC 12 warns about
+      const __mmask16 all = 0xffff;
+      const __m512 zero = _mm512_setzero_ps();
+      for (; j + 16 <= LANES; j += 16)
+      {
+	const __m512 p = _mm512_loadu_ps(position + j);
+	const __m512i i = _mm512_maskz_cvttps_epi32(all, p);
+	const __m512 f = p - _mm512_maskz_cvtepi32_ps(all, i);
+	const __m512i index = _mm512_add_epi32(_mm512_loadu_si512(table + j), i);
+
+	const __m512 y1 = _mm512_mask_i32gather_ps(zero, all, index, samples, sizeof(Real_t));
+	const __m512 y2 = _mm512_mask_i32gather_ps(zero, all, index, samples + 1, sizeof(Real_t));
+	if (interpolation == Interpolation::CUBIC)
+	{
+	  const __m512 y0 = _mm512_mask_i32gather_ps(zero, all, index, samples - 1, sizeof(Real_t));
+	  const __m512 y3 = _mm512_mask_i32gather_ps(zero, all, index, samples + 2, sizeof(Real_t));
+	  _mm512_storeu_ps(out + j, catmullRom(y0, y1, y2, y3, f));
+	}
+	else
+	{
+	  _mm512_storeu_ps(out + j, linear(y1, y2, f));
+	}
+      }
+#endif
+
+#if defined(__AVX2__)
+      for (; j + 8 <= LANES; j += 8)
+      {
+	const __m256 p = _mm256_loadu_ps(position + j);
+	const __m256i i = _mm256_cvttps_epi32(p);
+	const __m256 f = p - _mm256_cvtepi32_ps(i);
+	const __m256i index = _mm256_add_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(table + j)), i);
+
+	const __m256 y1 = _mm256_i32gather_ps(samples, index, sizeof(Real_t));
+	const __m256 y2 = _mm256_i32gather_ps(samples + 1, index, sizeof(Real_t));
+	if (interpolation == Interpolation::CUBIC)
+	{
+	  const __m256 y0 = _mm256_i32gather_ps(samples - 1, index, sizeof(Real_t));
+	  const __m256 y3 = _mm256_i32gather_ps(samples + 2, index, sizeof(Real_t));
+	  _mm256_storeu_ps(out + j, catmullRom(y0, y1, y2, y3, f));
+	}
+	else
+	{
+	  _mm256_storeu_ps(out + j, linear(y1, y2, f));
+	}
+      }
+#endif
+
+      for (; j < LANES; ++j)
+      {
+	out[j] = interpolate<interpolation>(samples + table[j], position[j]);
+      }
+    }
+
+  }
+}
@@ -0,0 +1,226 @@
+#include "handlers/synth/WorkerPool.h"
+
+#include <algorithm>
+#include <thread>
+#include <cerrno>
+
+namespace
+{
+  uint64_t makeRange(const uint64_t begin, const uint64_t end)
+  {
+    return begin | (end << 32);
+  }
+
+  uint64_t getBegin(const uint64_t range)
+  {
+    return range & 0xffffffff;
+  }
+
+  uint64_t getEnd(const uint64_t range)
+  {
+    return range >> 32;
+  }
+}
+
+namespace ASI
+{
+  namespace Synth
+  {
+
+    WorkerPool::WorkerPool()
+      : m_client(nullptr), m_workers(1), m_remaining(0), m_quit(false), m_work(nullptr), m_context(nullptr)
+    {
+      m_ranges.reset(new Range[1]);
+      m_ranges[0].items = 0;
+    }
+
+    WorkerPool::~WorkerPool()
+    {
+      stop();
+    }
+
+    bool WorkerPool::start(jack_client_t * client, const size_t workers)
+    {
+      stop();
+
+      m_client = client;
+      m_workers = std::max<size_t>(workers, 1);
+      m_ranges.reset(new Range[m_workers]);
+      m_wake.reset(new sem_t[m_workers]);
+      m_quit = false;
+
+      for (size_t i = 0; i < m_workers; ++i)
+      {
+	m_ranges[i].items = 0;
+	sem_init(&m_wake[i], 0, 0);
+      }
+
+      const int priority = jack_client_real_time_priority(m_client);
+      const int realtime = jack_is_realtime(m_client);
+
+      // their addresses are the arguments of the threads
+      m_threads.reserve(m_workers - 1);
+      for (size_t i = 1; i < m_workers; ++i)
+      {
+	const Thread thread = {this, i, jack_native_thread_t()};
+	m_threads.push_back(thread);
+	if (jack_client_create_thread(m_client, &m_threads.back().thread, priority, realtime, &WorkerPool::loop, &m_threads.back()))
+	{
+	  // the process callback must not wait for threads which are not real time
+	  m_threads.pop_back();
+	  stop();
+	  m_workers = 1;
+	  return false;
+	}
+      }
+
+      return true;
+    }
+
+    void WorkerPool::stop()
+    {
+      if (!m_wake)
+      {
+	return;
+      }
+
+      m_quit = true;
+      for (const Thread & thread : m_threads)
+      {
+	sem_post(&m_wake[thread.worker]);
+      }
+      for (const Thread & thread : m_threads)
+      {
+	jack_client_stop_thread(m_client, thread.thread);
+      }
+      m_threads.clear();
+
+      for (size_t i = 0; i < m_workers; ++i)
+      {
+	sem_destroy(&m_wake[i]);
+      }
+      m_wake.reset();
+    }
+
+    size_t WorkerPool::getNumberOfWorkers() const
+    {
+      return m_workers;
+    }
+
+    void WorkerPool::run(const size_t items, const Work work, void * context)
+    {
+      m_work = work;
+      m_context = context;
+
+      // contiguous ranges, the first ones get the remainder
+      const size_t share = items / m_workers;
+      const size_t extra = items % m_workers;
+      size_t begin = 0;
+      for (size_t i = 0; i < m_workers; ++i)
+      {
+	const size_t end = begin + share + (i < extra ? 1 : 0);
+	m_ranges[i].items.store(makeRange(begin, end), std::memory_order_relaxed);
+	begin = end;
+      }
+
+      m_remaining.store(m_workers - 1, std::memory_order_relaxed);
+      for (size_t i = 1; i < m_workers; ++i)
+      {
+	sem_post(&m_wake[i]);
+      }
+
+      process(0);
+
+      // the others are finishing their last item
+      while (m_remaining.load(std::memory_order_acquire) > 0)
+      {
+	std::this_thread::yield();
+      }
+    }
+
+    void * WorkerPool::loop(void * arg)
+    {
+      const Thread & thread = *static_cast<const Thread *>(arg);
+      WorkerPool & pool = *thread.pool;
+
+      while (true)
+      {
+	if (sem_wait(&pool.m_wake[thread.worker]))
+	{
+	  if (errno == EINTR)
+	  {
+	    continue;
+	  }
+	  break;
+	}
+
+	if (pool.m_quit)
+	{
+	  break;
+	}
+
+	pool.process(thread.worker);
+	pool.m_remaining.fetch_sub(1, std::memory_order_release);
+      }
+
+      return nullptr;
+    }
+
+    void WorkerPool::process(const size_t worker)
+    {
+      while (true)
+      {
+	size_t item;
+	while (pop(worker, item))
+	{
+	  m_work(m_context, worker, item);
+	}
+
+	// nothing left anywhere: done
+	bool stolen = false;
+	for (size_t i = 1; i < m_workers && !stolen; ++i)
+	{
+	  stolen = steal(worker, (worker + i) % m_workers);
+	}
+	if (!stolen)
+	{
+	  return;
+	}
+      }
+    }
+
+    bool WorkerPool::pop(const size_t worker, size_t & item)
+    {
+      std::atomic<uint64_t> & items = m_ranges[worker].items;
+      uint64_t range = items.load(std::memory_order_acquire);
+      while (getBegin(range) < getEnd(range))
+      {
+	if (items.compare_exchange_weak(range, makeRange(getBegin(range) + 1, getEnd(range)), std::memory_order_acq_rel))
+	{
+	  item = getBegin(range);
+	  return true;
+	}
+      }
+      return false;
+    }
+
+    bool WorkerPool::steal(const size_t thief, const size_t victim)
+    {
+      std::atomic<uint64_t> & items = m_ranges[victim].items;
+      uint64_t range = items.load(std::memory_order_acquire);
+      while (getBegin(range) < getEnd(range))
+      {
+	// the back half, the last item too
+	const uint64_t middle = getBegin(range) + (getEnd(range) - getBegin(range)) / 2;
+	if (items.compare_exchange_weak(range, makeRange(getBegin(range), middle), std::memory_order_acq_rel))
+	{
+	  // nobody touches an empty range
+	  m_ranges[thief].items.store(makeRange(middle, getEnd(range)), std::memory_order_release);
+	  return true;
+	}
+      }
+      return false;
+    }
+
+  }
+}
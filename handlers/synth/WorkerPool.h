@@ -0,0 +1,87 @@
+#pragma once
+
+#include <jack/jack.h>
+#include <jack/thread.h>
+#include <semaphore.h>
+
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace ASI
+{
+  namespace Synth
+  {
+
+    /*
+      Threads created once, which share the items of a job with work stealing.
+
+      Each worker starts with a contiguous range of items and takes them from the front;
+      when it runs out, it steals the back half of the range of another worker.
+      The ranges are single atomic words, so run() never locks nor allocates:
+      the caller is worker 0, the others are woken by a semaphore each.
+
+      The threads are created via jack_client_create_thread(), like the ones of ParallelChain,
+      so they have the same scheduling as the process callback which waits for them.
+      If they cannot be created, there is only worker 0.
+    */
+    class WorkerPool
+    {
+    public:
+
+      // item in [0, items), worker in [0, getNumberOfWorkers())
+      typedef void (*Work)(void * context, const size_t worker, const size_t item);
+
+      WorkerPool();
+      ~WorkerPool();
+
+      // workers - 1 threads, real time if the client is
+      // false if they cannot be created: then the pool has 1 worker
+      bool start(jack_client_t * client, const size_t workers);
+      void stop();
+
+      size_t getNumberOfWorkers() const;
+
+      // returns once all the items are done
+      void run(const size_t items, const Work work, void * context);
+
+    private:
+
+      // begin in the low 32 bits, end in the high ones
+      // 1 cache line each: they are written by different threads
+      struct Range
+      {
+	std::atomic<uint64_t> items;
+	char padding[64 - sizeof(std::atomic<uint64_t>)];
+      };
+
+      // the argument of a thread
+      struct Thread
+      {
+	WorkerPool * pool;
+	size_t worker;
+	jack_native_thread_t thread;
+      };
+
+      jack_client_t * m_client;
+      size_t m_workers;
+      std::unique_ptr<Range[]> m_ranges;
+      std::unique_ptr<sem_t[]> m_wake;
+      std::vector<Thread> m_threads;
+
+      std::atomic<size_t> m_remaining;
+      std::atomic<bool> m_quit;
+
+      Work m_work;
+      void * m_context;
+
+      static void * loop(void * arg);
+      void process(const size_t worker);
+      bool pop(const size_t worker, size_t & item);
+      bool steal(const size_t thief, const size_t victim);
+    };
+
+  }
+}
@@ -13,9 +13,8 @@ namespace ASI
     TransportHandler::TransportHandler(const std::shared_ptr<CommonControls> & common)
       : InputOutputHandler(common), m_pedalDown(false)
     {
-      jack_client_t * client = m_common->getClient();
-      m_inputPort = jack_port_register(client, "transport_in", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
-      m_outputPort = jack_port_register(client, "transport_out", JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput, 0);
+      m_inputPort = m_common->registerMidiPort("transport_in", JackPortIsInput);
+      m_outputPort = m_common->registerMidiPort("transport_out", JackPortIsOutput);
     }
 
     void TransportHandler::process(const jack_nframes_t nframes)
@@ -24,17 +23,17 @@ namespace ASI
       const std::map<jack_midi_data_t, Sounds::Program> & sounds = m_common->getSelectedSounds();
       const jack_midi_data_t channel = m_common->getChannel();
 
-      void* inPortBuf = jack_port_get_buffer(m_inputPort, nframes);
-      void* outPortBuf = jack_port_get_buffer(m_outputPort, nframes);
+      const MidiPortBuffer inPortBuf = m_inputPort->getBuffer(nframes);
+      MidiPortBuffer outPortBuf = m_outputPort->getBuffer(nframes);
 
-      jack_midi_clear_buffer(outPortBuf);
+      outPortBuf.clear();
 
-      jack_nframes_t eventCount = jack_midi_get_event_count(inPortBuf);
+      jack_nframes_t eventCount = inPortBuf.getEventCount();
 
       for (size_t i = 0; i < eventCount; ++i)
       {
 	jack_midi_event_t inEvent;
-	jack_midi_event_get(&inEvent, inPortBuf, i);
+	inPortBuf.getEvent(&inEvent, i);
 
 	const jack_midi_data_t cmd = inEvent.buffer[0] & 0xf0;
 
@@ -83,17 +82,17 @@ namespace ASI
 		data[0] = MIDI_CC | (channel - 1);
 		data[1] = MIDI_CC_MSB;
 		data[2] = program.msb;
-		jack_midi_event_write(outPortBuf, inEvent.time, data, 3);
+		outPortBuf.write(inEvent.time, data, 3);
 
 		// repeated for clarity
 		data[0] = MIDI_CC | (channel - 1);
 		data[1] = MIDI_CC_LSB;
 		data[2] = program.lsb;
-		jack_midi_event_write(outPortBuf, inEvent.time, data, 3);
+		outPortBuf.write(inEvent.time, data, 3);
 
 		data[0] = MIDI_PC | (channel - 1);
 		data[1] = program.number - 1;
-		jack_midi_event_write(outPortBuf, inEvent.time, data, 2);
+		outPortBuf.write(inEvent.time, data, 2);
 	      }
 	    }
 	    break;
@@ -107,5 +106,10 @@ namespace ASI
     {
     }
 
+    const char * TransportHandler::getName() const
+    {
+      return "trans";
+    }
+
   }
 }
@@ -23,6 +23,8 @@ namespace ASI
 
       virtual void shutdown();
 
+      virtual const char * getName() const;
+
     private:
 
       bool m_pedalDown;
@@ -0,0 +1,604 @@
+#include "offline/OfflineJack.h"
+
+#include <jack/midiport.h>
+#include <jack/ringbuffer.h>
+#include <jack/thread.h>
+
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+
+#define MIDI_BUFFER_SIZE 32768
+#define MIDI_BUFFER_EVENTS 4096
+
+namespace
+{
+
+  struct MidiBuffer
+  {
+    std::vector<jack_midi_event_t> events;
+    std::vector<jack_midi_data_t> data;
+    size_t used;
+    uint32_t lost;
+  };
+
+  void clearMidiBuffer(MidiBuffer & buffer)
+  {
+    buffer.events.clear();
+    buffer.used = 0;
+    buffer.lost = 0;
+  }
+
+}
+
+struct _jack_port
+{
+  jack_client_t * client;
+  std::string name;
+  std::string shortName;
+  std::string type;
+  unsigned long flags;
+  bool isMidi;
+
+  std::vector<jack_default_audio_sample_t> audio;
+  MidiBuffer midi;
+
+  // only for inputs
+  std::vector<jack_port_t *> sources;
+};
+
+struct _jack_client
+{
+  std::string name;
+  jack_nframes_t sampleRate;
+  jack_nframes_t bufferSize;
+
+  // frame time at the start of the current cycle
+  jack_nframes_t frame;
+
+  jack_transport_state_t state;
+  jack_nframes_t transportFrame;
+
+  // requests are applied at the next cycle, like JACK does
+  jack_transport_state_t nextState;
+  bool reposition;
+  jack_nframes_t repositionFrame;
+
+  std::vector<std::unique_ptr<jack_port_t> > ports;
+};
+
+namespace
+{
+
+  void mergeMidiInputs(jack_port_t * port)
+  {
+    MidiBuffer & buffer = port->midi;
+    clearMidiBuffer(buffer);
+
+    // merge sorted by time, stable w.r.t. the connection order
+    std::vector<std::pair<jack_port_t *, size_t> > all;
+    for (jack_port_t * source : port->sources)
+    {
+      for (size_t i = 0; i < source->midi.events.size(); ++i)
+      {
+	all.push_back(std::make_pair(source, i));
+      }
+    }
+
+    std::stable_sort(all.begin(), all.end(), [](const std::pair<jack_port_t *, size_t> & lhs, const std::pair<jack_port_t *, size_t> & rhs)
+		     {
+		       return lhs.first->midi.events[lhs.second].time < rhs.first->midi.events[rhs.second].time;
+		     });
+
+    for (const std::pair<jack_port_t *, size_t> & item : all)
+    {
+      const jack_midi_event_t & event = item.first->midi.events[item.second];
+      jack_midi_event_write(&buffer, event.time, event.buffer, event.size);
+    }
+  }
+
+  void mixAudioInputs(jack_port_t * port, const jack_nframes_t nframes)
+  {
+    std::vector<jack_default_audio_sample_t> & buffer = port->audio;
+    std::fill(buffer.begin(), buffer.begin() + nframes, 0.0f);
+
+    for (jack_port_t * source : port->sources)
+    {
+      for (size_t i = 0; i < nframes; ++i)
+      {
+	buffer[i] += source->audio[i];
+      }
+    }
+  }
+
+}
+
+namespace ASI
+{
+  namespace Offline
+  {
+
+    jack_client_t * createClient(const char * name, const jack_nframes_t sampleRate, const jack_nframes_t bufferSize)
+    {
+      jack_client_t * client = new jack_client_t;
+      client->name = name;
+      client->sampleRate = sampleRate;
+      client->bufferSize = bufferSize;
+      client->frame = 0;
+      client->state = JackTransportRolling;
+      client->transportFrame = 0;
+      client->nextState = client->state;
+      client->reposition = false;
+      client->repositionFrame = 0;
+      return client;
+    }
+
+    void destroyClient(jack_client_t * client)
+    {
+      delete client;
+    }
+
+    std::vector<jack_port_t *> getPorts(jack_client_t * client)
+    {
+      std::vector<jack_port_t *> ports;
+      for (const std::unique_ptr<jack_port_t> & port : client->ports)
+      {
+	ports.push_back(port.get());
+      }
+      return ports;
+    }
+
+    void advance(jack_client_t * client, const jack_nframes_t nframes)
+    {
+      client->frame += nframes;
+
+      if (client->state == JackTransportRolling)
+      {
+	client->transportFrame += nframes;
+      }
+
+      if (client->reposition)
+      {
+	client->transportFrame = client->repositionFrame;
+	client->reposition = false;
+      }
+
+      client->state = client->nextState;
+    }
+
+  }
+}
+
+extern "C"
+{
+
+  jack_nframes_t jack_get_sample_rate(jack_client_t * client)
+  {
+    return client->sampleRate;
+  }
+
+  jack_nframes_t jack_get_buffer_size(jack_client_t * client)
+  {
+    return client->bufferSize;
+  }
+
+  int jack_client_real_time_priority(jack_client_t * client)
+  {
+    // offline: not real time
+    return -1;
+  }
+
+  int jack_is_realtime(jack_client_t * client)
+  {
+    return 0;
+  }
+
+  int jack_client_create_thread(jack_client_t * client, jack_native_thread_t * thread, int priority, int realtime, void *(*start_routine)(void *), void * arg)
+  {
+    // never real time, like the process callback
+    return pthread_create(thread, nullptr, start_routine, arg);
+  }
+
+  int jack_client_stop_thread(jack_client_t * client, jack_native_thread_t thread)
+  {
+    return pthread_join(thread, nullptr);
+  }
+
+  jack_port_t * jack_port_register(jack_client_t * client, const char * port_name, const char * port_type, unsigned long flags, unsigned long buffer_size)
+  {
+    const std::string name = client->name + ":" + port_name;
+    for (const std::unique_ptr<jack_port_t> & port : client->ports)
+    {
+      if (port->name == name)
+      {
+	return nullptr;
+      }
+    }
+
+    std::unique_ptr<jack_port_t> port(new jack_port_t);
+    port->client = client;
+    port->name = name;
+    port->shortName = port_name;
+    port->type = port_type;
+    port->flags = flags;
+    port->isMidi = port->type == JACK_DEFAULT_MIDI_TYPE;
+
+    if (port->isMidi)
+    {
+      port->midi.events.reserve(MIDI_BUFFER_EVENTS);
+      port->midi.data.resize(MIDI_BUFFER_SIZE);
+      clearMidiBuffer(port->midi);
+    }
+    else
+    {
+      port->audio.resize(client->bufferSize, 0.0f);
+    }
+
+    client->ports.push_back(std::move(port));
+    return client->ports.back().get();
+  }
+
+  void * jack_port_get_buffer(jack_port_t * port, jack_nframes_t nframes)
+  {
+    const bool input = port->flags & JackPortIsInput;
+
+    if (port->isMidi)
+    {
+      if (input)
+      {
+	mergeMidiInputs(port);
+      }
+      return &port->midi;
+    }
+    else
+    {
+      if (input)
+      {
+	mixAudioInputs(port, nframes);
+      }
+      return port->audio.data();
+    }
+  }
+
+  const char * jack_port_name(const jack_port_t * port)
+  {
+    return port->name.c_str();
+  }
+
+  const char * jack_port_short_name(const jack_port_t * port)
+  {
+    return port->shortName.c_str();
+  }
+
+  int jack_port_flags(const jack_port_t * port)
+  {
+    return port->flags;
+  }
+
+  const char * jack_port_type(const jack_port_t * port)
+  {
+    return port->type.c_str();
+  }
+
+  int jack_connect(jack_client_t * client, const char * source_port, const char * destination_port)
+  {
+    jack_port_t * source = nullptr;
+    jack_port_t * destination = nullptr;
+
+    for (const std::unique_ptr<jack_port_t> & port : client->ports)
+    {
+      if (port->name == source_port)
+      {
+	source = port.get();
+      }
+      if (port->name == destination_port)
+      {
+	destination = port.get();
+      }
+    }
+
+    if (!source || !destination)
+    {
+      return -1;
+    }
+
+    if (!(source->flags & JackPortIsOutput) || !(destination->flags & JackPortIsInput) || source->type != destination->type)
+    {
+      return -1;
+    }
+
+    std::vector<jack_port_t *> & sources = destination->sources;
+    if (std::find(sources.begin(), sources.end(), source) != sources.end())
+    {
+      return EEXIST;
+    }
+
+    sources.push_back(source);
+    return 0;
+  }
+
+  jack_nframes_t jack_last_frame_time(const jack_client_t * client)
+  {
+    return client->frame;
+  }
+
+  jack_nframes_t jack_frame_time(const jack_client_t * client)
+  {
+    return client->frame;
+  }
+
+  jack_time_t jack_frames_to_time(const jack_client_t * client, jack_nframes_t frames)
+  {
+    return jack_time_t(frames) * 1000000 / client->sampleRate;
+  }
+
+  jack_nframes_t jack_time_to_frames(const jack_client_t * client, jack_time_t time)
+  {
+    return time * client->sampleRate / 1000000;
+  }
+
+  jack_transport_state_t jack_transport_query(const jack_client_t * client, jack_position_t * pos)
+  {
+    if (pos)
+    {
+      memset(pos, 0, sizeof(*pos));
+      pos->frame_rate = client->sampleRate;
+      pos->frame = client->transportFrame;
+      pos->usecs = jack_frames_to_time(client, client->frame);
+    }
+    return client->state;
+  }
+
+  void jack_transport_start(jack_client_t * client)
+  {
+    client->nextState = JackTransportRolling;
+  }
+
+  void jack_transport_stop(jack_client_t * client)
+  {
+    client->nextState = JackTransportStopped;
+  }
+
+  int jack_transport_reposition(jack_client_t * client, const jack_position_t * pos)
+  {
+    client->reposition = true;
+    client->repositionFrame = pos->frame;
+    return 0;
+  }
+
+  uint32_t jack_midi_get_event_count(void * port_buffer)
+  {
+    const MidiBuffer * buffer = reinterpret_cast<MidiBuffer *>(port_buffer);
+    return buffer->events.size();
+  }
+
+  int jack_midi_event_get(jack_midi_event_t * event, void * port_buffer, uint32_t event_index)
+  {
+    const MidiBuffer * buffer = reinterpret_cast<MidiBuffer *>(port_buffer);
+    if (event_index >= buffer->events.size())
+    {
+      return ENODATA;
+    }
+    *event = buffer->events[event_index];
+    return 0;
+  }
+
+  void jack_midi_clear_buffer(void * port_buffer)
+  {
+    MidiBuffer * buffer = reinterpret_cast<MidiBuffer *>(port_buffer);
+    clearMidiBuffer(*buffer);
+  }
+
+  size_t jack_midi_max_event_size(void * port_buffer)
+  {
+    const MidiBuffer * buffer = reinterpret_cast<MidiBuffer *>(port_buffer);
+    return buffer->data.size() - buffer->used;
+  }
+
+  jack_midi_data_t * jack_midi_event_reserve(void * port_buffer, jack_nframes_t time, size_t data_size)
+  {
+    MidiBuffer * buffer = reinterpret_cast<MidiBuffer *>(port_buffer);
+
+    // same rules as JACK: events must be written in order
+    if (!buffer->events.empty() && buffer->events.back().time > time)
+    {
+      return nullptr;
+    }
+
+    if (buffer->used + data_size > buffer->data.size() || buffer->events.size() == buffer->events.capacity())
+    {
+      ++buffer->lost;
+      return nullptr;
+    }
+
+    jack_midi_event_t event;
+    event.time = time;
+    event.size = data_size;
+    event.buffer = buffer->data.data() + buffer->used;
+
+    buffer->used += data_size;
+    buffer->events.push_back(event);
+
+    return event.buffer;
+  }
+
+  int jack_midi_event_write(void * port_buffer, jack_nframes_t time, const jack_midi_data_t * data, size_t data_size)
+  {
+    jack_midi_data_t * dest = jack_midi_event_reserve(port_buffer, time, data_size);
+    if (!dest)
+    {
+      return ENOBUFS;
+    }
+    memcpy(dest, data, data_size);
+    return 0;
+  }
+
+  uint32_t jack_midi_get_lost_event_count(void * port_buffer)
+  {
+    const MidiBuffer * buffer = reinterpret_cast<MidiBuffer *>(port_buffer);
+    return buffer->lost;
+  }
+
+  // single producer / single consumer, same layout and semantics as JACK's
+
+  jack_ringbuffer_t * jack_ringbuffer_create(size_t sz)
+  {
+    size_t power = 1;
+    while (power < sz)
+    {
+      power <<= 1;
+    }
+
+    jack_ringbuffer_t * rb = reinterpret_cast<jack_ringbuffer_t *>(malloc(sizeof(jack_ringbuffer_t)));
+    if (!rb)
+    {
+      return nullptr;
+    }
+
+    rb->size = power;
+    rb->size_mask = power - 1;
+    rb->write_ptr = 0;
+    rb->read_ptr = 0;
+    rb->mlocked = 0;
+    rb->buf = reinterpret_cast<char *>(malloc(power));
+    if (!rb->buf)
+    {
+      free(rb);
+      return nullptr;
+    }
+    return rb;
+  }
+
+  void jack_ringbuffer_free(jack_ringbuffer_t * rb)
+  {
+    free(rb->buf);
+    free(rb);
+  }
+
+  int jack_ringbuffer_mlock(jack_ringbuffer_t * rb)
+  {
+    rb->mlocked = 1;
+    return 0;
+  }
+
+  void jack_ringbuffer_reset(jack_ringbuffer_t * rb)
+  {
+    rb->read_ptr = 0;
+    rb->write_ptr = 0;
+  }
+
+  size_t jack_ringbuffer_read_space(const jack_ringbuffer_t * rb)
+  {
+    const size_t w = rb->write_ptr;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const size_t r = rb->read_ptr;
+    return (w - r) & rb->size_mask;
+  }
+
+  size_t jack_ringbuffer_write_space(const jack_ringbuffer_t * rb)
+  {
+    const size_t w = rb->write_ptr;
+    const size_t r = rb->read_ptr;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return ((r - w - 1) & rb->size_mask);
+  }
+
+  void jack_ringbuffer_get_read_vector(const jack_ringbuffer_t * rb, jack_ringbuffer_data_t * vec)
+  {
+    const size_t free = jack_ringbuffer_read_space(rb);
+    const size_t r = rb->read_ptr;
+    const size_t end = r + free;
+
+    if (end > rb->size)
+    {
+      vec[0].buf = &rb->buf[r];
+      vec[0].len = rb->size - r;
+      vec[1].buf = rb->buf;
+      vec[1].len = end & rb->size_mask;
+    }
+    else
+    {
+      vec[0].buf = &rb->buf[r];
+      vec[0].len = free;
+      vec[1].buf = nullptr;
+      vec[1].len = 0;
+    }
+  }
+
+  void jack_ringbuffer_get_write_vector(const jack_ringbuffer_t * rb, jack_ringbuffer_data_t * vec)
+  {
+    const size_t free = jack_ringbuffer_write_space(rb);
+    const size_t w = rb->write_ptr;
+    const size_t end = w + free;
+
+    if (end > rb->size)
+    {
+      vec[0].buf = &rb->buf[w];
+      vec[0].len = rb->size - w;
+      vec[1].buf = rb->buf;
+      vec[1].len = end & rb->size_mask;
+    }
+    else
+    {
+      vec[0].buf = &rb->buf[w];
+      vec[0].len = free;
+      vec[1].buf = nullptr;
+      vec[1].len = 0;
+    }
+  }
+
+  size_t jack_ringbuffer_peek(jack_ringbuffer_t * rb, char * dest, size_t cnt)
+  {
+    jack_ringbuffer_data_t vec[2];
+    jack_ringbuffer_get_read_vector(rb, vec);
+
+    const size_t toRead = std::min(cnt, vec[0].len + vec[1].len);
+    const size_t first = std::min(toRead, vec[0].len);
+    memcpy(dest, vec[0].buf, first);
+    if (toRead > first)
+    {
+      memcpy(dest + first, vec[1].buf, toRead - first);
+    }
+    return toRead;
+  }
+
+  void jack_ringbuffer_read_advance(jack_ringbuffer_t * rb, size_t cnt)
+  {
+    std::atomic_thread_fence(std::memory_order_release);
+    rb->read_ptr = (rb->read_ptr + cnt) & rb->size_mask;
+  }
+
+  size_t jack_ringbuffer_read(jack_ringbuffer_t * rb, char * dest, size_t cnt)
+  {
+    const size_t done = jack_ringbuffer_peek(rb, dest, cnt);
+    jack_ringbuffer_read_advance(rb, done);
+    return done;
+  }
+
+  void jack_ringbuffer_write_advance(jack_ringbuffer_t * rb, size_t cnt)
+  {
+    std::atomic_thread_fence(std::memory_order_release);
+    rb->write_ptr = (rb->write_ptr + cnt) & rb->size_mask;
+  }
+
+  size_t jack_ringbuffer_write(jack_ringbuffer_t * rb, const char * src, size_t cnt)
+  {
+    jack_ringbuffer_data_t vec[2];
+    jack_ringbuffer_get_write_vector(rb, vec);
+
+    const size_t toWrite = std::min(cnt, vec[0].len + vec[1].len);
+    const size_t first = std::min(toWrite, vec[0].len);
+    memcpy(vec[0].buf, src, first);
+    if (toWrite > first)
+    {
+      memcpy(vec[1].buf, src + first, toWrite - first);
+    }
+    jack_ringbuffer_write_advance(rb, toWrite);
+    return toWrite;
+  }
+
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <jack/jack.h>
+#include <vector>
+
+/*
+  The offline driver links against this file instead of libjack.
+
+  It implements the subset of the JACK API used by the handlers,
+  so the same I_JackHandler chain can be run without a server,
+  as fast as the CPU allows.
+
+  A client owns its ports; there is no global state, so different clients
+  can be used concurrently from different threads.
+*/
+
+namespace ASI
+{
+  namespace Offline
+  {
+
+    // transport starts rolling from frame 0
+    jack_client_t * createClient(const char * name, const jack_nframes_t sampleRate, const jack_nframes_t bufferSize);
+    void destroyClient(jack_client_t * client);
+
+    // in registration order
+    std::vector<jack_port_t *> getPorts(jack_client_t * client);
+
+    // to be called after each cycle:
+    // advances the frame time and applies pending transport requests
+    void advance(jack_client_t * client, const jack_nframes_t nframes);
+
+  }
+}
@@ -0,0 +1,256 @@
+#include "offline/OfflineRenderer.h"
+#include "offline/OfflineJack.h"
+#include "offline/WavWriter.h"
+#include "handlers/player/PlayerParameters.h"
+#include "MidiFile.h"
+#include "Factory.h"
+
+#include <jack/midiport.h>
+
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+
+namespace
+{
+
+  // handler construction is not guaranteed to be thread safe
+  // (e.g. the noise generator of the synthesiser)
+  std::mutex factoryMutex;
+
+  bool endsWith(const std::string & s, const std::string & suffix)
+  {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+  }
+
+  void loadEvents(const std::string & filename, const jack_nframes_t sampleRate, std::vector<ASI::MidiEvent> & events)
+  {
+    if (endsWith(filename, ".json"))
+    {
+      const std::shared_ptr<const ASI::Player::Melody> melody = ASI::Player::loadPlayerMelody(filename);
+      ASI::Player::processMelody(*melody, 1, sampleRate, 0, events);
+    }
+    else
+    {
+      ASI::loadMidiFile(filename, sampleRate, events);
+    }
+  }
+
+  class Client
+  {
+  public:
+    Client(const jack_nframes_t sampleRate, const jack_nframes_t bufferSize)
+      : m_client(ASI::Offline::createClient("AsiSynth", sampleRate, bufferSize))
+    {
+    }
+
+    ~Client()
+    {
+      for (auto & handler : m_handlers)
+      {
+	handler->shutdown();
+      }
+      // handlers must go before the client
+      m_handlers.clear();
+      ASI::Offline::destroyClient(m_client);
+    }
+
+    jack_client_t * get() const
+    {
+      return m_client;
+    }
+
+    std::vector<std::shared_ptr<ASI::I_JackHandler> > & handlers()
+    {
+      return m_handlers;
+    }
+
+  private:
+    jack_client_t * m_client;
+    std::vector<std::shared_ptr<ASI::I_JackHandler> > m_handlers;
+  };
+
+  void connect(jack_client_t * client, jack_port_t * source, jack_port_t * destination)
+  {
+    if (jack_connect(client, jack_port_name(source), jack_port_name(destination)))
+    {
+      throw std::runtime_error(std::string("Cannot connect ") + jack_port_name(source) + " to " + jack_port_name(destination));
+    }
+  }
+
+  void connectChain(jack_client_t * client, jack_port_t * midiSource, jack_port_t * audioSink)
+  {
+    jack_port_t * source = midiSource;
+
+    for (jack_port_t * port : ASI::Offline::getPorts(client))
+    {
+      if (port == midiSource || port == audioSink)
+      {
+	continue;
+      }
+
+      const int flags = jack_port_flags(port);
+      const bool midi = std::string(jack_port_type(port)) == JACK_DEFAULT_MIDI_TYPE;
+
+      if (midi)
+      {
+	if (flags & JackPortIsInput)
+	{
+	  connect(client, source, port);
+	}
+	else if (flags & JackPortIsOutput)
+	{
+	  source = port;
+	}
+      }
+      else if (flags & JackPortIsOutput)
+      {
+	connect(client, port, audioSink);
+      }
+    }
+  }
+
+}
+
+namespace ASI
+{
+  namespace Offline
+  {
+
+    RenderStatistics renderFile(const RenderOptions & options, const std::string & input, const std::string & output)
+    {
+      const jack_nframes_t bufferSize = options.bufferSize;
+
+      std::vector<MidiEvent> events;
+      loadEvents(input, options.sampleRate, events);
+
+      Client client(options.sampleRate, bufferSize);
+
+      jack_port_t * midiSource = jack_port_register(client.get(), "render_out", JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput, 0);
+      jack_port_t * audioSink = jack_port_register(client.get(), "render_in", JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+
+      std::vector<std::shared_ptr<I_JackHandler> > & handlers = client.handlers();
+      {
+	std::vector<std::string> arguments(1, "asirender");
+	arguments.insert(arguments.end(), options.handlerArguments.begin(), options.handlerArguments.end());
+
+	std::vector<char *> argv;
+	for (std::string & argument : arguments)
+	{
+	  argv.push_back(&argument[0]);
+	}
+
+	// not used offline
+	ClientOptions clientOptions;
+
+	std::lock_guard<std::mutex> lock(factoryMutex);
+	if (!createHandlers(argv.size(), argv.data(), client.get(), handlers, clientOptions))
+	{
+	  throw std::runtime_error("Invalid handler options");
+	}
+      }
+
+      if (handlers.empty())
+      {
+	throw std::runtime_error("No handler selected");
+      }
+
+      connectChain(client.get(), midiSource, audioSink);
+
+      WavWriter wav(output, options.sampleRate, 1);
+
+      const jack_nframes_t lastEvent = events.empty() ? 0 : events.back().m_time;
+      const jack_nframes_t total = lastEvent + options.tail * options.sampleRate;
+
+      RenderStatistics statistics;
+      statistics.frames = 0;
+      statistics.cycles = 0;
+
+      size_t next = 0;
+
+      const auto t0 = std::chrono::steady_clock::now();
+
+      while (statistics.frames < total)
+      {
+	const jack_nframes_t frame = statistics.frames;
+
+	void * midiBuffer = jack_port_get_buffer(midiSource, bufferSize);
+	jack_midi_clear_buffer(midiBuffer);
+
+	while (next < events.size() && events[next].m_time < frame + bufferSize)
+	{
+	  const MidiEvent & event = events[next];
+	  jack_midi_event_write(midiBuffer, event.m_time - frame, event.m_data, event.m_size);
+	  ++next;
+	}
+
+	for (auto & handler : handlers)
+	{
+	  handler->process(bufferSize);
+	}
+
+	const jack_default_audio_sample_t * audio = (const jack_default_audio_sample_t *)jack_port_get_buffer(audioSink, bufferSize);
+	wav.write(audio, bufferSize);
+
+	advance(client.get(), bufferSize);
+
+	statistics.frames += bufferSize;
+	++statistics.cycles;
+      }
+
+      const auto t1 = std::chrono::steady_clock::now();
+      statistics.renderSeconds = std::chrono::duration<double>(t1 - t0).count();
+
+      wav.close();
+
+      return statistics;
+    }
+
+    void renderFiles(const RenderOptions & options, const size_t threads, std::vector<RenderJob> & jobs)
+    {
+      std::atomic<size_t> next(0);
+
+      auto worker = [&]()
+	{
+	  while (true)
+	  {
+	    const size_t i = next++;
+	    if (i >= jobs.size())
+	    {
+	      break;
+	    }
+
+	    RenderJob & job = jobs[i];
+	    try
+	    {
+	      job.statistics = renderFile(options, job.input, job.output);
+	    }
+	    catch (const std::exception & e)
+	    {
+	      job.error = e.what();
+	    }
+	  }
+	};
+
+      const size_t numberOfThreads = std::max<size_t>(1, std::min(threads, jobs.size()));
+
+      std::vector<std::thread> pool;
+      for (size_t i = 1; i < numberOfThreads; ++i)
+      {
+	pool.push_back(std::thread(worker));
+      }
+
+      // the calling thread works too
+      worker();
+
+      for (std::thread & thread : pool)
+      {
+	thread.join();
+      }
+    }
+
+  }
+}
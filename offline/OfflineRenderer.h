@@ -0,0 +1,53 @@
+#pragma once
+
+#include <jack/jack.h>
+
+#include <string>
+#include <vector>
+
+namespace ASI
+{
+  namespace Offline
+  {
+
+    struct RenderOptions
+    {
+      jack_nframes_t sampleRate;
+      jack_nframes_t bufferSize;
+      double tail;            // seconds rendered after the last event
+
+      // same as asisynth's, they select and configure the handlers
+      std::vector<std::string> handlerArguments;
+    };
+
+    struct RenderStatistics
+    {
+      jack_nframes_t frames;
+      size_t cycles;
+      double renderSeconds;   // only the process loop
+    };
+
+    struct RenderJob
+    {
+      std::string input;      // .mid or a PlayerHandler melody (.json)
+      std::string output;     // .wav
+
+      RenderStatistics statistics;
+      std::string error;      // empty if ok
+    };
+
+    /*
+      Feeds the events of the input through the handler chain
+      in blocks of bufferSize and writes the audio outputs (mixed) to a WAV file.
+
+      MIDI ports are daisy chained in registration order:
+      each MIDI input is connected to the most recent MIDI output (the input file to start with).
+    */
+    RenderStatistics renderFile(const RenderOptions & options, const std::string & input, const std::string & output);
+
+    // render all jobs using up to "threads" threads
+    // errors are reported in RenderJob::error
+    void renderFiles(const RenderOptions & options, const size_t threads, std::vector<RenderJob> & jobs);
+
+  }
+}
@@ -0,0 +1,111 @@
+#include "offline/WavWriter.h"
+
+#include <stdexcept>
+
+namespace
+{
+
+  const uint16_t WAVE_FORMAT_IEEE_FLOAT = 3;
+
+  void put16(std::ostream & out, const uint16_t value)
+  {
+    const char data[2] = {char(value & 0xff), char(value >> 8)};
+    out.write(data, sizeof(data));
+  }
+
+  void put32(std::ostream & out, const uint32_t value)
+  {
+    const char data[4] = {char(value & 0xff), char((value >> 8) & 0xff), char((value >> 16) & 0xff), char(value >> 24)};
+    out.write(data, sizeof(data));
+  }
+
+  // positions of the fields we patch in close()
+  const std::streamoff RIFF_SIZE = 4;
+  const std::streamoff FACT_FRAMES = 46;
+  const std::streamoff DATA_SIZE = 54;
+  const uint32_t HEADER_SIZE = 58;
+
+}
+
+namespace ASI
+{
+  namespace Offline
+  {
+
+    WavWriter::WavWriter(const std::string & filename, const jack_nframes_t sampleRate, const uint16_t channels)
+      : m_output(filename.c_str(), std::ios::binary), m_channels(channels), m_frames(0)
+    {
+      if (!m_output)
+      {
+	throw std::runtime_error("Cannot open output file: " + filename);
+      }
+
+      const uint16_t bytesPerSample = sizeof(float);
+
+      m_output.write("RIFF", 4);
+      put32(m_output, HEADER_SIZE - 8);
+      m_output.write("WAVE", 4);
+
+      m_output.write("fmt ", 4);
+      put32(m_output, 18);
+      put16(m_output, WAVE_FORMAT_IEEE_FLOAT);
+      put16(m_output, m_channels);
+      put32(m_output, sampleRate);
+      put32(m_output, sampleRate * m_channels * bytesPerSample);
+      put16(m_output, m_channels * bytesPerSample);
+      put16(m_output, 8 * bytesPerSample);
+      put16(m_output, 0);
+
+      // non PCM formats need a fact chunk
+      m_output.write("fact", 4);
+      put32(m_output, 4);
+      put32(m_output, 0);
+
+      m_output.write("data", 4);
+      put32(m_output, 0);
+    }
+
+    WavWriter::~WavWriter()
+    {
+      try
+      {
+	close();
+      }
+      catch (const std::exception &)
+      {
+      }
+    }
+
+    void WavWriter::write(const jack_default_audio_sample_t * data, const size_t frames)
+    {
+      // WAV is little endian, like the machines we run on
+      const size_t size = sizeof(jack_default_audio_sample_t) * frames * m_channels;
+      m_output.write(reinterpret_cast<const char *>(data), size);
+      m_frames += frames;
+    }
+
+    void WavWriter::close()
+    {
+      if (!m_output.is_open())
+      {
+	return;
+      }
+
+      const uint32_t dataSize = m_frames * m_channels * sizeof(float);
+
+      m_output.seekp(RIFF_SIZE);
+      put32(m_output, HEADER_SIZE - 8 + dataSize);
+      m_output.seekp(FACT_FRAMES);
+      put32(m_output, m_frames);
+      m_output.seekp(DATA_SIZE);
+      put32(m_output, dataSize);
+
+      m_output.close();
+      if (m_output.fail())
+      {
+	throw std::runtime_error("Error writing WAV file");
+      }
+    }
+
+  }
+}
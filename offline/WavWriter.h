@@ -0,0 +1,36 @@
+#pragma once
+
+#include <jack/jack.h>
+
+#include <string>
+#include <fstream>
+#include <cstdint>
+
+namespace ASI
+{
+  namespace Offline
+  {
+
+    /*
+      32 bit float WAV file
+      sizes in the header are patched when the file is closed
+    */
+    class WavWriter
+    {
+    public:
+      WavWriter(const std::string & filename, const jack_nframes_t sampleRate, const uint16_t channels);
+      ~WavWriter();
+
+      // interleaved if more than 1 channel
+      void write(const jack_default_audio_sample_t * data, const size_t frames);
+
+      void close();
+
+    private:
+      std::ofstream m_output;
+      const uint16_t m_channels;
+      uint32_t m_frames;
+    };
+
+  }
+}
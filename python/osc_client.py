@@ -0,0 +1,45 @@
+import random
+import socket
+import struct
+import time
+
+# see handlers/osc/OscHandler.h, no OSC library needed
+
+NTP_UNIX_OFFSET = 2208988800
+
+
+def pad(data):
+    return data + b"\0" * (4 - len(data) % 4)
+
+
+def message(address, *arguments):
+    types = "," + "i" * len(arguments)
+    values = b"".join(struct.pack(">i", a) for a in arguments)
+    return pad(address.encode()) + pad(types.encode()) + values
+
+
+def bundle(when, *messages):
+    seconds = when + NTP_UNIX_OFFSET
+    timetag = (int(seconds) << 32) | int((seconds % 1) * (1 << 32))
+    elements = b"".join(struct.pack(">i", len(m)) + m for m in messages)
+    return pad(b"#bundle") + struct.pack(">Q", timetag) + elements
+
+
+sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+target = ("127.0.0.1", 9000)
+
+while True:
+    note = random.randrange(20, 100)
+    now = time.time()
+
+    # an arpeggio, timed by the receiver
+    sock.sendto(bundle(now + 0.05, message("/note/on", 1, note, 0x67)), target)
+    sock.sendto(bundle(now + 0.10, message("/note/on", 1, note + 3, 0x67)), target)
+    sock.sendto(bundle(now + 0.15, message("/note/on", 1, note + 5, 0x67)), target)
+    time.sleep(0.5)
+
+    sock.sendto(bundle(time.time() + 0.05,
+                       message("/note/off", 1, note),
+                       message("/note/off", 1, note + 3),
+                       message("/note/off", 1, note + 5)), target)
+    time.sleep(1)
@@ -0,0 +1,20 @@
+import zmq
+import struct
+
+# see handlers/server/WireFormat.h and asisynth --publish
+HEADER = struct.Struct("<BBHIq")
+
+context = zmq.Context()
+socket = context.socket(zmq.SUB)
+socket.connect("tcp://localhost:5557")
+socket.setsockopt(zmq.SUBSCRIBE, b"")
+
+while True:
+    message = socket.recv()
+    position = 0
+    while position < len(message):
+        version, reference, size, _, frame = HEADER.unpack_from(message, position)
+        position += HEADER.size
+        data = message[position:position + size]
+        position += size
+        print(frame, data.hex())
@@ -0,0 +1,39 @@
+import zmq
+import random
+import struct
+import time
+
+# see handlers/server/WireFormat.h
+SENDER_MICROSECONDS = 0
+
+
+def send(socket, data):
+    now = time.monotonic_ns() // 1000
+    header = struct.pack("<BBHIq", 1, SENDER_MICROSECONDS, len(data), 0, now)
+    socket.send(header + data)
+
+
+def noteon(socket, note, velocity):
+    send(socket, bytes([0x90, note, velocity]))
+
+
+def noteoff(socket, note):
+    send(socket, bytes([0x80, note, 0]))
+
+
+context = zmq.Context()
+socket = context.socket(zmq.PUB)
+socket.bind("tcp://*:5556")
+
+while True:
+    note = random.randrange(20, 100)
+
+    noteon(socket, note, 0x67)
+    noteon(socket, note + 3, 0x67)
+    noteon(socket, note + 5, 0x67)
+    time.sleep(0.1)
+
+    noteoff(socket, note)
+    noteoff(socket, note + 3)
+    noteoff(socket, note + 5)
+    time.sleep(1)